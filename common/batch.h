@@ -0,0 +1,181 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __BATCH_H
+#define __BATCH_H
+
+// Job records for the batch drivers and query daemons, and the cache
+// that keeps computed distributions between jobs. Header only, like
+// sweep.h.
+
+#include <string>
+#include <map>
+#include <list>
+#include <initializer_list>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+/* A job record is one line of whitespace-separated name=value fields,
+   for instance
+
+     id=7 tool=pow hon_param=0.1 delta=2 adv_param=0.04 approx_error=1e-6 spike=5 w=40
+
+   Blank lines and lines starting with '#' hold no job. Results go out
+   the same way, one line per result, led by the job's id and tool. */
+
+class JobRecord {
+public:
+  JobRecord(const std::string& line) {
+    std::istringstream fields(line);
+    std::string field;
+    while (fields >> field) {
+      size_t equals = field.find('=');
+      if ((equals == std::string::npos) || (equals == 0))
+	throw std::invalid_argument("JOB: expected name=value, got " + field);
+      values[field.substr(0, equals)] = field.substr(equals + 1); }
+  }
+  static bool blank(const std::string& line) {
+    size_t first = line.find_first_not_of(" \t\r");
+    return((first == std::string::npos) || (line[first] == '#'));
+  }
+  bool has(const std::string& name) const {
+    return(values.count(name) > 0);
+  }
+  std::string text(const std::string& name) const {
+    std::map<std::string, std::string>::const_iterator value = values.find(name);
+    if (value == values.end()) throw std::invalid_argument("JOB: missing " + name);
+    return(value->second);
+  }
+  std::string text(const std::string& name, const std::string& otherwise) const {
+    return(has(name) ? text(name) : otherwise);
+  }
+  double number(const std::string& name) const {
+    std::string value = text(name);
+    size_t used = 0;
+    double result = 0;
+    try { result = std::stod(value, &used); } catch (std::exception&) { used = 0; }
+    if ((used == 0) || (used != value.size())) throw std::invalid_argument("JOB: " + name + " is not a number");
+    return(result);
+  }
+  double number(const std::string& name, double otherwise) const {
+    return(has(name) ? number(name) : otherwise);
+  }
+  int integer(const std::string& name) const {
+    double value = number(name);
+    if (value != int(value)) throw std::invalid_argument("JOB: " + name + " is not an integer");
+    return(int(value));
+  }
+  int integer(const std::string& name, int otherwise) const {
+    return(has(name) ? integer(name) : otherwise);
+  }
+  // "id=... tool=...", the start of every result line of this job.
+  std::string lead() const {
+    return("id=" + text("id", "-") + " tool=" + text("tool", "-"));
+  }
+private:
+  std::map<std::string, std::string> values;
+};
+
+// Error results quote the message, which may hold spaces.
+inline std::string error_field(const std::string& message) {
+  std::string quoted = "error=\"";
+  for (char letter : message)
+    quoted = quoted + ((letter == '"') ? '\'' : letter);
+  return(quoted + "\"");
+}
+
+// Key text for a cache: the values given, at full precision.
+inline std::string cache_key(std::initializer_list<double> values) {
+  std::ostringstream key;
+  key << std::setprecision(17);
+  for (double value : values)
+    key << value << " ";
+  return(key.str());
+}
+
+/* Owns up to capacity values, and values of at most budget bytes in
+   all if a budget is given, dropping the least recently used to stay
+   within both; the most recent value is kept whatever its size. A
+   pointer from find() or insert() stays good until the next insert()
+   or resize(). */
+
+template <class Value> class LruCache {
+public:
+  size_t hits, misses;
+  LruCache(size_t init_capacity,
+	   size_t init_budget = 0) : hits(0), misses(0),
+				     capacity(init_capacity > 0 ? init_capacity : 1),
+				     budget(init_budget),
+				     bytes(0) {}
+  ~LruCache() {
+    for (typename std::list<Entry>::iterator entry = entries.begin(); entry != entries.end(); entry++)
+      delete(entry->value);
+  }
+  Value* find(const std::string& key) {
+    typename std::map<std::string, typename std::list<Entry>::iterator>::iterator place = index.find(key);
+    if (place == index.end()) {
+      misses++;
+      return(NULL); }
+    hits++;
+    entries.splice(entries.begin(), entries, place->second);
+    return(place->second->value);
+  }
+  Value* insert(const std::string& key, Value* value, size_t value_bytes = 0) {
+    if (index.count(key)) throw std::invalid_argument("CACHE: key already present");
+    Entry entry = {key, value, value_bytes};
+    entries.push_front(entry);
+    index[key] = entries.begin();
+    bytes = bytes + value_bytes;
+    trim();
+    return(value);
+  }
+  // A value has grown or shrunk in place; it becomes the most recent.
+  void resize(const std::string& key, size_t value_bytes) {
+    if (find(key) == NULL) throw std::invalid_argument("CACHE: no such key");
+    hits--;
+    bytes = bytes - entries.front().bytes + value_bytes;
+    entries.front().bytes = value_bytes;
+    trim();
+  }
+  size_t size() const {
+    return(entries.size());
+  }
+  size_t used() const {
+    return(bytes);
+  }
+private:
+  struct Entry {
+    std::string key;
+    Value*      value;
+    size_t      bytes;
+  };
+  size_t                  capacity;
+  size_t                  budget;    // 0 for none
+  size_t                  bytes;
+  std::list<Entry>        entries;   // most recently used first
+  std::map<std::string, typename std::list<Entry>::iterator> index;
+  void trim() {
+    while ((entries.size() > capacity)
+	   || ((budget > 0) && (bytes > budget) && (entries.size() > 1))) {
+      delete(entries.back().value);
+      bytes = bytes - entries.back().bytes;
+      index.erase(entries.back().key);
+      entries.pop_back(); }
+  }
+};
+
+#endif
@@ -0,0 +1,228 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __BENCH_H
+#define __BENCH_H
+
+// Timing, reporting and baseline comparison for the per-directory
+// bench programs. Header only, like sweep.h.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <unistd.h>
+
+struct BenchResult {
+  std::string kernel;
+  std::string params;
+  int         threads;
+  double      seconds;   // per call, or per call-equivalent of throughput
+  double      updates;   // state cells produced per call
+  double      bytes;     // nominal memory traffic per call
+  double ns_per_update() const { return(1e9 * seconds / updates); }
+  double gbs() const { return(bytes / seconds / 1e9); }
+};
+
+inline double bench_now() {
+  return(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/* Runs kernel(thread) on `threads' threads at once, each over and over
+   on its own data, for at least min_seconds of wall time after one
+   warm-up call each, and returns wall time over calls made: the time
+   per call for one thread, the inverse throughput for more. */
+inline double time_throughput(int threads,
+			      std::function<void(int)> kernel,
+			      double min_seconds) {
+  for (int thread = 0; thread < threads; thread++)
+    kernel(thread);
+  std::atomic<bool> stop(false);
+  std::atomic<long> calls(0);
+  double start = bench_now();
+  std::vector<std::thread> runners;
+  for (int thread = 0; thread < threads; thread++)
+    runners.push_back(std::thread([&, thread] {
+	  do {
+	    kernel(thread);
+	    calls++;
+	  } while (!stop); }));
+  while (bench_now() - start < min_seconds)
+    usleep(1000);
+  stop = true;
+  for (std::thread& runner : runners)
+    runner.join();
+  return((bench_now() - start) / calls);
+}
+
+// Best of several timed batches of a kernel that is parallel itself.
+inline double time_kernel(std::function<void()> kernel, double min_seconds) {
+  kernel();
+  double best = 1e300;
+  for (int batch = 0; batch < 3; batch++) {
+    long calls = 0;
+    double start = bench_now(), elapsed;
+    do {
+      kernel();
+      calls++;
+      elapsed = bench_now() - start;
+    } while (elapsed < min_seconds / 3);
+    best = std::min(best, elapsed / calls); }
+  return(best);
+}
+
+/* STREAM triad, a[i] = b[i] + s c[i], on arrays well beyond any cache,
+   split among `threads' threads that each first touch and then sweep
+   their own share, as STREAM does under OpenMP: best of five, counting
+   24 bytes an element. */
+inline double stream_triad_gbs(int threads = 1, size_t elements = 1 << 23) {
+  threads = std::max(1, threads);
+  size_t share = std::max(size_t(1), elements / threads);
+  std::vector<std::vector<double> > a(threads), b(threads), c(threads);
+  auto together = [threads](std::function<void(int)> part) {
+    std::vector<std::thread> runners;
+    for (int thread = 0; thread < threads; thread++)
+      runners.push_back(std::thread(part, thread));
+    for (std::thread& runner : runners)
+      runner.join();
+  };
+  together([&](int thread) {
+      a[thread].assign(share, 0.0);
+      b[thread].assign(share, 1.0);
+      c[thread].assign(share, 2.0); });
+  double best = 1e300;
+  for (int trial = 0; trial < 5; trial++) {
+    double start = bench_now();
+    together([&](int thread) {
+	double* to = &a[thread][0];
+	const double* from = &b[thread][0];
+	const double* scaled = &c[thread][0];
+	for (size_t i = 0; i < share; i++)
+	  to[i] = from[i] + 3.0 * scaled[i]; });
+    best = std::min(best, bench_now() - start); }
+  for (int thread = 0; thread < threads; thread++)
+    if (a[thread][share / 2] != 7.0) throw std::runtime_error("BENCH: triad went wrong");
+  return(24.0 * share * threads / best / 1e9);
+}
+
+inline std::string json_field(const std::string& line, const std::string& name) {
+  std::string tag = "\"" + name + "\": ";
+  size_t at = line.find(tag);
+  if (at == std::string::npos) return("");
+  at = at + tag.size();
+  if (line[at] == '"') return(line.substr(at + 1, line.find('"', at + 1) - at - 1));
+  return(line.substr(at, line.find_first_of(",}", at) - at));
+}
+
+/* Results go out as JSON, one result object to a line, so that
+   compare() can read a baseline back without a JSON library:
+
+     {"tool": "pos", "stream_gbs": {"1": 11.2, "2": 19.5}, "results": [
+       {"kernel": "convolve", "params": "p=0.4", "threads": 1, "seconds": ..., ...},
+       ...
+     ]}
+*/
+
+class BenchReport {
+public:
+  const std::string tool;
+  std::map<int, double> stream_gbs;  // triad bandwidth by thread count
+  std::vector<BenchResult> results;
+  BenchReport(const std::string& init_tool) : tool(init_tool) {}
+  // The triad on each thread count, for the "% of STREAM" of results
+  // on as many threads.
+  void measure_stream(const std::vector<int>& counts) {
+    for (int threads : counts) {
+      stream_gbs[threads] = stream_triad_gbs(threads);
+      std::cout << "STREAM triad    threads " << threads << ": " << stream_gbs[threads] << " GB/s" << std::endl; }
+  }
+  void add(const BenchResult& result) {
+    results.push_back(result);
+    std::ostringstream line;
+    line << std::left << std::setw(16) << result.kernel << std::setw(32) << result.params
+	 << " threads " << std::setw(3) << result.threads << std::right << std::fixed
+	 << std::setprecision(3) << std::setw(12) << result.ns_per_update() << " ns/update "
+	 << std::setw(8) << result.gbs() << " GB/s";
+    std::map<int, double>::const_iterator stream = stream_gbs.find(result.threads);
+    if ((stream != stream_gbs.end()) && (stream->second > 0))
+      line << std::setw(7) << std::setprecision(1) << 100 * result.gbs() / stream->second << "% of STREAM";
+    std::cout << line.str() << std::endl;
+  }
+  void write(std::ostream& out) const {
+    out << std::setprecision(9);
+    out << "{\"tool\": \"" << tool << "\", \"stream_gbs\": {";
+    for (std::map<int, double>::const_iterator stream = stream_gbs.begin(); stream != stream_gbs.end(); stream++)
+      out << ((stream == stream_gbs.begin()) ? "" : ", ") << "\"" << stream->first << "\": " << stream->second;
+    out << "}, \"results\": [\n";
+    for (size_t at = 0; at < results.size(); at++) {
+      const BenchResult& result = results[at];
+      out << "  {\"kernel\": \"" << result.kernel << "\", \"params\": \"" << result.params
+	  << "\", \"threads\": " << result.threads << ", \"seconds\": " << result.seconds
+	  << ", \"updates\": " << result.updates << ", \"bytes\": " << result.bytes
+	  << ", \"ns_per_update\": " << result.ns_per_update() << ", \"gbs\": " << result.gbs()
+	  << "}" << ((at + 1 < results.size()) ? "," : "") << "\n"; }
+    out << "]}\n";
+  }
+  // Flags results slower than the baseline's by more than noise (a
+  // fraction); returns how many.
+  int compare(const std::string& baseline, double noise, std::ostream& out) const {
+    std::ifstream in(baseline.c_str());
+    if (!in) throw std::runtime_error("BENCH: cannot read baseline " + baseline);
+    out << std::setprecision(4);
+    int regressions = 0, matched = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+      std::string kernel = json_field(line, "kernel");
+      if (kernel.empty()) continue;
+      std::string params = json_field(line, "params");
+      int threads = std::stoi(json_field(line, "threads"));
+      double before = std::stod(json_field(line, "ns_per_update"));
+      for (const BenchResult& result : results)
+	if ((result.kernel == kernel) && (result.params == params) && (result.threads == threads)) {
+	  matched++;
+	  double ratio = result.ns_per_update() / before;
+	  if (ratio > 1 + noise) {
+	    regressions++;
+	    out << "REGRESSION " << kernel << " " << params << " threads " << threads << ": "
+		<< before << " -> " << result.ns_per_update() << " ns/update (x" << ratio << ")\n"; }}}
+    out << matched << " results compared with " << baseline << ", " << regressions
+	<< " slower by more than " << 100 * noise << "%\n";
+    return(regressions);
+  }
+};
+
+// Thread counts for scaling runs: 1, 2, 4, ... and the hardware's own,
+// or limit if that is fewer.
+inline std::vector<int> thread_counts(int limit = 0) {
+  int most = std::max(1u, std::thread::hardware_concurrency());
+  if (limit > 0) most = std::min(most, limit);
+  std::vector<int> counts;
+  for (int count = 1; count < most; count = 2 * count)
+    counts.push_back(count);
+  counts.push_back(most);
+  return(counts);
+}
+
+#endif
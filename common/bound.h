@@ -0,0 +1,337 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __BOUND_H
+#define __BOUND_H
+
+/*
+  Large-deviation bounds on the margin walk, for the bound-first sweeps
+  (-b target), which evolve a point only when the bounds leave open
+  whether its density is at most the target.
+
+  Without its barrier and its range, the chain of a tool (markov.h) is
+  a Markov additive walk: the phase moves as a Markov chain, beta by
+  the honest shift plus the adversarial advance. Tilted by exp(theta
+  beta), a step is the phases x phases matrix
+
+    M(theta)[i][j] = A(theta) sum of weight exp(theta shift)
+                     over the honest outcomes moving i to j,
+
+  A(theta) the generating function of the advance, and
+  E[exp(theta beta_w); phase_0 = i] = exp(theta beta_0) (M(theta)^w 1)[i].
+  Markov's inequality then bounds the tails, Chernoff's way,
+
+    P(beta_w >= x) <= exp(-theta x) E exp(theta beta_w),  theta > 0
+    P(beta_w <= x) <= exp(-theta x) E exp(theta beta_w),  theta < 0
+
+  and, by a union over the steps, reaching x by step w,
+
+    P(beta_n <= x for some n <= w)
+      <= exp(-theta x) sum over n <= w of E exp(theta beta_n),  theta < 0.
+
+  Every theta gives a bound. The best is found by golden section on the
+  log of the bound, which is convex in theta. The powers and sums of
+  M(theta) are taken by doubling, with a log scale kept aside, so a theta
+  costs about phases^3 log w operations against the phases x rows x w
+  of an evolution.
+
+  The start is given by its generating function per phase, in logs:
+  start(theta)[i] = log E[exp(theta beta_0); phase_0 = i]. The walk has
+  no range, so the bounds hold for the untruncated chain; an evolution
+  differs from that by the mass it lost past its range.
+  Header only, like sweep.h.
+*/
+
+#include <vector>
+#include <string>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <cmath>
+#include "markov.h"
+
+struct DensityBounds {
+  double lower;
+  double upper;
+};
+
+enum BoundVerdict {bound_below, bound_above, bound_open};
+
+// Whether the bounds settle the density being at most target.
+inline BoundVerdict bound_verdict(const DensityBounds& bounds, double target) {
+  if (bounds.upper <= target) return(bound_below);
+  if (bounds.lower > target) return(bound_above);
+  return(bound_open);
+}
+
+// The key of a point in a -b result log.
+inline std::string bound_key(const std::string& key, double target) {
+  std::ostringstream result;
+  result << key << " threshold=" << std::setprecision(12) << target;
+  return(result.str());
+}
+
+// A point's line in a -b result log: the density, or the bound that
+// settled it, whether it is at most the target, and how it was found.
+inline std::string bound_result(double value, double target, bool exact) {
+  std::ostringstream result;
+  result << std::setprecision(17) << value << ((value <= target) ? " below" : " above")
+	 << (exact ? " exact" : " bound");
+  return(result.str());
+}
+
+// The points of a -b sweep by the way they were answered.
+struct BoundTally {
+  std::atomic<int> below;
+  std::atomic<int> above;
+  std::atomic<int> exact;
+  BoundTally() : below(0), above(0), exact(0) {}
+  void count(BoundVerdict verdict) {
+    if (verdict == bound_below) below++;
+    else if (verdict == bound_above) above++;
+    else exact++;
+  }
+  std::string report() const {
+    std::ostringstream text;
+    text << (below + above) << " points settled by the bound (" << below << " below, "
+	 << above << " above the target), " << exact << " by evolution";
+    return(text.str());
+  }
+};
+
+typedef std::function<std::vector<double>(double)> BoundStart;
+
+// log(sum of exp(logs)), for the generating functions of a start.
+inline double bound_log_sum(const std::vector<double>& logs) {
+  double top = -HUGE_VAL;
+  for (double value : logs)
+    top = std::max(top, value);
+  if (!std::isfinite(top)) return(top);
+  double sum = 0;
+  for (double value : logs)
+    sum = sum + std::exp(value - top);
+  return(top + std::log(sum));
+}
+
+class BoundWalk {
+public:
+  const int phases;
+  /* The walk of a chain; advance(theta), if given, is the log of the
+     adversarial generating function, for chains whose advance the
+     chain truncates (pow's Poisson to its range). */
+  template <class Chain> BoundWalk(const Chain& chain,
+				   std::function<double(double)> init_advance = NULL) : phases(chain.phases()),
+											advance(init_advance) {
+    for (int phase = 0; phase < phases; phase++)
+      for (int honest = 0; honest < chain.honest_outcomes(); honest++) {
+	MarkovMove move = chain.move(phase, honest);
+	Move kept = {phase, move.phase, move.shift, double(chain.honest_weight(honest))};
+	if (kept.weight > 0) moves.push_back(kept); }
+    for (int adversarial = 0; adversarial < chain.adversarial_outcomes(); adversarial++)
+      if (chain.adversarial_weight(adversarial) > 0)
+	advances.push_back(std::make_pair(adversarial, double(chain.adversarial_weight(adversarial))));
+  }
+
+  // P(beta_steps >= x).
+  double upper_tail(const BoundStart& start, int x, int steps) const {
+    return(best(1.0, [&](double theta) { return(exponent(start, theta, x, steps, false)); }));
+  }
+
+  // P(beta_steps <= x).
+  double lower_tail(const BoundStart& start, int x, int steps) const {
+    return(best(-1.0, [&](double theta) { return(exponent(start, theta, x, steps, false)); }));
+  }
+
+  // P(beta_n <= x for some n in [0 ... steps]).
+  double reach_below(const BoundStart& start, int x, int steps) const {
+    return(best(-1.0, [&](double theta) { return(exponent(start, theta, x, steps, true)); }));
+  }
+
+private:
+  struct Move {
+    int    from;
+    int    to;
+    int    shift;
+    double weight;
+  };
+  // A matrix of exp(scale) times the cells, the largest cell 1.
+  struct Scaled {
+    std::vector<double> cells;
+    double              scale;
+  };
+  std::vector<Move>                   moves;
+  std::vector<std::pair<int, double>> advances;
+  std::function<double(double)>       advance;
+
+  void normalize(Scaled& matrix) const {
+    double top = 0;
+    for (double cell : matrix.cells)
+      top = std::max(top, std::abs(cell));
+    if (top == 0) {
+      matrix.scale = -HUGE_VAL;
+      return; }
+    for (double& cell : matrix.cells)
+      cell = cell / top;
+    matrix.scale = matrix.scale + std::log(top);
+  }
+
+  Scaled identity() const {
+    Scaled result = {std::vector<double>(size_t(phases) * phases, 0.0), 0.0};
+    for (int phase = 0; phase < phases; phase++)
+      result.cells[size_t(phase) * phases + phase] = 1.0;
+    return(result);
+  }
+
+  Scaled multiply(const Scaled& a, const Scaled& b) const {
+    Scaled result = {std::vector<double>(size_t(phases) * phases, 0.0), a.scale + b.scale};
+    if (!std::isfinite(result.scale)) {
+      result.scale = -HUGE_VAL;
+      return(result); }
+    for (int i = 0; i < phases; i++)
+      for (int k = 0; k < phases; k++) {
+	double left = a.cells[size_t(i) * phases + k];
+	if (left == 0) continue;
+	for (int j = 0; j < phases; j++)
+	  result.cells[size_t(i) * phases + j] += left * b.cells[size_t(k) * phases + j]; }
+    normalize(result);
+    return(result);
+  }
+
+  Scaled add(const Scaled& a, const Scaled& b) const {
+    if (!std::isfinite(a.scale)) return(b);
+    if (!std::isfinite(b.scale)) return(a);
+    double top = std::max(a.scale, b.scale);
+    double from_a = std::exp(a.scale - top), from_b = std::exp(b.scale - top);
+    Scaled result = {std::vector<double>(a.cells.size()), top};
+    for (size_t cell = 0; cell < result.cells.size(); cell++)
+      result.cells[cell] = from_a * a.cells[cell] + from_b * b.cells[cell];
+    normalize(result);
+    return(result);
+  }
+
+  double log_advance(double theta) const {
+    if (advance) return(advance(theta));
+    std::vector<double> logs;
+    for (const std::pair<int, double>& outcome : advances)
+      logs.push_back(std::log(outcome.second) + theta * outcome.first);
+    return(bound_log_sum(logs));
+  }
+
+  Scaled step(double theta) const {
+    Scaled result = {std::vector<double>(size_t(phases) * phases, 0.0), log_advance(theta)};
+    for (const Move& move : moves)
+      result.cells[size_t(move.from) * phases + move.to] += move.weight * std::exp(theta * move.shift);
+    normalize(result);
+    return(result);
+  }
+
+  /* log (M^steps 1)[i], or with summed log (sum over n <= steps of
+     M^n 1)[i]: by doubling, or, where the steps are fewer than the
+     dense products would cost, a step at a time over the moves. */
+  std::vector<double> log_moments(double theta, int steps, bool summed) const {
+    double dense = double(phases) * phases * phases * 3 * std::log2(steps + 2.0);
+    double sparse = double(steps) * (moves.size() + phases);
+    return((sparse < dense) ? stepped(theta, steps, summed) : doubled(theta, steps, summed));
+  }
+
+  std::vector<double> stepped(double theta, int steps, bool summed) const {
+    std::vector<double> weights;
+    for (const Move& move : moves)
+      weights.push_back(move.weight * std::exp(theta * move.shift));
+    double each = log_advance(theta);
+    Scaled moment = {std::vector<double>(phases, 1.0), 0.0};
+    Scaled sum = moment;
+    for (int step = 1; (step <= steps) && std::isfinite(moment.scale); step++) {
+      Scaled next = {std::vector<double>(phases, 0.0), moment.scale + each};
+      for (size_t at = 0; at < moves.size(); at++)
+	next.cells[moves[at].from] += weights[at] * moment.cells[moves[at].to];
+      normalize(next);
+      moment = next;
+      if (summed) sum = add(sum, moment); }
+    const Scaled& kept = summed ? sum : moment;
+    std::vector<double> result(phases);
+    for (int i = 0; i < phases; i++)
+      result[i] = (kept.cells[i] > 0) ? kept.scale + std::log(kept.cells[i]) : -HUGE_VAL;
+    return(result);
+  }
+
+  /* Doubling: (P_a, S_a) = (M^a, sum over n < a of M^n) combine as
+     P_{a+b} = P_a P_b, S_{a+b} = S_a + P_a S_b. */
+  std::vector<double> doubled(double theta, int steps, bool summed) const {
+    Scaled power = identity(), sum = {std::vector<double>(size_t(phases) * phases, 0.0), -HUGE_VAL};
+    Scaled base_power = step(theta), base_sum = identity();
+    for (int left = steps; left > 0; left = left / 2) {
+      if (left % 2 == 1) {
+	sum = add(sum, multiply(power, base_sum));
+	power = multiply(power, base_power); }
+      if (left > 1) {
+	base_sum = add(base_sum, multiply(base_power, base_sum));
+	base_power = multiply(base_power, base_power); }}
+    const Scaled& kept = summed ? add(sum, power) : power;
+    std::vector<double> result(phases);
+    for (int i = 0; i < phases; i++) {
+      double row = 0;
+      for (int j = 0; j < phases; j++)
+	row = row + kept.cells[size_t(i) * phases + j];
+      result[i] = (row > 0) ? kept.scale + std::log(row) : -HUGE_VAL; }
+    return(result);
+  }
+
+  double exponent(const BoundStart& start, double theta, int x, int steps, bool summed) const {
+    std::vector<double> initial = start(theta);
+    std::vector<double> moments = log_moments(theta, steps, summed);
+    for (int i = 0; i < phases; i++)
+      initial[i] = initial[i] + moments[i];
+    double result = bound_log_sum(initial) - theta * x;
+    return(std::isnan(result) ? HUGE_VAL : result);
+  }
+
+  /* exp of the least of f(sign s) over s > 0, at most 1: out from
+     s = 1/16 by doubling while f falls, then golden section. */
+  double best(double sign, const std::function<double(double)>& f) const {
+    double high = 1.0 / 16;
+    double at_high = f(sign * high);
+    while (high < 64) {
+      double further = f(sign * 2 * high);
+      if (!(further < at_high)) break;
+      high = 2 * high;
+      at_high = further; }
+    const double golden = (std::sqrt(5.0) - 1) / 2;
+    double low = 0, top = 2 * high;
+    double a = top - golden * (top - low), b = low + golden * (top - low);
+    double fa = f(sign * a), fb = f(sign * b);
+    double least = std::min(at_high, std::min(fa, fb));
+    for (int round = 0; round < 40; round++) {
+      if (fa < fb) {
+	top = b;
+	b = a;
+	fb = fa;
+	a = top - golden * (top - low);
+	fa = f(sign * a); }
+      else {
+	low = a;
+	a = b;
+	fa = fb;
+	b = low + golden * (top - low);
+	fb = f(sign * b); }
+      least = std::min(least, std::min(fa, fb)); }
+    return(std::min(1.0, std::exp(least)));
+  }
+};
+
+#endif
@@ -0,0 +1,87 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __CABI_H
+#define __CABI_H
+
+/*
+  What the C libraries libecq, libpow and libpos (see libecq.h,
+  libpow.h, libpos.h) have in common: their result codes and the view
+  they give of a distribution's sites.
+
+  Every call that can fail returns SPIKE_OK or a negative code, and
+  leaves a message for the calling thread in the library's
+  *_last_error(). No C++ exception crosses the boundary.
+*/
+
+#define SPIKE_ABI_VERSION 1
+
+#define SPIKE_OK         0
+#define SPIKE_EINVAL    -1  /* an argument is out of range or mismatched */
+#define SPIKE_ENOMEM    -2  /* a distribution could not be allocated */
+#define SPIKE_ERUNTIME  -3  /* the computation failed */
+#define SPIKE_EUNKNOWN  -4  /* anything else */
+
+/* The sites of a distribution, read-only and in place: the value at
+   indices (i, j) is at (const char*) data + i * strides[0] + j *
+   strides[1], for i < shape[0] and j < shape[1]. Only the first
+   used[0] x used[1] of them belong to the distribution; the rest are
+   padding, not to be read. The view lives as long as the
+   distribution. What the indices mean is given by each library. */
+
+typedef struct {
+  const double* data;
+  int           rank;        /* 1 or 2; a rank 1 view has shape[1] = used[1] = 1 */
+  long          shape[2];
+  long          strides[2];  /* in bytes */
+  long          used[2];
+} spike_view;
+
+#ifdef __cplusplus
+
+#include <string>
+#include <new>
+#include <stdexcept>
+
+// Visible outside the shared library; everything else is built hidden,
+// so that libpow and libpos can share a process despite both defining
+// BarrierDistribution.
+#define SPIKE_EXPORT extern "C" __attribute__((visibility("default")))
+
+/* Runs body, turning its exceptions into result codes and keeping the
+   message in last_error, one per thread. */
+
+template <class Body> int cabi_guard(std::string& last_error, Body body) {
+  try {
+    body();
+    return(SPIKE_OK); }
+  catch (std::invalid_argument& failure) {
+    last_error = failure.what();
+    return(SPIKE_EINVAL); }
+  catch (std::bad_alloc&) {
+    last_error = "out of memory";
+    return(SPIKE_ENOMEM); }
+  catch (std::exception& failure) {
+    last_error = failure.what();
+    return(SPIKE_ERUNTIME); }
+  catch (...) {
+    last_error = "unknown failure";
+    return(SPIKE_EUNKNOWN); }
+}
+
+#endif
+
+#endif
@@ -0,0 +1,116 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __CONFORM_H
+#define __CONFORM_H
+
+// Comparison against golden values for the per-directory conform
+// programs. Header only, like sweep.h.
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+/* A computed value conforms if it is within absolute of the golden
+   value, or within relative of it as a fraction of the golden value. */
+
+struct Tolerance {
+  double relative;
+  double absolute;
+  bool within(double expected, double actual) const {
+    double allowed = std::max(absolute, relative * std::fabs(expected));
+    return(std::fabs(actual - expected) <= allowed);
+  }
+};
+
+// The comma-separated numbers of a golden field, "0.98,0.97,...".
+inline std::vector<double> golden_list(const std::string& text) {
+  std::vector<double> values;
+  std::istringstream items(text);
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    size_t used = 0;
+    double value = 0;
+    try { value = std::stod(item, &used); } catch (std::exception&) { used = 0; }
+    if ((used == 0) || (used != item.size()))
+      throw std::invalid_argument("CONFORM: bad golden value " + item);
+    values.push_back(value); }
+  return(values);
+}
+
+inline std::string golden_text(const std::vector<double>& values) {
+  std::ostringstream text;
+  text << std::setprecision(17);
+  for (size_t at = 0; at < values.size(); at++)
+    text << (at ? "," : "") << values[at];
+  return(text.str());
+}
+
+// The fields of a record line but the one named, to write it back with
+// fresh golden values.
+inline std::string without_field(const std::string& line, const std::string& name) {
+  std::istringstream fields(line);
+  std::string field, kept;
+  while (fields >> field)
+    if (field.compare(0, name.size() + 1, name + "=") != 0)
+      kept = kept + (kept.empty() ? "" : " ") + field;
+  return(kept);
+}
+
+/* Counts checks and failures, printing the first `shown' failures as
+   FAIL lines; finish() prints the tally and gives the exit status. */
+
+class ConformReport {
+public:
+  int checks;
+  int failures;
+  ConformReport(std::ostream& init_out, int init_shown = 20) : checks(0), failures(0),
+							      out(init_out), shown(init_shown) {}
+  bool value(const std::string& what, double expected, double actual, const Tolerance& tolerance) {
+    checks++;
+    if (tolerance.within(expected, actual)) return(true);
+    fail(what, expected, actual);
+    return(false);
+  }
+  bool invariant(const std::string& what, double expected, double actual, double allowed) {
+    checks++;
+    if (std::fabs(actual - expected) <= allowed) return(true);
+    fail(what, expected, actual);
+    return(false);
+  }
+  int finish(const std::string& suite) {
+    out << suite << ": " << checks << " checks, " << failures << " failed" << std::endl;
+    return((failures > 0) ? 1 : 0);
+  }
+private:
+  std::ostream& out;
+  int           shown;
+  void fail(const std::string& what, double expected, double actual) {
+    if (failures++ < shown)
+      out << "FAIL " << what << ": expected " << std::setprecision(17) << expected
+	  << ", got " << actual << " (relative error " << std::setprecision(3)
+	  << ((expected != 0) ? std::fabs(actual - expected) / std::fabs(expected) : INFINITY) << ")" << std::endl;
+    else if (failures == shown + 1)
+      out << "... further failures not shown" << std::endl;
+  }
+};
+
+#endif
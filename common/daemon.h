@@ -0,0 +1,282 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __DAEMON_H
+#define __DAEMON_H
+
+// The serving loop of the query daemons (ecqd, powd, posd). Header
+// only, like sweep.h and batch.h.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <sstream>
+#include <deque>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "batch.h"
+
+/* A request is one job record (see batch.h) on one line. The reply is
+   the job's result lines, exactly as the batch drivers write them,
+   and then a line holding only a full stop. Requests on one
+   connection are answered in order.
+
+   A request the caches already answer is answered at once on the
+   serving thread, by lookup(), which runs holding cache_lock(). Any
+   other goes to a worker thread, to handler(), so a long computation
+   holds up neither cached answers nor other connections; handler()
+   takes cache_lock() itself, only while it reads or updates the
+   caches, and computes on copies in between. A reply that is ready
+   waits for those before it on its connection. */
+
+// The lock on a daemon's caches.
+inline std::mutex& cache_lock() {
+  static std::mutex lock;
+  return(lock);
+}
+
+inline int listen_unix(const std::string& path) {
+  struct sockaddr_un address;
+  if (path.size() >= sizeof(address.sun_path)) throw std::invalid_argument("DAEMON: socket path too long");
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path.c_str());
+  unlink(path.c_str());
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if ((listener < 0) || (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0)
+      || (listen(listener, 64) != 0)) {
+    std::string failure = strerror(errno);
+    if (listener >= 0) close(listener);
+    throw std::runtime_error("DAEMON: cannot listen on " + path + ": " + failure); }
+  return(listener);
+}
+
+// Loopback only: the daemons have no access control.
+inline int listen_local_tcp(int port) {
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  if (listener >= 0) setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if ((listener < 0) || (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0)
+      || (listen(listener, 64) != 0)) {
+    std::string failure = strerror(errno);
+    if (listener >= 0) close(listener);
+    throw std::runtime_error("DAEMON: cannot listen on port " + std::to_string(port) + ": " + failure); }
+  return(listener);
+}
+
+// Sends what the socket takes now, without blocking, and erases it
+// from text; false if the connection is broken.
+inline bool send_some(int socket, std::string& text) {
+  size_t sent = 0;
+  while (sent < text.size()) {
+    ssize_t now = ::send(socket, text.data() + sent, text.size() - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (now < 0) {
+      if (errno == EINTR) continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) break;
+      return(false); }
+    sent = sent + now; }
+  text.erase(0, sent);
+  return(true);
+}
+
+struct DaemonReply {
+  std::string text;
+  bool        done;
+};
+
+struct DaemonClient {
+  std::string input;    // unfinished request text
+  std::deque<std::string> held;  // request lines not yet taken up, in order
+  std::deque<std::shared_ptr<DaemonReply> > replies;  // in request order
+  std::string output;   // replies the socket has not yet taken
+  bool        reading;  // false once the client has closed its side
+};
+
+struct DaemonTask {
+  JobRecord   job;
+  std::string lead;
+  std::shared_ptr<DaemonReply> reply;
+};
+
+/* Serves requests until the process is killed. lookup() answers a job
+   into the stream from the caches and returns true, or returns false
+   having written nothing; handler() answers it on one of `workers'
+   threads. Either throws to report an error.
+
+   Replies go out without blocking, from each connection's own buffer,
+   as its socket takes them, so a client that does not read holds up
+   no other. A tool=stats request, and every request after it on its
+   connection, waits until those before it are answered, so that the
+   figures include them. */
+inline void serve_queries(int listener,
+			  std::function<bool(const JobRecord&, std::ostream&)> lookup,
+			  std::function<void(const JobRecord&, std::ostream&)> handler,
+			  int precision,
+			  int workers) {
+  signal(SIGPIPE, SIG_IGN);
+  std::mutex queue_lock;    // tasks and the replies' text and done
+  std::condition_variable queued;
+  std::deque<DaemonTask> tasks;
+  int wake[2];              // a worker writes a byte when a reply is done
+  if (pipe(wake) != 0) throw std::runtime_error("DAEMON: cannot make a pipe");
+  for (int worker = 0; worker < std::max(1, workers); worker++)
+    std::thread([&] {
+	while (true) {
+	  std::unique_lock<std::mutex> guard(queue_lock);
+	  queued.wait(guard, [&] { return(!tasks.empty()); });
+	  DaemonTask task = tasks.front();
+	  tasks.pop_front();
+	  guard.unlock();
+	  std::ostringstream reply;
+	  reply.precision(precision);
+	  try {
+	    handler(task.job, reply); }
+	  catch (std::exception& failure) {
+	    reply << task.lead << " " << error_field(failure.what()) << "\n"; }
+	  reply << ".\n";
+	  guard.lock();
+	  task.reply->text = reply.str();
+	  task.reply->done = true;
+	  guard.unlock();
+	  char byte = 0;
+	  while ((write(wake[1], &byte, 1) < 0) && (errno == EINTR)) {} }
+      }).detach();
+
+  // Whether the client has a reply still being worked on.
+  auto waiting = [&](const DaemonClient& client) {
+    std::lock_guard<std::mutex> guard(queue_lock);
+    for (const std::shared_ptr<DaemonReply>& reply : client.replies)
+      if (!reply->done) return(true);
+    return(false);
+  };
+  // Takes up the client's held lines, in order, as far as it may.
+  auto take = [&](DaemonClient& client) {
+    while (!client.held.empty()) {
+      std::string line = client.held.front();
+      std::ostringstream answered;
+      answered.precision(precision);
+      std::string lead = "id=- tool=-";
+      bool queue = false;
+      try {
+	if (!JobRecord::blank(line)) {
+	  JobRecord job(line);
+	  lead = job.lead();
+	  if ((job.text("tool") == "stats") && waiting(client)) return;
+	  bool hit;
+	  {
+	    std::lock_guard<std::mutex> guard(cache_lock());
+	    hit = lookup(job, answered);
+	  }
+	  if (!hit) {
+	    std::shared_ptr<DaemonReply> reply(new DaemonReply());
+	    reply->done = false;
+	    client.replies.push_back(reply);
+	    DaemonTask task = {job, lead, reply};
+	    std::lock_guard<std::mutex> guard(queue_lock);
+	    tasks.push_back(task);
+	    queued.notify_one();
+	    queue = true; }}}
+      catch (std::exception& failure) {
+	answered.str("");
+	answered << lead << " " << error_field(failure.what()) << "\n"; }
+      client.held.pop_front();
+      if (queue) continue;
+      answered << ".\n";
+      std::shared_ptr<DaemonReply> reply(new DaemonReply());
+      reply->text = answered.str();
+      reply->done = true;
+      client.replies.push_back(reply); }
+  };
+
+  std::map<int, DaemonClient> clients;
+  while (true) {
+    std::vector<struct pollfd> watched(2);
+    watched[0].fd = listener;
+    watched[0].events = POLLIN;
+    watched[1].fd = wake[0];
+    watched[1].events = POLLIN;
+    for (std::map<int, DaemonClient>::iterator client = clients.begin(); client != clients.end(); client++) {
+      struct pollfd entry = {client->first, 0, 0};
+      if (client->second.reading) entry.events = entry.events | POLLIN;
+      if (!client->second.output.empty()) entry.events = entry.events | POLLOUT;
+      if (entry.events != 0) watched.push_back(entry); }
+    if (poll(&watched[0], watched.size(), -1) < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error("DAEMON: poll failed"); }
+    if (watched[0].revents & POLLIN) {
+      int client = accept(listener, NULL, NULL);
+      if (client >= 0) {
+	clients[client].input = "";
+	clients[client].reading = true; }}
+    if (watched[1].revents & POLLIN) {
+      char drained[256];
+      while (read(wake[0], drained, sizeof(drained)) < 0 && (errno == EINTR)) {} }
+    for (size_t at = 2; at < watched.size(); at++) {
+      DaemonClient& client = clients[watched[at].fd];
+      if (!client.reading || !(watched[at].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+      char chunk[4096];
+      ssize_t got = recv(watched[at].fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+      if (got < 0) {
+	if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK)) continue;
+	client.reading = false;
+	continue; }
+      if (got == 0) {
+	client.reading = false;
+	continue; }
+      client.input.append(chunk, got);
+      size_t newline;
+      while ((newline = client.input.find('\n')) != std::string::npos) {
+	client.held.push_back(client.input.substr(0, newline));
+	client.input.erase(0, newline + 1); }}
+    // Take up what may be, then send the replies that are ready and
+    // have none waiting before them, as far as each socket takes them.
+    for (std::map<int, DaemonClient>::iterator client = clients.begin(); client != clients.end(); ) {
+      take(client->second);
+      {
+	std::lock_guard<std::mutex> guard(queue_lock);
+	while (!client->second.replies.empty() && client->second.replies.front()->done) {
+	  client->second.output = client->second.output + client->second.replies.front()->text;
+	  client->second.replies.pop_front(); }
+      }
+      bool open = send_some(client->first, client->second.output);
+      if (!open || (!client->second.reading && client->second.held.empty() &&
+		    client->second.replies.empty() && client->second.output.empty())) {
+	close(client->first);
+	clients.erase(client++); }
+      else
+	client++; }}
+}
+
+#endif
@@ -0,0 +1,89 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __DUAL_H
+#define __DUAL_H
+
+/*
+  Forward-mode dual numbers: a value and its derivative (the slope)
+  with respect to one parameter, seeded as Dual(x, 1) and every other
+  input as a constant Dual(c) = Dual(c, 0). Arithmetic carries the
+  slope by the chain rule, so a distribution of Dual cells evolved by
+  markov.h holds d(cell)/d(parameter) beside each cell, and its
+  density the derivative of the density.
+
+  A Dual is two doubles, value first, so a buffer of them can be read
+  as doubles with twice the stride (the reductions of reduce.h do).
+*/
+
+#include <cmath>
+
+struct Dual {
+  double value;
+  double slope;
+  Dual(double init_value = 0.0, double init_slope = 0.0) : value(init_value), slope(init_slope) {}
+  Dual& operator+=(const Dual& other) {
+    value = value + other.value;
+    slope = slope + other.slope;
+    return(*this);
+  }
+};
+
+inline Dual operator+(const Dual& a, const Dual& b) {
+  return(Dual(a.value + b.value, a.slope + b.slope));
+}
+
+inline Dual operator-(const Dual& a, const Dual& b) {
+  return(Dual(a.value - b.value, a.slope - b.slope));
+}
+
+inline Dual operator-(const Dual& a) {
+  return(Dual(-a.value, -a.slope));
+}
+
+inline Dual operator*(const Dual& a, const Dual& b) {
+  return(Dual(a.value * b.value, a.slope * b.value + a.value * b.slope));
+}
+
+inline Dual operator/(const Dual& a, const Dual& b) {
+  return(Dual(a.value / b.value, (a.slope * b.value - a.value * b.slope) / (b.value * b.value)));
+}
+
+// Equal as functions near the point: value and slope both.
+inline bool operator==(const Dual& a, const Dual& b) {
+  return((a.value == b.value) && (a.slope == b.slope));
+}
+
+inline bool operator!=(const Dual& a, const Dual& b) {
+  return(!(a == b));
+}
+
+inline Dual exp(const Dual& a) {
+  double value = std::exp(a.value);
+  return(Dual(value, value * a.slope));
+}
+
+inline Dual log(const Dual& a) {
+  return(Dual(std::log(a.value), a.slope / a.value));
+}
+
+// base^a for a constant base > 0.
+inline Dual pow(double base, const Dual& a) {
+  double value = std::pow(base, a.value);
+  return(Dual(value, value * std::log(base) * a.slope));
+}
+
+#endif
@@ -0,0 +1,299 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __HISTORY_H
+#define __HISTORY_H
+
+/*
+  The history of an evolution, kept so the distribution at any step of
+  a finished run can be looked at again without running it from the
+  start (ecq-pg -y, pos -y; read by ecq-hist and pos-hist).
+
+  Every spacing steps from the first, the history takes a keyframe:
+  the rows of the distribution that hold some mass, bit for bit. For
+  the steps in between it keeps only the density, if the run computed
+  one. The evolution is deterministic, so a step between keyframes is
+  the keyframe before it evolved the rest of the way, at most
+  spacing - 1 steps; storing the cells would not save that, as every
+  cell of the active rows changes at every step. Each directory
+  replays its own distributions (history_replay()).
+
+  The keyframes are held to a budget in bytes. When the next one would
+  exceed it, every other keyframe is dropped and the spacing doubles,
+  so the history covers the whole run at whatever spacing fits; the
+  first keyframe always stays.
+
+  File layout, native byte order:
+
+    char     magic[8]        "SPKHIST1"
+    int32    width           cells per row
+    int32    spacing         steps between keyframes
+    int32    origin, last    the first and last step of the run
+    int32    params, frames
+    per parameter: char name[24], double value
+    double   density[last - origin + 1], NaN where none was computed
+    per keyframe: int32 step, int32 low, int32 rows, int32 (zero),
+                  double sites[rows][width], rows low ... low + rows - 1
+    uint64   FNV-1a hash of everything above
+*/
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+
+static const char history_magic[8] = {'S','P','K','H','I','S','T','1'};
+
+struct HistoryFrame {
+  int                 step;
+  int                 low;    // first row held; the others are zero
+  int                 rows;
+  std::vector<double> sites;  // rows * width
+};
+
+class EvolutionHistory {
+public:
+  typedef std::vector<std::pair<std::string, double> > Params;
+
+  // An empty history of rows of width cells, keyframes every spacing
+  // steps within budget bytes; the parameters are what a replay needs.
+  EvolutionHistory(int init_width, int init_spacing, size_t init_budget, const Params& init_params)
+    : width(init_width), spacing(init_spacing), budget(init_budget), origin(-1), last(-1), params(init_params) {
+    if ((width < 1) || (spacing < 1)) throw std::invalid_argument("HISTORY: width and spacing must be positive");
+    for (const std::pair<std::string, double>& param : params)
+      if (param.first.size() >= 24) throw std::invalid_argument("HISTORY: parameter name too long: " + param.first);
+  }
+
+  // A history saved by save(), to read.
+  EvolutionHistory(const std::string& path) : budget(0) {
+    load(path);
+  }
+
+  int    row_width() const { return(width); }
+  int    every() const { return(spacing); }
+  int    first() const { return(origin); }
+  int    latest() const { return(last); }
+  size_t keyframes() const { return(frames.size()); }
+  size_t bytes() const { return(held); }
+
+  double param(const std::string& name) const {
+    for (const std::pair<std::string, double>& param : params)
+      if (param.first == name) return(param.second);
+    throw std::invalid_argument("HISTORY: no parameter " + name);
+  }
+
+  // The first step at or after step that takes a keyframe.
+  int next(int step) const {
+    if (origin < 0) return(step);
+    if (step <= origin) return(origin);
+    return(origin + ((step - origin + spacing - 1) / spacing) * spacing);
+  }
+  bool due(int step) const { return(next(step) == step); }
+
+  // Takes the rows of the distribution after step steps, count rows of
+  // stride cells, the first width of each being used. The first call
+  // sets the origin; later ones must be due, in order.
+  void keyframe(int step, const double* rows, int count, int stride) {
+    if ((origin >= 0) && (!due(step) || (step <= frames.back().step)))
+      throw std::invalid_argument("HISTORY: keyframe out of turn");
+    if (stride < width) throw std::invalid_argument("HISTORY: rows narrower than the history");
+    int low = count, high = -1;
+    for (int row = 0; row < count; row++)
+      for (int cell = 0; cell < width; cell++)
+	if (rows[size_t(row) * stride + cell] != 0.0) {
+	  low = std::min(low, row);
+	  high = row;
+	  break; }
+    HistoryFrame frame;
+    frame.step = step;
+    frame.low  = (high < low) ? 0 : low;
+    frame.rows = (high < low) ? 0 : high - low + 1;
+    frame.sites.resize(size_t(frame.rows) * width);
+    for (int row = 0; row < frame.rows; row++)
+      memcpy(&frame.sites[size_t(row) * width], rows + size_t(frame.low + row) * stride, width * sizeof(double));
+    if (origin < 0) {
+      origin = step;
+      last = step;
+      densities.assign(1, std::numeric_limits<double>::quiet_NaN()); }
+    held = held + frame.sites.size() * sizeof(double);
+    frames.push_back(frame);
+    // Thin to the budget, the new keyframe included if it survives.
+    while ((held > budget) && (frames.size() > 1)) {
+      spacing = spacing * 2;
+      std::vector<HistoryFrame> kept;
+      held = 0;
+      for (HistoryFrame& old : frames)
+	if ((old.step - origin) % spacing == 0) {
+	  held = held + old.sites.size() * sizeof(double);
+	  kept.push_back(HistoryFrame());
+	  kept.back().step = old.step;
+	  kept.back().low  = old.low;
+	  kept.back().rows = old.rows;
+	  kept.back().sites.swap(old.sites); }
+      frames.swap(kept); }
+  }
+
+  // The run has reached step; density is its density, if computed.
+  void note(int step, double density = std::numeric_limits<double>::quiet_NaN()) {
+    if ((origin < 0) || (step < origin)) throw std::invalid_argument("HISTORY: step before the first keyframe");
+    if (step > last) {
+      densities.resize(step - origin + 1, std::numeric_limits<double>::quiet_NaN());
+      last = step; }
+    if (!std::isnan(density)) densities[step - origin] = density;
+  }
+
+  // The density the run computed at step, NaN if it did not.
+  double density(int step) const {
+    check(step);
+    return(densities[step - origin]);
+  }
+
+  // Writes the keyframe at or before step into count rows of stride
+  // cells, zero elsewhere, and returns its step.
+  int restore(int step, double* rows, int count, int stride) const {
+    check(step);
+    const HistoryFrame* frame = &frames[0];
+    for (const HistoryFrame& candidate : frames)
+      if (candidate.step <= step) frame = &candidate;
+    if ((stride < width) || (frame->low + frame->rows > count))
+      throw std::invalid_argument("HISTORY: keyframe does not fit the distribution");
+    std::fill(rows, rows + size_t(count) * stride, 0.0);
+    for (int row = 0; row < frame->rows; row++)
+      memcpy(rows + size_t(frame->low + row) * stride, &frame->sites[size_t(row) * width], width * sizeof(double));
+    return(frame->step);
+  }
+
+  // Writes the history to path, through a scratch file renamed over it.
+  void save(const std::string& path) const {
+    std::vector<char> bytes(history_magic, history_magic + 8);
+    int32_t header[6] = {width, spacing, origin, last, int32_t(params.size()), int32_t(frames.size())};
+    put(bytes, header, sizeof(header));
+    for (const std::pair<std::string, double>& param : params) {
+      char name[24];
+      memset(name, 0, sizeof(name));
+      strncpy(name, param.first.c_str(), sizeof(name) - 1);
+      put(bytes, name, sizeof(name));
+      put(bytes, &param.second, sizeof(double)); }
+    if (!densities.empty()) put(bytes, &densities[0], densities.size() * sizeof(double));
+    for (const HistoryFrame& frame : frames) {
+      int32_t layout[4] = {frame.step, frame.low, frame.rows, 0};
+      put(bytes, layout, sizeof(layout));
+      if (!frame.sites.empty()) put(bytes, &frame.sites[0], frame.sites.size() * sizeof(double)); }
+    uint64_t hash = fnv1a(bytes);
+    put(bytes, &hash, sizeof(hash));
+
+    std::string scratch = path + ".tmp";
+    std::ofstream out(scratch.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("HISTORY: cannot create " + scratch);
+    out.write(&bytes[0], bytes.size());
+    out.close();
+    if (!out) throw std::runtime_error("HISTORY: cannot write " + scratch);
+    if (rename(scratch.c_str(), path.c_str()) != 0)
+      throw std::runtime_error("HISTORY: cannot rename onto " + path + ": " + strerror(errno));
+  }
+
+private:
+  int                       width;
+  int                       spacing;
+  size_t                    budget;
+  size_t                    held = 0;   // bytes of keyframe sites
+  int                       origin;
+  int                       last;
+  Params                    params;
+  std::vector<double>       densities;  // from origin to last
+  std::vector<HistoryFrame> frames;     // by step
+
+  void check(int step) const {
+    if ((origin < 0) || (step < origin) || (step > last))
+      throw std::invalid_argument("HISTORY: step " + std::to_string(step) + " is outside the run, steps " +
+				  std::to_string(origin) + " to " + std::to_string(last));
+  }
+
+  static uint64_t fnv1a(const std::vector<char>& bytes) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char byte : bytes) {
+      hash = hash ^ (unsigned char) byte;
+      hash = hash * 1099511628211ULL; }
+    return(hash);
+  }
+
+  static void put(std::vector<char>& bytes, const void* raw, size_t size) {
+    bytes.insert(bytes.end(), (const char*) raw, (const char*) raw + size);
+  }
+
+  static void take(const std::vector<char>& bytes, size_t& at, void* raw, size_t size) {
+    if (at + size > bytes.size()) throw std::runtime_error("HISTORY: file truncated");
+    memcpy(raw, &bytes[at], size);
+    at = at + size;
+  }
+
+  void load(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    if (!in) throw std::runtime_error("HISTORY: cannot open " + path + ": " + strerror(errno));
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if ((bytes.size() < 8 + sizeof(uint64_t)) || (memcmp(&bytes[0], history_magic, 8) != 0))
+      throw std::runtime_error("HISTORY: " + path + " is not a history");
+    size_t end = bytes.size() - sizeof(uint64_t);
+    uint64_t stored;
+    memcpy(&stored, &bytes[end], sizeof(stored));
+    bytes.resize(end);
+    if (fnv1a(bytes) != stored) throw std::runtime_error("HISTORY: checksum mismatch in " + path);
+
+    size_t at = 8;
+    int32_t header[6];
+    take(bytes, at, header, sizeof(header));
+    width  = header[0];
+    spacing = header[1];
+    origin = header[2];
+    last   = header[3];
+    if ((width < 1) || (spacing < 1) || (origin < 0) || (last < origin) || (header[4] < 0) || (header[5] < 1))
+      throw std::runtime_error("HISTORY: damaged header in " + path);
+    for (int param = 0; param < header[4]; param++) {
+      char name[24];
+      double value;
+      take(bytes, at, name, sizeof(name));
+      take(bytes, at, &value, sizeof(value));
+      params.push_back(std::make_pair(std::string(name, strnlen(name, sizeof(name))), value)); }
+    densities.resize(last - origin + 1);
+    take(bytes, at, &densities[0], densities.size() * sizeof(double));
+    for (int frame = 0; frame < header[5]; frame++) {
+      int32_t layout[4];
+      take(bytes, at, layout, sizeof(layout));
+      if ((layout[0] < origin) || (layout[0] > last) || (layout[1] < 0) || (layout[2] < 0) ||
+	  (!frames.empty() && (layout[0] <= frames.back().step)))
+	throw std::runtime_error("HISTORY: damaged keyframe in " + path);
+      frames.push_back(HistoryFrame());
+      frames.back().step = layout[0];
+      frames.back().low  = layout[1];
+      frames.back().rows = layout[2];
+      frames.back().sites.resize(size_t(layout[2]) * width);
+      if (layout[2] > 0) take(bytes, at, &frames.back().sites[0], frames.back().sites.size() * sizeof(double));
+      held = held + frames.back().sites.size() * sizeof(double); }
+    if (frames[0].step != origin) throw std::runtime_error("HISTORY: no keyframe at the first step in " + path);
+    if (at != bytes.size()) throw std::runtime_error("HISTORY: trailing bytes in " + path);
+  }
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __INVERSE_H
+#define __INVERSE_H
+
+/*
+  Inverse problems of the sweep drivers: the largest parameter (an
+  adversarial stake or rate, a spike) for which the density at slot w
+  stays at or below a target, the density growing with the parameter.
+
+  For a continuous parameter the density comes with its derivative, as
+  a Dual (dual.h), and inverse_solve() runs Newton's method on
+  log(density) - log(target), which is close to linear in the
+  parameter where the density decays geometrically. It is safeguarded
+  by a bracket [low ... high] that always holds the crossing: a Newton
+  step that would leave it, or that does not halve the move before
+  last, is replaced by bisection (as in Numerical Recipes' rtsafe), so
+  it converges whatever the start, and in a handful of evaluations
+  near the answer. The bracket ends are taken on trust
+  and only evaluated if the answer ends up there. An answer pinned at
+  the top of the range, where the density is still at or below the
+  target, is not bracketed, and a density seen falling as the
+  parameter grows breaks the premise: either is reported, by
+  inverse_trouble(), in place of an answer.
+
+  For an integer parameter (pos's spike) inverse_search() bisects.
+*/
+
+#include <functional>
+#include <string>
+#include <sstream>
+#include <cmath>
+#include "dual.h"
+
+struct InverseResult {
+  double parameter;    // the largest parameter found safe
+  Dual   density;      // there, with its derivative
+  int    evaluations;
+  bool   feasible;     // false: even the low end exceeds the target
+  bool   bracketed;    // false: even the high end is within the target
+  bool   monotone;     // false: the density fell at parameter
+};
+
+/* density(x) for x in [low ... high], increasing. Stops when the
+   bracket is narrower than tolerance, with the result on its low side,
+   or at a point where log(density) is within 1e-9 of log(target), or
+   at the first point where the density's slope is negative. */
+inline InverseResult inverse_solve(const std::function<Dual(double)>& density,
+				   double target,
+				   double low,
+				   double high,
+				   double tolerance,
+				   int most = 60) {
+  const double goal = std::log(target);
+  InverseResult result = {low, Dual(0.0), 0, true, true, true};
+  bool   have_low = false;  // result holds a safe evaluation
+  bool   have_high = false; // high has come down to an unsafe evaluation
+  bool   crossed = false;   // an evaluation met the target, to rounding
+  const double top = high;
+  double x = 0.5 * (low + high);
+  double step = high - low, earlier = step;  // the last two moves
+  while (result.evaluations < most) {
+    Dual at = density(x);
+    result.evaluations++;
+    if ((at.value > 0) && (at.slope < 0)) {
+      result.parameter = x;
+      result.density = at;
+      result.monotone = false;
+      return(result); }
+    double residual = std::log(at.value) - goal;  // -inf for a zero density
+    bool safe = (residual < 1e-9);  // at or below the target, to rounding
+    if (safe) {
+      low = x;
+      result.parameter = x;
+      result.density = at;
+      have_low = true; }
+    else {
+      high = x;
+      have_high = true; }
+    crossed = (std::abs(residual) < 1e-9);
+    if (crossed || (high - low < tolerance)) break;
+    // Newton while it stays inside the bracket and at least halves the
+    // move before last, else bisect.
+    double slope = at.slope / at.value;  // of log(density)
+    double next  = x - residual / slope;
+    earlier = step;
+    if (!std::isfinite(next) || !(slope > 0) || (next <= low) || (next >= high) ||
+	(std::abs(next - x) > 0.5 * std::abs(earlier)))
+      next = 0.5 * (low + high);
+    else if (safe && (std::abs(next - x) < tolerance))
+      break;  // the crossing is within tolerance above x
+    step = next - x;
+    x = next; }
+  if (!have_low) {
+    // Every point tried was above the target: is the low end safe?
+    result.parameter = low;
+    result.density = density(low);
+    result.evaluations++;
+    result.feasible = (result.density.value <= target); }
+  else if (!have_high && !crossed) {
+    // Every point tried was safe: is the crossing below the high end?
+    Dual at = density(top);
+    result.evaluations++;
+    if (at.value <= target) {
+      result.parameter = top;
+      result.density = at;
+      result.bracketed = false; }}
+  return(result);
+}
+
+// The largest k in [low ... high] with density(k) <= target, for
+// density increasing in k; low - 1 if there is none.
+inline InverseResult inverse_search(const std::function<double(int)>& density,
+				    double target,
+				    int low,
+				    int high) {
+  InverseResult result = {double(low - 1), Dual(0.0), 0, false, true, true};
+  int safe = low - 1, unsafe = high + 1;
+  while (unsafe - safe > 1) {
+    int k = safe + (unsafe - safe) / 2;
+    double at = density(k);
+    result.evaluations++;
+    if (at <= target) {
+      safe = k;
+      result.density = Dual(at); }
+    else
+      unsafe = k; }
+  result.parameter = safe;
+  result.feasible  = (safe >= low);
+  result.bracketed = (safe < high);
+  return(result);
+}
+
+// Why a result is no answer, or "" if it is one.
+inline std::string inverse_trouble(const InverseResult& found) {
+  std::ostringstream out;
+  out.precision(17);
+  if (!found.monotone)
+    out << "not monotone: slope " << found.density.slope << " at " << found.parameter;
+  else if (!found.bracketed)
+    out << "not bracketed: density " << found.density.value << " at the top of the range, " << found.parameter;
+  return(out.str());
+}
+
+#endif
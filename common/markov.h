@@ -0,0 +1,393 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __MARKOV_H
+#define __MARKOV_H
+
+/*
+  The evolution engine under ecq, pow and pos. All three evolve a
+  distribution over (beta, phase): a row of the buffer per beta, a
+  column per phase (ecq's transition point, pow's isolation state,
+  pos's single one). A step draws an honest outcome and an adversarial
+  one independently; the honest one moves the phase and shifts beta,
+  the adversarial one then advances beta by its index. What differs
+  is told by a chain, a class with
+
+    int    phases() const;                  // states per row
+    int    column(int phase) const;         // where a phase is stored
+    int    honest_outcomes() const;
+    double honest_weight(int) const;
+    int    adversarial_outcomes() const;
+    double adversarial_weight(int) const;   // of advancing beta by its index
+    MarkovMove move(int phase, int honest) const;
+    int    barrier() const;                 // rows [0 ... barrier-1] are on the barrier
+    int    land(int row, MarkovMove, int adversarial) const;
+                                            // where a barrier source lands, -1 nowhere
+    int    first_regular() const;           // other sources are read from rows
+    int    last_regular(int adversarial) const;  // [first_regular ... last_regular]
+    bool   fold() const;                    // merge the moves between the same cells
+    int    fixed_rows() const;              // target rows the chain computes itself
+    double fixed(const double* source, int stride, int row, int column) const;
+
+  A source outside the regular rows, and not on the barrier, is lost;
+  markov_unbounded as the bounds reads everywhere, from zero ghost rows
+  at the edges of the buffers.
+
+  The chain is compiled into a MarkovStencil, the gather form of one
+  step: for each target column, the source cells it collects from, in
+  the order a scatter over (honest, adversarial, source row, phase)
+  would have added them. Each term is added as (source x adversarial
+  weight) x honest weight, or, folded, as source x the sum of the
+  weights of the moves it merges, the forms the tools have always
+  used, so their results are unchanged to the bit. Rows where every
+  term applies take a fast path over flat offsets; the others check
+  each term against its range of target rows.
+
+  The stencil and the kernels are templates over the cell type:
+  MarkovStencil is that of doubles, and a chain whose weights (and
+  fixed()) are Dual numbers of dual.h makes a MarkovStencilOf<Dual>
+  that evolves Dual cells, each carrying its derivative along.
+
+  Evolution works on row ranges, so that a pool of threads can share a
+  distribution by rows (see ecq/evolvepool.h) with results independent
+  of the split. The reductions below are those of reduce.h, the same
+  whatever the split; the row convolution sums in the tools' order.
+  Header only, like sweep.h.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cmath>
+#include "reduce.h"
+
+const int markov_unbounded = 1 << 28;
+
+struct MarkovMove {
+  int phase;  // after the honest outcome
+  int shift;  // of beta, before the adversarial advance
+};
+
+struct MarkovTerm {
+  int  row;     // source row, relative to the target row unless fixed
+  int  column;  // source column
+  bool fixed;   // row is absolute: a source on the barrier
+  int  first;   // target rows the term applies to
+  int  last;
+};
+
+template <class Scalar> class MarkovStencilOf {
+public:
+  int                     stride;
+  bool                    folded;
+  int                     reach;          // largest |row| of a relative term
+  int                     uniform_first;  // rows where every term applies,
+  int                     uniform_last;   // and no barrier source lands
+  std::vector<int>        targets;        // target columns
+  std::vector<int>        start;          // terms of targets[i]: [start[i] ... start[i+1])
+  std::vector<MarkovTerm> terms;
+  std::vector<Scalar>     weight;         // adversarial, or the folded product
+  std::vector<Scalar>     honest;         // 1 when folded
+  // The relative terms alone, for the fast path, as above.
+  std::vector<int>        flat_start;
+  std::vector<long>       flat;           // source cell - target cell
+  std::vector<Scalar>     flat_weight;
+  std::vector<Scalar>     flat_honest;
+
+  template <class Chain> MarkovStencilOf(const Chain& chain, int init_stride) : stride(init_stride),
+										folded(chain.fold()) {
+    struct Pending {
+      MarkovTerm term;
+      Scalar     weight;
+      Scalar     honest;
+    };
+    std::vector<std::vector<Pending>> by_target(chain.phases());
+    std::vector<std::pair<int, MarkovMove>> moves;  // (phase, move), in source row order
+    for (int honest_outcome = 0; honest_outcome < chain.honest_outcomes(); honest_outcome++) {
+      Scalar hw = chain.honest_weight(honest_outcome);
+      moves.clear();
+      for (int phase = 0; phase < chain.phases(); phase++)
+	moves.push_back(std::make_pair(phase, chain.move(phase, honest_outcome)));
+      const std::vector<std::pair<int, MarkovMove>> by_phase(moves);
+      // A larger shift reads a lower source row.
+      std::stable_sort(moves.begin(), moves.end(),
+		       [](const std::pair<int, MarkovMove>& a, const std::pair<int, MarkovMove>& b) {
+			 return(a.second.shift > b.second.shift); });
+      for (int adversarial = 0; adversarial < chain.adversarial_outcomes(); adversarial++) {
+	Scalar aw = chain.adversarial_weight(adversarial);
+	if (!folded && ((aw == Scalar(0.0)) || (hw == Scalar(0.0)))) continue;  // adds +0, which changes nothing
+	for (int row = 0; row < chain.barrier(); row++)
+	  for (const std::pair<int, MarkovMove>& move : by_phase) {
+	    int target = chain.land(row, move.second, adversarial);
+	    if (target < 0) continue;
+	    MarkovTerm term = {row, chain.column(move.first), true, target, target};
+	    add(by_target[move.second.phase], term, aw, hw); }
+	for (const std::pair<int, MarkovMove>& move : moves) {
+	  int offset = move.second.shift + adversarial;
+	  MarkovTerm term = {-offset, chain.column(move.first), false,
+			     bounded_sum(chain.first_regular(), offset),
+			     bounded_sum(chain.last_regular(adversarial), offset)};
+	  add(by_target[move.second.phase], term, aw, hw); }}}
+    reach = 0;
+    uniform_first = -markov_unbounded;
+    uniform_last  = markov_unbounded;
+    start.push_back(0);
+    flat_start.push_back(0);
+    for (int phase = 0; phase < chain.phases(); phase++) {
+      int column = chain.column(phase);
+      targets.push_back(column);
+      for (Pending& pending : by_target[phase]) {
+	const MarkovTerm& term = pending.term;
+	terms.push_back(term);
+	weight.push_back(pending.weight);
+	honest.push_back(pending.honest);
+	if (term.fixed) {
+	  uniform_first = std::max(uniform_first, term.last + 1);
+	  continue; }
+	reach = std::max(reach, std::abs(term.row));
+	uniform_first = std::max(uniform_first, term.first);
+	uniform_last  = std::min(uniform_last, term.last);
+	flat.push_back(long(term.row) * stride + term.column - column);
+	flat_weight.push_back(pending.weight);
+	flat_honest.push_back(pending.honest); }
+      start.push_back(int(terms.size()));
+      flat_start.push_back(int(flat.size())); }
+  }
+
+  // Whether every row is uniform, as multi-step sweeps need.
+  bool everywhere() const {
+    return((uniform_first < -markov_unbounded / 2) && (uniform_last > markov_unbounded / 2));
+  }
+
+private:
+  template <class Pending> void add(std::vector<Pending>& list, const MarkovTerm& term, Scalar aw, Scalar hw) {
+    if (folded) {
+      for (Pending& pending : list)
+	if ((pending.term.row == term.row) && (pending.term.column == term.column) &&
+	    (pending.term.fixed == term.fixed) && (pending.term.first == term.first) &&
+	    (pending.term.last == term.last)) {
+	  pending.weight += aw * hw;
+	  return; }
+      Pending merged = {term, Scalar(0.0), Scalar(1.0)};
+      merged.weight += aw * hw;
+      list.push_back(merged); }
+    else {
+      Pending kept = {term, aw, hw};
+      list.push_back(kept); }
+  }
+  static int bounded_sum(int bound, int offset) {
+    if (bound <= -markov_unbounded) return(-markov_unbounded);
+    if (bound >= markov_unbounded) return(markov_unbounded);
+    return(bound + offset);
+  }
+};
+
+typedef MarkovStencilOf<double> MarkovStencil;
+
+// The fast path: rows where every term applies, over flat offsets.
+template <bool folded, class Scalar> void markov_uniform_rows(const MarkovStencilOf<Scalar>& stencil,
+							      const Scalar* source,
+							      Scalar* target,
+							      int first,
+							      int last) {
+  const int     stride  = stencil.stride;
+  const int     columns = int(stencil.targets.size());
+  const int*    targets = &stencil.targets[0];
+  const int*    begin   = &stencil.flat_start[0];
+  const long*   flat    = stencil.flat.empty() ? NULL : &stencil.flat[0];
+  const Scalar* weight  = stencil.flat.empty() ? NULL : &stencil.flat_weight[0];
+  const Scalar* honest  = stencil.flat.empty() ? NULL : &stencil.flat_honest[0];
+  for (int row = first; row <= last; row++) {
+    const Scalar* from = source + size_t(row) * stride;
+    Scalar*       to   = target + size_t(row) * stride;
+    for (int i = 0; i < columns; i++) {
+      const Scalar* cell = from + targets[i];
+      Scalar value = 0.0;
+      for (int term = begin[i]; term < begin[i + 1]; term++)
+	if (folded)
+	  value += cell[flat[term]] * weight[term];
+	else
+	  value += (cell[flat[term]] * weight[term]) * honest[term];
+      to[targets[i]] = value; }}
+}
+
+// The others, each term checked against its target rows.
+template <class Scalar> void markov_checked_rows(const MarkovStencilOf<Scalar>& stencil,
+						 const Scalar* source,
+						 Scalar* target,
+						 int first,
+						 int last) {
+  const int stride = stencil.stride;
+  for (int row = first; row <= last; row++) {
+    const Scalar* from = source + size_t(row) * stride;
+    Scalar*       to   = target + size_t(row) * stride;
+    for (size_t i = 0; i < stencil.targets.size(); i++) {
+      Scalar value = 0.0;
+      for (int term = stencil.start[i]; term < stencil.start[i + 1]; term++) {
+	const MarkovTerm& at = stencil.terms[term];
+	if ((row < at.first) || (row > at.last)) continue;
+	Scalar cell = at.fixed ? source[size_t(at.row) * stride + at.column]
+	  : from[long(at.row) * stride + at.column];
+	if (stencil.folded)
+	  value += cell * stencil.weight[term];
+	else
+	  value += (cell * stencil.weight[term]) * stencil.honest[term]; }
+      to[stencil.targets[i]] = value; }}
+}
+
+// Rows [first ... last] of target from source, both row-major buffers
+// of the stencil's stride, with row 0 at the pointers.
+template <class Scalar> void markov_evolve_rows(const MarkovStencilOf<Scalar>& stencil,
+						const Scalar* source,
+						Scalar* target,
+						int first,
+						int last) {
+  int low  = std::max(first, stencil.uniform_first);
+  int high = std::min(last, stencil.uniform_last);
+  if (low > high) {
+    markov_checked_rows(stencil, source, target, first, last);
+    return; }
+  if (first < low)
+    markov_checked_rows(stencil, source, target, first, low - 1);
+  if (stencil.folded)
+    markov_uniform_rows<true>(stencil, source, target, low, high);
+  else
+    markov_uniform_rows<false>(stencil, source, target, low, high);
+  if (high < last)
+    markov_checked_rows(stencil, source, target, high + 1, last);
+}
+
+/* Multi-step sweeps, for stencils that apply everywhere. A step at row
+   r only reads rows r-reach ... r+reach, so `steps' steps of a tile
+   [lo ... hi] only depend on the source rows [lo-reach*steps ...
+   hi+reach*steps]. Each tile is copied into a small scratch pair with
+   that halo and evolved there, narrower by reach on each side per
+   step, the last step landing in the target. The halo rows are
+   computed redundantly by both neighbouring tiles, but the full-size
+   buffers are only read and written once per call instead of once per
+   step. Ghost rows are never computed, so they stay zero in scratch as
+   they would in the buffers. The arithmetic per cell is that of
+   single steps, so the results are bit-identical to them. */
+
+const size_t markov_tilebytes = 256 * 1024;  // scratch pair, about an L2
+
+// Rows 0 ... reach-1 and rows-reach ... rows-1 are ghost rows; the
+// source must be readable over the whole [0 ... rows-1].
+template <class Scalar> void markov_evolve_rows(const MarkovStencilOf<Scalar>& stencil,
+						const Scalar* source,
+						Scalar* target,
+						int first,
+						int last,
+						int rows,
+						int steps) {
+  if (steps == 1) {
+    markov_evolve_rows(stencil,source,target,first,last);
+    return; }
+  if (!stencil.everywhere()) throw std::invalid_argument("MARKOV: multi-step sweeps need a stencil that applies everywhere");
+  const int stride = stencil.stride;
+  const int reach  = std::max(stencil.reach, 1);
+  const int halo   = reach * steps;
+  int tile = int(markov_tilebytes / (2 * sizeof(Scalar) * stride)) - 2 * halo - 2;
+  if (tile < 4 * halo) tile = 4 * halo;
+  const int span = tile + 2 * halo + 2;
+  Scalar* scratch[2];
+  scratch[0] = new Scalar[size_t(span) * stride];
+  scratch[1] = new Scalar[size_t(span) * stride];
+  for (int lo = first; lo <= last; lo = lo + tile) {
+    int hi = std::min(lo + tile - 1, last);
+    int origin = std::max(lo - halo - 1, 0);       // buffer row of scratch row 0
+    int top    = std::min(hi + halo + 1, rows - 1);
+    if ((origin == 0) || (top == rows - 1))  // a ghost row lands in scratch
+      for (size_t cell = 0; cell < size_t(span) * stride; cell++)
+	scratch[1][cell] = 0.0;
+    for (size_t cell = 0; cell < size_t(top - origin + 1) * stride; cell++)
+      scratch[0][cell] = source[size_t(origin) * stride + cell];
+    for (int s = 1; s < steps; s++) {
+      int from = std::max(lo - reach * (steps - s), reach);
+      int to   = std::min(hi + reach * (steps - s), rows - 1 - reach);
+      markov_evolve_rows(stencil, scratch[(s - 1) % 2], scratch[s % 2],
+			 from - origin, to - origin); }
+    markov_evolve_rows(stencil, scratch[(steps - 1) % 2], target + size_t(origin) * stride,
+		       lo - origin, hi - origin); }
+  delete[] scratch[0];
+  delete[] scratch[1];
+}
+
+// One step over rows [first ... last], the chain's fixed rows included.
+template <class Chain, class Scalar> void markov_evolve(const Chain& chain,
+							const MarkovStencilOf<Scalar>& stencil,
+							const Scalar* source,
+							Scalar* target,
+							int first,
+							int last) {
+  int row = first;
+  for (; (row <= last) && (row < chain.fixed_rows()); row++)
+    for (int column : stencil.targets)
+      target[size_t(row) * stencil.stride + column] = chain.fixed(source, stencil.stride, row, column);
+  if (row <= last)
+    markov_evolve_rows(stencil, source, target, row, last);
+}
+
+// The columns of a chain in phase order, the order of the reductions.
+template <class Chain> std::vector<int> markov_columns(const Chain& chain) {
+  std::vector<int> columns;
+  for (int phase = 0; phase < chain.phases(); phase++)
+    columns.push_back(chain.column(phase));
+  return(columns);
+}
+
+// Sum over rows [first ... last], the columns of each in the order
+// given, by the tree of reduce.h rooted at row 0 of the buffer.
+inline double markov_sum(const double* sites,
+			 int stride,
+			 int first,
+			 int last,
+			 const std::vector<int>& columns) {
+  ReduceCells cells = {sites, NULL, 0, size_t(stride), columns.data(), int(columns.size())};
+  return(reduce_rows<false>(cells, first, last));
+}
+
+// Half the l1 distance over the same cells, compensated: it is small
+// next to the masses it is taken from.
+inline double markov_distance(const double* a,
+			      const double* b,
+			      int stride,
+			      int first,
+			      int last,
+			      const std::vector<int>& columns) {
+  ReduceCells cells = {a, b, 0, size_t(stride), columns.data(), int(columns.size())};
+  return(reduce_rows<true>(cells, first, last)/2);
+}
+
+/* Convolution along beta with a kernel over shifts [0 ... rows-1]: row
+   t of the target is the sum over a <= t of source row a times
+   kernel[t - a], column by column and in increasing a, as the tools'
+   scatter loops added it. Mass pushed beyond the last row is lost. */
+template <class Scalar> void markov_convolve(const Scalar* source,
+					     Scalar* target,
+					     int stride,
+					     int rows,
+					     const std::vector<int>& columns,
+					     const Scalar* kernel) {
+  for (int row = 0; row < rows; row++)
+    for (int column : columns) {
+      Scalar value = 0.0;
+      for (int from = 0; from <= row; from++)
+	value = value + source[size_t(from) * stride + column] * kernel[row - from];
+      target[size_t(row) * stride + column] = value; }
+}
+
+#endif
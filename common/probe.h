@@ -0,0 +1,307 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __PROBE_H
+#define __PROBE_H
+
+/*
+  Instrumentation for the drivers, off unless the environment variable
+  SPIKE_PROBE is set when the program starts:
+
+    SPIKE_PROBE=pow-probe.json ./pow     report to a file
+    SPIKE_PROBE=- ./pow                  report to stderr
+
+  A driver names itself with probe_start("pow"), wraps the work it
+  wants timed in scoped phases
+
+    { ProbePhase phase("evolve", cells);  ...  }
+
+  and records traces, probe_trace("error", step, error). Each phase
+  gathers calls, wall and CPU time, the state updates it was given,
+  the allocations made while it ran and, where perf_event_open is
+  permitted, cycles, instructions and cache misses. The report, one
+  JSON object to a line as the bench programs write, goes out at exit.
+
+  Off, a phase or trace costs one test of a cached flag; built with
+  -DNO_PROBE, nothing at all. Allocations are counted only in the one
+  file of a program that defines PROBE_ALLOCATIONS before including
+  this header, which replaces the global operator new and delete.
+  Phase allocation and counter figures are process-wide, so they are
+  exact for phases that do not overlap another thread's.
+*/
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <new>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#ifdef NO_PROBE
+inline bool probe_on() { return(false); }
+#else
+inline bool probe_on() {
+  static const bool on = (getenv("SPIKE_PROBE") != NULL);
+  return(on);
+}
+#endif
+
+struct ProbeAllocations {
+  std::atomic<long> allocations;
+  std::atomic<long> bytes;
+  std::atomic<long> frees;
+};
+
+inline ProbeAllocations& probe_allocations() {
+  static ProbeAllocations counts;
+  return(counts);
+}
+
+// Cycles, instructions and cache misses of the process and the threads
+// it starts, in user space, or nothing where perf_event_open is refused.
+class ProbeCounters {
+public:
+  static const int kinds = 3;
+  int         fds[kinds];
+  std::string refused;
+  ProbeCounters() {
+    for (int kind = 0; kind < kinds; kind++) fds[kind] = -1;
+#ifdef __linux__
+    const unsigned long long configs[kinds] = {PERF_COUNT_HW_CPU_CYCLES,
+					       PERF_COUNT_HW_INSTRUCTIONS,
+					       PERF_COUNT_HW_CACHE_MISSES};
+    for (int kind = 0; kind < kinds; kind++) {
+      struct perf_event_attr attr;
+      memset(&attr, 0, sizeof(attr));
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(attr);
+      attr.config = configs[kind];
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.inherit = 1;
+      fds[kind] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+      if (fds[kind] < 0) {
+	refused = std::string("perf_event_open: ") + strerror(errno);
+	close_all();
+	return; }}
+#else
+    refused = "perf_event_open: not on this system";
+#endif
+  }
+  ~ProbeCounters() { close_all(); }
+  bool available() const { return(fds[0] >= 0); }
+  void read_all(long long values[kinds]) const {
+    for (int kind = 0; kind < kinds; kind++) {
+      values[kind] = 0;
+      if ((fds[kind] >= 0) && (read(fds[kind], &values[kind], sizeof(long long)) != sizeof(long long)))
+	values[kind] = 0; }
+  }
+private:
+  void close_all() {
+    for (int kind = 0; kind < kinds; kind++) {
+      if (fds[kind] >= 0) close(fds[kind]);
+      fds[kind] = -1; }
+  }
+};
+
+struct ProbeSample {
+  double    wall;
+  double    cpu;
+  long      allocations;
+  long      bytes;
+  long long counters[ProbeCounters::kinds];
+};
+
+struct ProbeTotals {
+  long      calls;
+  double    wall;
+  double    cpu;
+  double    updates;
+  long      allocations;
+  long      bytes;
+  long long counters[ProbeCounters::kinds];
+};
+
+class Probe {
+public:
+  std::string tool;
+  Probe() : start_wall(wall_now()), start_cpu(cpu_now()) {}
+  static double wall_now() {
+    return(std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count());
+  }
+  static double cpu_now() {
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return(now.tv_sec + 1e-9 * now.tv_nsec);
+  }
+  void sample(ProbeSample& at) const {
+    at.wall = wall_now();
+    at.cpu = cpu_now();
+    at.allocations = probe_allocations().allocations.load(std::memory_order_relaxed);
+    at.bytes = probe_allocations().bytes.load(std::memory_order_relaxed);
+    counters.read_all(at.counters);
+  }
+  void add(const char* name, const ProbeSample& from, const ProbeSample& to, double updates) {
+    std::lock_guard<std::mutex> hold(lock);
+    ProbeTotals& totals = phases[name];
+    totals.calls++;
+    totals.wall += to.wall - from.wall;
+    totals.cpu += to.cpu - from.cpu;
+    totals.updates += updates;
+    totals.allocations += to.allocations - from.allocations;
+    totals.bytes += to.bytes - from.bytes;
+    for (int kind = 0; kind < ProbeCounters::kinds; kind++)
+      totals.counters[kind] += to.counters[kind] - from.counters[kind];
+  }
+  void trace(const std::string& series, double x, double y) {
+    std::lock_guard<std::mutex> hold(lock);
+    traces[series].push_back(std::make_pair(x, y));
+  }
+  void report(std::ostream& out) {
+    std::lock_guard<std::mutex> hold(lock);
+    const ProbeAllocations& allocated = probe_allocations();
+    out << std::setprecision(9);
+    out << "{\"tool\": \"" << tool << "\", \"wall\": " << wall_now() - start_wall
+	<< ", \"cpu\": " << cpu_now() - start_cpu
+	<< ", \"allocations\": " << allocated.allocations << ", \"allocated_bytes\": " << allocated.bytes
+	<< ", \"frees\": " << allocated.frees << ", \"counters\": \""
+	<< (counters.available() ? "cycles instructions cache_misses" : counters.refused) << "\",\n";
+    out << " \"phases\": [\n";
+    size_t at = 0;
+    for (auto& phase : phases) {
+      const ProbeTotals& totals = phase.second;
+      out << "  {\"phase\": \"" << phase.first << "\", \"calls\": " << totals.calls
+	  << ", \"wall\": " << totals.wall << ", \"cpu\": " << totals.cpu
+	  << ", \"updates\": " << totals.updates
+	  << ", \"updates_per_second\": " << ((totals.wall > 0) ? totals.updates / totals.wall : 0)
+	  << ", \"allocations\": " << totals.allocations << ", \"allocated_bytes\": " << totals.bytes;
+      if (counters.available())
+	out << ", \"cycles\": " << totals.counters[0] << ", \"instructions\": " << totals.counters[1]
+	    << ", \"cache_misses\": " << totals.counters[2];
+      out << "}" << ((++at < phases.size()) ? "," : "") << "\n"; }
+    out << " ],\n \"traces\": [\n";
+    at = 0;
+    for (auto& trace : traces) {
+      out << "  {\"trace\": \"" << trace.first << "\", \"points\": [";
+      for (size_t point = 0; point < trace.second.size(); point++)
+	out << (point ? ", [" : "[") << trace.second[point].first << ", " << trace.second[point].second << "]";
+      out << "]}" << ((++at < traces.size()) ? "," : "") << "\n"; }
+    out << " ]}\n";
+  }
+private:
+  std::mutex                  lock;
+  double                      start_wall;
+  double                      start_cpu;
+  ProbeCounters               counters;
+  std::map<std::string, ProbeTotals> phases;
+  std::map<std::string, std::vector<std::pair<double, double>>> traces;
+};
+
+// The program's Probe, NULL when instrumentation is off.
+inline Probe* probe() {
+  static Probe* instance = probe_on() ? new Probe() : NULL;
+  return(instance);
+}
+
+inline void probe_report() {
+  Probe* current = probe();
+  std::string path = getenv("SPIKE_PROBE");
+  if (path.empty() || (path == "-")) {
+    current->report(std::cerr);
+    return; }
+  std::ofstream out(path.c_str());
+  if (!out) {
+    std::cerr << "PROBE: cannot write " << path << std::endl;
+    return; }
+  current->report(out);
+}
+
+// Names the program and has the report written at exit.
+inline void probe_start(const std::string& tool) {
+  if (!probe_on()) return;
+  probe()->tool = tool;
+  atexit(probe_report);
+}
+
+class ProbePhase {
+public:
+  ProbePhase(const char* init_name, double init_updates = 0) : name(NULL) {
+    if (!probe_on()) return;
+    name = init_name;
+    updates = init_updates;
+    probe()->sample(from);
+  }
+  ~ProbePhase() {
+    if (name == NULL) return;
+    ProbeSample to;
+    probe()->sample(to);
+    probe()->add(name, from, to, updates);
+  }
+private:
+  const char* name;
+  double      updates;
+  ProbeSample from;
+};
+
+inline void probe_trace(const char* series, double x, double y) {
+  if (probe_on()) probe()->trace(series, x, y);
+}
+
+inline void probe_trace(const std::string& series, double x, double y) {
+  if (probe_on()) probe()->trace(series, x, y);
+}
+
+#ifdef PROBE_ALLOCATIONS
+// Out of line, so that the compiler does not pair the malloc and free
+// it would otherwise see through them with the new and delete calls.
+__attribute__((noinline)) void* operator new(size_t bytes) {
+  if (probe_on()) {
+    probe_allocations().allocations.fetch_add(1, std::memory_order_relaxed);
+    probe_allocations().bytes.fetch_add(bytes, std::memory_order_relaxed); }
+  void* block = malloc(bytes ? bytes : 1);
+  if (block == NULL) throw std::bad_alloc();
+  return(block);
+}
+
+void* operator new[](size_t bytes) {
+  return(operator new(bytes));
+}
+
+__attribute__((noinline)) void operator delete(void* block) noexcept {
+  if (probe_on() && (block != NULL))
+    probe_allocations().frees.fetch_add(1, std::memory_order_relaxed);
+  free(block);
+}
+
+void operator delete[](void* block) noexcept {
+  operator delete(block);
+}
+#endif
+
+#endif
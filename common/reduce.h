@@ -0,0 +1,194 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __REDUCE_H
+#define __REDUCE_H
+
+/*
+  Reproducible sums over the rows of a buffer, for the densities and
+  distances of all the tools. A row is summed serially over its
+  columns; the rows are then added by a fixed binary tree whose
+  leaves are the rows numbered from the buffer's row 0 (not from the
+  first row summed), rows outside the range being zero leaves. Adding
+  a zero is exact, so the empty parts of the tree are skipped.
+
+  The tree is cut into blocks of reduce_blockrows rows, a power of
+  two, so the sum of a block (reduce_block()) is a whole subtree: blocks
+  may be summed by any thread, or any rank, in any order, and the
+  block sums added by the same tree over the block number
+  (reduce_blocks()) give the bits of reduce_rows() in one thread. The
+  order of every addition is the tree's, so neither the thread count
+  nor the vector width of the machine changes a result.
+
+  Compensated, a row carries Neumaier's correction and each node of
+  the tree the rounding error of its addition (TwoSum); the result is
+  the sum plus the gathered error, about as good as summing in twice
+  the precision, and as reproducible.
+*/
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+const int reduce_blockrows = 4096;  // rows per block, a power of two
+
+// A sum so far, and its rounding error when compensated (zero otherwise).
+struct ReducePartial {
+  double sum;
+  double error;
+};
+
+/* The cells summed: row r of the buffer at a + (r - origin) * stride,
+   the listed columns of it, in order; with b, the absolute differences
+   against the same cells of b. */
+struct ReduceCells {
+  const double* a;
+  const double* b;
+  int           origin;
+  size_t        stride;
+  const int*    columns;
+  int           count;
+};
+
+inline ReducePartial reduce_zero() {
+  ReducePartial result = {0.0, 0.0};
+  return(result);
+}
+
+inline double reduce_value(const ReducePartial& partial) {
+  return(partial.sum + partial.error);
+}
+
+template <bool compensated> inline void reduce_add(ReducePartial& partial, double value) {
+  double sum = partial.sum + value;
+  if (compensated)
+    partial.error = partial.error + ((std::abs(partial.sum) >= std::abs(value)) ?
+				     (partial.sum - sum) + value : (value - sum) + partial.sum);
+  partial.sum = sum;
+}
+
+template <bool compensated> inline ReducePartial reduce_row(const ReduceCells& cells, int row) {
+  size_t offset = size_t(row - cells.origin) * cells.stride;
+  const double* a = cells.a + offset;
+  ReducePartial result = reduce_zero();
+  if (cells.b == NULL)
+    for (int column = 0; column < cells.count; column++)
+      reduce_add<compensated>(result, a[cells.columns[column]]);
+  else {
+    const double* b = cells.b + offset;
+    for (int column = 0; column < cells.count; column++)
+      reduce_add<compensated>(result, std::abs(a[cells.columns[column]] - b[cells.columns[column]])); }
+  return(result);
+}
+
+// left = left + right, one node of the tree.
+template <bool compensated> inline void reduce_combine(ReducePartial& left, const ReducePartial& right) {
+  double sum = left.sum + right.sum;
+  if (compensated) {
+    double moved = sum - left.sum;
+    left.error = left.error + right.error + ((left.sum - (sum - moved)) + (right.sum - moved)); }
+  left.sum = sum;
+}
+
+/* The tree over nodes [0 ... count-1], padded with zero nodes to a
+   power of two; the nodes are overwritten. */
+template <bool compensated> inline ReducePartial reduce_tree(ReducePartial* nodes, int count) {
+  if (count <= 0) return(reduce_zero());
+  for (int width = 1; width < count; width = 2 * width)
+    for (int node = 0; node + width < count; node = node + 2 * width)
+      reduce_combine<compensated>(nodes[node], nodes[node + width]);
+  return(nodes[0]);
+}
+
+/* Block block's share of the sum over rows [first ... last]. The three
+   lowest levels of the tree are added as the rows are read, eight rows
+   at a time (a block starts on a multiple of eight), to keep the nodes
+   stored down to one per eight rows. */
+template <bool compensated> inline ReducePartial reduce_block(const ReduceCells& cells,
+							      int block,
+							      int first,
+							      int last) {
+  const int group = 8;
+  int base = block * reduce_blockrows;
+  int low  = std::max(first, base);
+  int high = std::min(last, base + reduce_blockrows - 1);
+  if (low > high) return(reduce_zero());
+  std::vector<ReducePartial> nodes((high - base) / group + 1, reduce_zero());
+  for (int node = (low - base) / group; node <= (high - base) / group; node++) {
+    ReducePartial rows[group];
+    int start = base + node * group;
+    if ((start >= low) && (start + group - 1 <= high))
+      for (int member = 0; member < group; member++)
+	rows[member] = reduce_row<compensated>(cells, start + member);
+    else
+      for (int member = 0; member < group; member++) {
+	int row = start + member;
+	rows[member] = ((row < low) || (row > high)) ? reduce_zero() : reduce_row<compensated>(cells, row); }
+    reduce_combine<compensated>(rows[0], rows[1]);
+    reduce_combine<compensated>(rows[2], rows[3]);
+    reduce_combine<compensated>(rows[4], rows[5]);
+    reduce_combine<compensated>(rows[6], rows[7]);
+    reduce_combine<compensated>(rows[0], rows[2]);
+    reduce_combine<compensated>(rows[4], rows[6]);
+    reduce_combine<compensated>(rows[0], rows[4]);
+    nodes[node] = rows[0]; }
+  return(reduce_tree<compensated>(&nodes[0], int(nodes.size())));
+}
+
+// The block sums of blocks [0 ... sums.size()-1] added up; sums is overwritten.
+template <bool compensated> inline double reduce_blocks(std::vector<ReducePartial>& sums) {
+  return(reduce_value(reduce_tree<compensated>(sums.data(), int(sums.size()))));
+}
+
+template <bool compensated> inline double reduce_rows(const ReduceCells& cells, int first, int last) {
+  if (first > last) return(0.0);
+  std::vector<ReducePartial> sums(last / reduce_blockrows + 1, reduce_zero());
+  for (int block = first / reduce_blockrows; block <= last / reduce_blockrows; block++)
+    sums[block] = reduce_block<compensated>(cells, block, first, last);
+  return(reduce_blocks<compensated>(sums));
+}
+
+/* The same sum, rows handed over one at a time in increasing order,
+   for buffers swept once and not revisited (ecq/streamdist.cpp). Holds
+   one block of row sums. */
+template <bool compensated> class ReduceStream {
+ public:
+  ReduceStream() : block(-1) {}
+  void add(int row, const ReducePartial& value) {
+    if (row / reduce_blockrows != block) {
+      flush();
+      block = row / reduce_blockrows;
+      leaves.assign(reduce_blockrows, reduce_zero()); }
+    leaves[row - block * reduce_blockrows] = value;
+  }
+  double result() {
+    flush();
+    return(reduce_blocks<compensated>(sums));
+  }
+ private:
+  void flush() {
+    if (block < 0) return;
+    if (int(sums.size()) <= block) sums.resize(block + 1, reduce_zero());
+    sums[block] = reduce_tree<compensated>(&leaves[0], reduce_blockrows);
+    block = -1;
+  }
+  int block;
+  std::vector<ReducePartial> leaves;
+  std::vector<ReducePartial> sums;
+};
+
+#endif
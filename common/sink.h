@@ -0,0 +1,241 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __SINK_H
+#define __SINK_H
+
+/*
+  Results written by a background thread, so that the evolution loop
+  only drops a record in a queue. A record is a kind ('d' for a
+  density, 'e' for a stationary error, ...), a step and a value; the
+  run's parameters are given once. A sink given an index name also
+  carries an integer index per record (as ecq-pg's depth m), as a
+  column between step and value. The formats are
+
+    human   each record through the driver's own formatting, the
+            lines the drivers have always printed
+    csv     a header of the parameter names then kind,step,value, and
+            a row per record led by the parameter values
+    binary  a text header line, "# name=value ... records=16\n", then
+            per record a SinkBinary: kind, three bytes padding, step
+            as a 32-bit int, value as a double, in native byte order;
+            with an index, "index=name records=24" and a SinkIndexed
+
+  A sink keeps a record only every `every' steps, and with a ratio
+  above 1 only when its step is at least ratio times that of the last
+  kept record of its kind, which thins long runs geometrically. pace()
+  sets another cadence for one kind, or starts its thinning afresh.
+  Header only, like sweep.h.
+*/
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <stdexcept>
+#include <cstdint>
+#include <unistd.h>
+
+enum SinkFormat {sink_human, sink_csv, sink_binary};
+
+inline SinkFormat sink_format(const std::string& name) {
+  if (name == "human") return(sink_human);
+  if (name == "csv") return(sink_csv);
+  if (name == "binary") return(sink_binary);
+  throw std::invalid_argument("SINK: unknown format " + name + " (human, csv or binary)");
+}
+
+struct SinkRecord {
+  char   kind;
+  int    step;
+  double value;
+  int    index;
+};
+
+struct SinkBinary {
+  char    kind;
+  char    pad[3];
+  int32_t step;
+  double  value;
+};
+
+struct SinkIndexed {
+  char    kind;
+  char    pad[3];
+  int32_t step;
+  int32_t index;
+  int32_t pad_index;
+  double  value;
+};
+
+/* A ring of records between one producer and one consumer, without
+   locks: the producer alone moves tail, the consumer alone head. */
+
+class SinkQueue {
+public:
+  SinkQueue(size_t capacity_log2) : ring(size_t(1) << capacity_log2),
+				    mask((size_t(1) << capacity_log2) - 1),
+				    head(0), tail(0) {}
+  bool push(const SinkRecord& record) {
+    size_t at = tail.load(std::memory_order_relaxed);
+    if (at - head.load(std::memory_order_acquire) > mask) return(false);
+    ring[at & mask] = record;
+    tail.store(at + 1, std::memory_order_release);
+    return(true);
+  }
+  bool pop(SinkRecord& record) {
+    size_t at = head.load(std::memory_order_relaxed);
+    if (at == tail.load(std::memory_order_acquire)) return(false);
+    record = ring[at & mask];
+    head.store(at + 1, std::memory_order_release);
+    return(true);
+  }
+private:
+  std::vector<SinkRecord> ring;
+  const size_t            mask;
+  std::atomic<size_t>     head;
+  std::atomic<size_t>     tail;
+};
+
+class ResultSink {
+public:
+  typedef std::vector<std::pair<std::string, double>> Params;
+  typedef std::function<void(std::ostream&, const SinkRecord&)> Human;
+  // An empty path or "-" writes to standard output.
+  ResultSink(SinkFormat init_format,
+	     const std::string& path,
+	     const Params& init_params,
+	     Human init_human,
+	     int init_every = 1,
+	     double init_ratio = 0,
+	     const std::string& init_index = "") : format(init_format), params(init_params),
+						   index_name(init_index),
+						   human(init_human), out(&std::cout), queue(16),
+				      pushed(0), written(0), closing(false) {
+    for (int kind = 0; kind < 256; kind++)
+      pace(char(kind), init_every, init_ratio);
+    if (!path.empty() && (path != "-")) {
+      file.open(path.c_str(), (format == sink_binary) ? std::ios::out | std::ios::binary : std::ios::out);
+      if (!file) throw std::runtime_error("SINK: cannot write " + path);
+      out = &file; }
+    header();
+    writer = std::thread([this] { write_records(); });
+  }
+  ~ResultSink() {
+    closing = true;
+    writer.join();
+  }
+  void pace(char kind, int every, double ratio) {
+    paces[(unsigned char) kind] = {(every > 0) ? every : 1, ratio, 0};
+  }
+  // Whether a record of this kind at this step would be kept.
+  bool wants(char kind, int step) const {
+    const Pace& kept = paces[(unsigned char) kind];
+    if (step % kept.every != 0) return(false);
+    return((kept.ratio <= 1) || (kept.last_kept == 0) || (step >= kept.ratio * kept.last_kept));
+  }
+  void put(char kind, int step, double value, int index = 0) {
+    if (!wants(kind, step)) return;
+    paces[(unsigned char) kind].last_kept = step;
+    SinkRecord record = {kind, step, value, index};
+    while (!queue.push(record))
+      std::this_thread::yield();
+    pushed.store(pushed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+  // Waits until everything put so far is written out, as before a prompt.
+  void drain() {
+    long target = pushed.load(std::memory_order_relaxed);
+    while (written.load(std::memory_order_acquire) < target)
+      usleep(100);
+  }
+private:
+  struct Pace {
+    int    every;
+    double ratio;
+    int    last_kept;
+  };
+  const SinkFormat  format;
+  const Params      params;
+  const std::string index_name;
+  Human             human;
+  Pace              paces[256];
+  std::ofstream     file;
+  std::ostream*     out;
+  SinkQueue         queue;
+  std::atomic<long> pushed;
+  std::atomic<long> written;
+  std::atomic<bool> closing;
+  std::thread       writer;
+
+  void header() {
+    if (format == sink_csv) {
+      for (const std::pair<std::string, double>& param : params)
+	*out << param.first << ",";
+      *out << "kind,step," << (index_name.empty() ? "" : index_name + ",") << "value\n"; }
+    else if (format == sink_binary) {
+      *out << "#" << std::setprecision(17);
+      for (const std::pair<std::string, double>& param : params)
+	*out << " " << param.first << "=" << param.second;
+      if (!index_name.empty())
+	*out << " index=" << index_name;
+      *out << " records=" << (index_name.empty() ? sizeof(SinkBinary) : sizeof(SinkIndexed)) << "\n"; }
+  }
+  void write_one(const SinkRecord& record) {
+    if (format == sink_human)
+      human(*out, record);
+    else if (format == sink_csv) {
+      *out << std::setprecision(17);
+      for (const std::pair<std::string, double>& param : params)
+	*out << param.second << ",";
+      *out << record.kind << "," << record.step << ",";
+      if (!index_name.empty())
+	*out << record.index << ",";
+      *out << record.value << "\n"; }
+    else if (!index_name.empty()) {
+      SinkIndexed packed = {record.kind, {0, 0, 0}, int32_t(record.step), int32_t(record.index), 0, record.value};
+      out->write((const char*) &packed, sizeof(packed)); }
+    else {
+      SinkBinary packed = {record.kind, {0, 0, 0}, int32_t(record.step), record.value};
+      out->write((const char*) &packed, sizeof(packed)); }
+  }
+  // Writes records as they come, flushing whenever the queue runs dry.
+  void write_records() {
+    SinkRecord record;
+    long count = 0;
+    while (true) {
+      bool finishing = closing.load(std::memory_order_acquire);
+      bool any = false;
+      while (queue.pop(record)) {
+	write_one(record);
+	count++;
+	any = true; }
+      if (any) {
+	out->flush();
+	written.store(count, std::memory_order_release); }
+      else if (finishing)
+	break;
+      else
+	usleep(200); }
+    out->flush();
+  }
+};
+
+#endif
@@ -0,0 +1,296 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __SURROGATE_H
+#define __SURROGATE_H
+
+/*
+  Surrogate tables: the log-density of a tool over a grid of its
+  parameters and of the step, computed once by a sweep driver (-T) and
+  then read by memory mapping to answer queries off the grid (-Q)
+  without evolving anything.
+
+  A query is interpolated linearly in log-density along every axis,
+  between the corners of the grid cell around it. The result lies
+  between the smallest and the largest corner, and so does the true
+  log-density when it is monotone in each parameter across the cell
+  (growing or shrinking, each axis its own way): the spread of the
+  corners, plus the rounding of the stored floats, is a bound on the
+  error in log-density, about the relative error of the density. The
+  writer checks that every axis is monotone along all the edges of
+  the grid, but for steps the wrong way of less than surrogate_slack
+  (rounding, where a density is about 1) which every bound then
+  allows for, and records which are; a cell across an axis that is not,
+  a query off the grid, or a corner of density zero next to one that
+  is not, gets an unbounded answer. surrogate_answer() takes the
+  interpolation when its bound is within the caller's tolerance and
+  otherwise computes the point exactly.
+
+  Table layout, native byte order:
+
+    char     magic[8]        "SPKSURR1"
+    int32    axes
+    int32    (zero)
+    int64    cells           product of the axis lengths
+    per axis: char name[24], int32 length, int32 monotone (+1, -1, 0)
+    double   the values of each axis in turn, increasing
+    float    log-density per cell, the last axis fastest
+*/
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sweep.h"
+
+static const char surrogate_magic[8] = {'S','P','K','S','U','R','R','1'};
+const double surrogate_slack = 1e-9;  // in log-density
+
+struct SurrogateAxisRecord {
+  char    name[24];
+  int32_t length;
+  int32_t monotone;
+};
+
+struct SurrogateAnswer {
+  double density;
+  double bound;  // on |log(density) - log(true density)|; 0 when exact
+  bool   exact;  // computed, the bound being over the tolerance
+};
+
+/* Writes the table of axes (the step last, by convention) and their
+   log-densities, the last axis fastest, through a scratch file renamed
+   over path. */
+inline void surrogate_write(const std::string& path,
+			    const GridAxes& axes,
+			    const std::vector<float>& cells) {
+  size_t count = 1;
+  for (const std::pair<std::string, std::vector<double> >& axis : axes) {
+    if (axis.first.size() >= sizeof(SurrogateAxisRecord().name))
+      throw std::invalid_argument("SURROGATE: axis name too long: " + axis.first);
+    for (size_t at = 1; at < axis.second.size(); at++)
+      if (!(axis.second[at - 1] < axis.second[at]))
+	throw std::invalid_argument("SURROGATE: values of " + axis.first + " must increase");
+    count = count * axis.second.size(); }
+  if (cells.size() != count) throw std::invalid_argument("SURROGATE: cells do not fill the grid");
+  std::vector<SurrogateAxisRecord> records(axes.size());
+  size_t inner = count;
+  for (size_t axis = 0; axis < axes.size(); axis++) {
+    SurrogateAxisRecord& record = records[axis];
+    memset(&record, 0, sizeof(record));
+    strncpy(record.name, axes[axis].first.c_str(), sizeof(record.name) - 1);
+    record.length = int32_t(axes[axis].second.size());
+    // Monotone if no edge along the axis goes up, or none goes down.
+    inner = inner / record.length;
+    bool up = false, down = false, unordered = false;
+    for (size_t cell = 0; cell < count; cell++) {
+      if ((cell / inner) % record.length == size_t(record.length - 1)) continue;
+      float here = cells[cell], next = cells[cell + inner];
+      if (std::isnan(here) || std::isnan(next)) unordered = true;
+      else if (next > here + surrogate_slack) up = true;
+      else if (next < here - surrogate_slack) down = true; }
+    record.monotone = (unordered || (up && down)) ? 0 : down ? -1 : 1; }
+
+  std::string scratch = path + ".tmp";
+  std::ofstream out(scratch.c_str(), std::ios::binary | std::ios::trunc);
+  if (!out) throw std::runtime_error("SURROGATE: cannot create " + scratch);
+  int32_t header[2] = {int32_t(axes.size()), 0};
+  int64_t cell_count = int64_t(count);
+  out.write(surrogate_magic, 8);
+  out.write((const char*) header, sizeof(header));
+  out.write((const char*) &cell_count, sizeof(cell_count));
+  out.write((const char*) &records[0], records.size() * sizeof(SurrogateAxisRecord));
+  for (const std::pair<std::string, std::vector<double> >& axis : axes)
+    out.write((const char*) &axis.second[0], axis.second.size() * sizeof(double));
+  out.write((const char*) &cells[0], cells.size() * sizeof(float));
+  out.close();
+  if (!out) throw std::runtime_error("SURROGATE: cannot write " + scratch);
+  if (rename(scratch.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("SURROGATE: cannot rename onto " + path + ": " + strerror(errno));
+}
+
+class SurrogateTable {
+public:
+  GridAxes         axes;
+  std::vector<int> monotone;
+
+  SurrogateTable(const std::string& path) {
+    fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("SURROGATE: cannot open " + path + ": " + strerror(errno));
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+      close(fd);
+      throw std::runtime_error("SURROGATE: cannot stat " + path); }
+    bytes = size_t(status.st_size);
+    map = (bytes > 0) ? mmap(NULL, bytes, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (map == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("SURROGATE: cannot map " + path); }
+    try {
+      read_layout(); }
+    catch (...) {
+      munmap(map, bytes);
+      close(fd);
+      throw; }
+  }
+  ~SurrogateTable() {
+    munmap(map, bytes);
+    close(fd);
+  }
+
+  // The interpolated density at a point, one value per axis in order.
+  SurrogateAnswer lookup(const std::vector<double>& point) const {
+    const double unbounded = std::numeric_limits<double>::infinity();
+    SurrogateAnswer answer = {0.0, unbounded, false};
+    if (point.size() != axes.size()) throw std::invalid_argument("SURROGATE: point has the wrong number of values");
+    std::vector<size_t> low(axes.size());
+    std::vector<double> weight(axes.size());   // of the upper corner
+    bool certified = true;
+    for (size_t axis = 0; axis < axes.size(); axis++) {
+      const std::vector<double>& values = axes[axis].second;
+      double x = point[axis];
+      if (!(x >= values.front()) || !(x <= values.back())) return(answer);
+      size_t at = std::upper_bound(values.begin(), values.end(), x) - values.begin();
+      if (at > 0) at--;
+      if ((at + 1 < values.size()) && (x > values[at])) {
+	weight[axis] = (x - values[at]) / (values[at + 1] - values[at]);
+	if (monotone[axis] == 0) certified = false; }
+      else
+	weight[axis] = 0.0;
+      low[axis] = at; }
+    double value = 0.0, lowest = unbounded, highest = -unbounded, largest = 0.0;
+    for (size_t corner = 0; corner < (size_t(1) << axes.size()); corner++) {
+      double share = 1.0;
+      size_t cell = 0;
+      for (size_t axis = 0; axis < axes.size(); axis++) {
+	bool upper = (corner >> axis) & 1;
+	if (upper && (weight[axis] == 0.0)) {
+	  share = 0.0;
+	  break; }
+	share = share * (upper ? weight[axis] : 1.0 - weight[axis]);
+	cell = cell * axes[axis].second.size() + low[axis] + upper; }
+      if (share == 0.0) continue;
+      double corner_value = cells[cell];
+      value = value + share * corner_value;
+      lowest = std::min(lowest, corner_value);
+      highest = std::max(highest, corner_value);
+      if (std::isfinite(corner_value)) largest = std::max(largest, std::abs(corner_value)); }
+    answer.density = std::exp(value);
+    if (!certified || std::isnan(value) || (std::isinf(lowest) && (lowest != highest))) return(answer);
+    // The spread of the corners, the slack of the monotone check, and
+    // the rounding of the stored floats (half an epsilon of the
+    // largest), with as much again to spare for the arithmetic here.
+    answer.bound = (std::isinf(lowest) ? 0.0 : highest - lowest) + surrogate_slack +
+      largest * std::numeric_limits<float>::epsilon();
+    return(answer);
+  }
+
+private:
+  int          fd;
+  size_t       bytes;
+  void*        map;
+  const float* cells;
+
+  void read_layout() {
+    const char* base = (const char*) map;
+    size_t at = 24;
+    if ((bytes < at) || (memcmp(base, surrogate_magic, 8) != 0))
+      throw std::runtime_error("SURROGATE: not a surrogate table");
+    int32_t count;
+    int64_t cell_count;
+    memcpy(&count, base + 8, sizeof(count));
+    memcpy(&cell_count, base + 16, sizeof(cell_count));
+    if ((count < 1) || (count > 16)) throw std::runtime_error("SURROGATE: damaged table");
+    if (bytes < at + count * sizeof(SurrogateAxisRecord)) throw std::runtime_error("SURROGATE: table truncated");
+    const SurrogateAxisRecord* records = (const SurrogateAxisRecord*) (base + at);
+    at = at + count * sizeof(SurrogateAxisRecord);
+    int64_t product = 1;
+    for (int axis = 0; axis < count; axis++) {
+      if ((records[axis].length < 1) || (bytes < at + records[axis].length * sizeof(double)))
+	throw std::runtime_error("SURROGATE: table truncated");
+      const double* values = (const double*) (base + at);
+      axes.push_back(std::make_pair(std::string(records[axis].name, strnlen(records[axis].name, sizeof(records[axis].name))),
+				    std::vector<double>(values, values + records[axis].length)));
+      monotone.push_back(records[axis].monotone);
+      at = at + records[axis].length * sizeof(double);
+      product = product * records[axis].length; }
+    if ((product != cell_count) || (bytes != at + size_t(cell_count) * sizeof(float)))
+      throw std::runtime_error("SURROGATE: table truncated or damaged");
+    cells = (const float*) (base + at);
+  }
+};
+
+// The table's answer if its bound is within tolerance, otherwise that
+// of exact(point).
+inline SurrogateAnswer surrogate_answer(const SurrogateTable& table,
+					const std::vector<double>& point,
+					double tolerance,
+					const std::function<double(const std::vector<double>&)>& exact) {
+  SurrogateAnswer answer = table.lookup(point);
+  if (answer.bound <= tolerance) return(answer);
+  answer.density = exact(point);
+  answer.bound = 0.0;
+  answer.exact = true;
+  return(answer);
+}
+
+/* Answers the queries on in, one point per line (the values of the
+   table's axes in order, blank or '#' lines skipped), with a line on
+   out each: the density, the bound, and "exact" if it was computed.
+   A point that cannot be computed gets an error line with what the
+   table has. */
+inline void surrogate_serve(const SurrogateTable& table,
+			    std::istream& in,
+			    std::ostream& out,
+			    double tolerance,
+			    const std::function<double(const std::vector<double>&)>& exact) {
+  std::string line;
+  while (std::getline(in, line)) {
+    line = grid_trim(line.substr(0, line.find('#')));
+    if (line.empty()) continue;
+    std::istringstream values(line);
+    std::vector<double> point;
+    double value;
+    while (values >> value)
+      point.push_back(value);
+    if (!values.eof() || (point.size() != table.axes.size())) {
+      out << "error: expected " << table.axes.size() << " numbers" << std::endl;
+      continue; }
+    try {
+      SurrogateAnswer answer = surrogate_answer(table, point, tolerance, exact);
+      out << std::setprecision(17) << answer.density << " " << std::setprecision(6) << answer.bound
+	  << (answer.exact ? " exact" : "") << std::endl; }
+    catch (const std::exception& error) {
+      SurrogateAnswer answer = table.lookup(point);
+      out << "error: " << error.what() << "; the table has " << std::setprecision(17) << answer.density
+	  << " " << std::setprecision(6) << answer.bound << std::endl; }}
+}
+
+#endif
@@ -0,0 +1,280 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __SWEEP_H
+#define __SWEEP_H
+
+// Parameter-grid sweeps, shared by the ecq, pow and pos sweep drivers:
+// grid specifications, a log of finished points that makes reruns skip
+// them, and a work-stealing thread pool that runs the costly points
+// first. Header only, so that each tool's directory still builds on
+// its own.
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <cmath>
+
+/* A grid specification lists one parameter per line, with either a
+   comma-separated list of values or an arithmetic range from:to:step
+   (inclusive); '#' starts a comment. The grid is the product of the
+   lines, in the order given:
+
+     hon_stake = 0.95, 0.90, 0.85
+     f         = 0.05
+     delta     = 5:20:5
+     w         = 50000
+*/
+
+class GridPoint {
+public:
+  std::vector<std::pair<std::string, double> > values;
+  double get(const std::string& name) const {
+    for (const std::pair<std::string, double>& value : values)
+      if (value.first == name) return(value.second);
+    throw std::invalid_argument("GRID: point has no parameter " + name);
+  }
+  bool has(const std::string& name) const {
+    for (const std::pair<std::string, double>& value : values)
+      if (value.first == name) return(true);
+    return(false);
+  }
+  // Canonical text of the point, the key of its line in the result log;
+  // twelve digits hide the rounding of ranges like 0.8:0.95:0.05.
+  std::string key() const {
+    std::ostringstream text;
+    text << std::setprecision(12);
+    for (size_t at = 0; at < values.size(); at++)
+      text << (at ? " " : "") << values[at].first << "=" << values[at].second;
+    return(text.str());
+  }
+};
+
+inline std::string grid_trim(const std::string& text) {
+  size_t first = text.find_first_not_of(" \t\r");
+  if (first == std::string::npos) return("");
+  return(text.substr(first, text.find_last_not_of(" \t\r") - first + 1));
+}
+
+typedef std::vector<std::pair<std::string, std::vector<double> > > GridAxes;
+
+inline GridAxes read_axes(std::istream& spec) {
+  GridAxes axes;
+  std::string line;
+  while (std::getline(spec, line)) {
+    line = grid_trim(line.substr(0, line.find('#')));
+    if (line.empty()) continue;
+    size_t equals = line.find('=');
+    if (equals == std::string::npos) throw std::invalid_argument("GRID: expected name = values, got " + line);
+    std::string name = grid_trim(line.substr(0, equals));
+    std::string values = line.substr(equals + 1);
+    std::vector<double> axis;
+    if (values.find(':') != std::string::npos) {
+      double from, to, step;
+      char colon1, colon2;
+      std::istringstream range(values);
+      if (!(range >> from >> colon1 >> to >> colon2 >> step) || (step <= 0))
+	throw std::invalid_argument("GRID: bad range for " + name);
+      // Count the steps rather than accumulating them, so 0.8:0.95:0.05 ends at 0.95.
+      long count = long(std::floor((to - from) / step + 1e-9));
+      for (long at = 0; at <= count; at++)
+	axis.push_back(from + at * step); }
+    else {
+      std::istringstream list(values);
+      std::string item;
+      while (std::getline(list, item, ',')) {
+	item = grid_trim(item);
+	if (item.empty()) continue;
+	axis.push_back(std::stod(item)); }}
+    if (axis.empty()) throw std::invalid_argument("GRID: no values for " + name);
+    axes.push_back(std::make_pair(name, axis)); }
+  return(axes);
+}
+
+inline std::vector<GridPoint> expand_grid(const GridAxes& axes) {
+  std::vector<GridPoint> points(1);
+  for (size_t axis = 0; axis < axes.size(); axis++) {
+    std::vector<GridPoint> grown;
+    for (const GridPoint& point : points)
+      for (double value : axes[axis].second) {
+	GridPoint next = point;
+	next.values.push_back(std::make_pair(axes[axis].first, value));
+	grown.push_back(next); }
+    points = grown; }
+  return(points);
+}
+
+inline std::vector<GridPoint> read_grid(std::istream& spec) {
+  return(expand_grid(read_axes(spec)));
+}
+
+// The specification text of a grid, exact enough to read back the
+// same doubles.
+inline std::string write_axes(const GridAxes& axes) {
+  std::ostringstream text;
+  text << std::setprecision(17);
+  for (const std::pair<std::string, std::vector<double> >& axis : axes) {
+    text << axis.first << " =";
+    for (size_t at = 0; at < axis.second.size(); at++)
+      text << (at ? ", " : " ") << axis.second[at];
+    text << "\n"; }
+  return(text.str());
+}
+
+/* The result log holds one line per finished point: its key, a tab,
+   and the result text. Lines are appended and flushed as points
+   finish, so an interrupted sweep keeps what it had done; opening an
+   existing log makes its points count as done. */
+
+class ResultLog {
+public:
+  ResultLog(const std::string& path) {
+    std::ifstream previous(path.c_str());
+    std::string line;
+    while (std::getline(previous, line)) {
+      size_t tab = line.find('\t');
+      if (tab != std::string::npos) finished.insert(line.substr(0, tab)); }
+    log.open(path.c_str(), std::ios::app);
+    if (!log) throw std::runtime_error("SWEEP: cannot append to " + path);
+  }
+  bool done(const std::string& key) {
+    std::lock_guard<std::mutex> guard(lock);
+    return(finished.count(key) > 0);
+  }
+  void record(const std::string& key, const std::string& result) {
+    std::lock_guard<std::mutex> guard(lock);
+    log << key << '\t' << result << '\n' << std::flush;
+    finished.insert(key);
+  }
+  size_t count() {
+    std::lock_guard<std::mutex> guard(lock);
+    return(finished.size());
+  }
+private:
+  std::mutex            lock;
+  std::ofstream         log;
+  std::set<std::string> finished;
+};
+
+/* Work-stealing pool. Tasks carry a cost estimate. Tasks submitted
+   before run() are sorted by cost and dealt round-robin, so every
+   worker starts on one of the heaviest. A worker takes the costliest
+   task of its own queue, and when that is empty steals the costliest
+   task it can find in the others. Tasks may submit further tasks while
+   the pool runs (say, the points that wait for a shared stationary
+   distribution); those go to the submitting worker's queue. run()
+   returns when every task, including those, has finished. */
+
+class WorkStealingPool {
+public:
+  typedef std::function<void()> Task;
+  const int threads;
+  WorkStealingPool(int init_threads) : threads(std::max(init_threads, 1)),
+				       queues(std::max(init_threads, 1)),
+				       pending(0),
+				       running(false) {}
+  void submit(double cost, Task task) {
+    pending++;
+    if (!running) {
+      initial.push_back(Entry(cost, task));
+      return; }
+    Queue& queue = queues[current_worker() >= 0 ? current_worker() : 0];
+    {
+      std::lock_guard<std::mutex> guard(queue.lock);
+      std::deque<Entry>::iterator place = queue.tasks.begin();
+      while ((place != queue.tasks.end()) && (place->first >= cost)) place++;
+      queue.tasks.insert(place, Entry(cost, task));
+    }
+    wake.notify_all();
+  }
+  void run() {
+    std::stable_sort(initial.begin(), initial.end(),
+		     [](const Entry& a, const Entry& b) { return a.first > b.first; });
+    for (size_t at = 0; at < initial.size(); at++)
+      queues[at % threads].tasks.push_back(initial[at]);
+    initial.clear();
+    running = true;
+    std::vector<std::thread> workers;
+    for (int worker = 0; worker < threads; worker++)
+      workers.push_back(std::thread(&WorkStealingPool::work, this, worker));
+    for (std::thread& worker : workers)
+      worker.join();
+    running = false;
+  }
+  static int& current_worker() {
+    static thread_local int worker = -1;
+    return(worker);
+  }
+private:
+  typedef std::pair<double, Task> Entry;
+  struct Queue {
+    std::mutex        lock;
+    std::deque<Entry> tasks;
+  };
+  std::vector<Queue>      queues;
+  std::vector<Entry>      initial;
+  std::atomic<long>       pending;
+  std::atomic<bool>       running;
+  std::mutex              idle;
+  std::condition_variable wake;
+
+  bool take(int from, Task& task) {
+    std::lock_guard<std::mutex> guard(queues[from].lock);
+    if (queues[from].tasks.empty()) return(false);
+    task = queues[from].tasks.front().second;
+    queues[from].tasks.pop_front();
+    return(true);
+  }
+  bool steal(int thief, Task& task) {
+    int    victim = -1;
+    double heaviest = -1;
+    for (int other = 0; other < threads; other++) {
+      if (other == thief) continue;
+      std::lock_guard<std::mutex> guard(queues[other].lock);
+      if (!queues[other].tasks.empty() && (queues[other].tasks.front().first > heaviest)) {
+	heaviest = queues[other].tasks.front().first;
+	victim = other; }}
+    return((victim >= 0) && take(victim, task));
+  }
+  void work(int worker) {
+    current_worker() = worker;
+    Task task;
+    while (pending > 0) {
+      if (take(worker, task) || steal(worker, task)) {
+	task();
+	task = Task();
+	if (--pending == 0) wake.notify_all(); }
+      else {
+	std::unique_lock<std::mutex> guard(idle);
+	wake.wait_for(guard, std::chrono::milliseconds(10)); }}
+    current_worker() = -1;
+  }
+};
+
+#endif
@@ -0,0 +1,243 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include "sweep.h"
+#include "workqueue.h"
+#include "worker.h"
+
+using namespace std;
+
+/*
+  Cuts a grid of ecq, pow or pos points into work units, queues them
+  in a directory (see workqueue.cpp), and sees them through: it starts
+  local workers, serves remote ones over TCP, requeues the units of
+  workers whose heartbeats stop, and merges the units' results into
+  one file in the result-log format of the sweep drivers.
+
+  A unit holds all the points sharing what a sweep driver computes
+  once: the evolution of an ecq (hon_stake, f, delta), the stationary
+  distribution of a pow (hon_param, adv_param, delta, approx_error),
+  the stationary distribution of a pos p. Units with larger delta go
+  first. Rerunning with the same queue directory picks up where the
+  last run stopped.
+*/
+
+static set<string> unit_keys(const string& tool) {
+  if (tool == "ecq") return {"hon_stake", "f", "delta"};
+  if (tool == "pow") return {"hon_param", "adv_param", "delta", "approx_error"};
+  if (tool == "pos") return {"p"};
+  throw std::invalid_argument("SWEEP COORD: unknown tool " + tool);
+}
+
+static vector<string> shard(const GridAxes& axes, const string& tool) {
+  set<string> keys = unit_keys(tool);
+  GridAxes fixed, free;
+  for (const pair<string, vector<double> >& axis : axes)
+    (keys.count(axis.first) ? fixed : free).push_back(axis);
+  vector<pair<double, string> > units;
+  for (const GridPoint& point : expand_grid(fixed)) {
+    GridAxes unit;
+    for (const pair<string, vector<double> >& axis : axes)
+      if (keys.count(axis.first))
+	unit.push_back(make_pair(axis.first, vector<double>(1, point.get(axis.first))));
+      else
+	unit.push_back(axis);
+    double cost = point.has("delta") ? point.get("delta") + 1 : 1;
+    units.push_back(make_pair(cost, write_axes(unit))); }
+  stable_sort(units.begin(), units.end(),
+	      [](const pair<double, string>& a, const pair<double, string>& b) { return a.first > b.first; });
+  vector<string> texts;
+  for (const pair<double, string>& unit : units)
+    texts.push_back(unit.second);
+  return(texts);
+}
+
+// One remote worker's connection, served until it hangs up.
+static void serve(int socket, string dir) {
+  try {
+    Connection worker(socket);
+    WorkQueue queue(dir);
+    string line;
+    while (worker.read_line(line)) {
+      istringstream request(line);
+      string verb, id, name;
+      request >> verb;
+      if (verb == "CLAIM") {
+	request >> name;
+	string text;
+	WorkQueue::Claim claim = queue.claim(name, id, text);
+	if (claim == WorkQueue::claimed)
+	  worker.write("UNIT " + id + " " + to_string(text.size()) + "\n" + text);
+	else
+	  worker.write((claim == WorkQueue::wait) ? "WAIT\n" : "FINISHED\n"); }
+      else if (verb == "BEAT") {
+	request >> id >> name;
+	worker.write(queue.beat(id, name) ? "OK\n" : "LOST\n"); }
+      else if (verb == "RESULT") {
+	size_t length;
+	request >> id >> name >> length;
+	queue.complete(id, name, worker.read_bytes(length));
+	worker.write("OK\n"); }
+      else if (verb == "RELEASE") {
+	request >> id >> name;
+	queue.release(id, name);
+	worker.write("OK\n"); }
+      else break; }}
+  catch (std::exception& failure) {
+    cerr << "sweep-coord: remote worker: " << failure.what() << endl; }
+}
+
+static void listen_for_workers(int port, string dir) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if ((listener < 0) || (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0)
+      || (listen(listener, 64) != 0)) {
+    cerr << "sweep-coord: cannot listen on port " << port << ": " << strerror(errno) << endl;
+    return; }
+  while (true) {
+    int connection = accept(listener, NULL, NULL);
+    if (connection < 0) {
+      if (errno == EINTR) continue;
+      break; }
+    thread(serve, connection, dir).detach(); }
+}
+
+static string beside_me(const string& name) {
+  char self[PATH_MAX];
+  ssize_t length = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (length <= 0) return(name);
+  string path(self, length);
+  return(path.substr(0, path.rfind('/') + 1) + name);
+}
+
+// Starts a local worker: a separate program, so nothing of this
+// process's threads is inherited.
+static pid_t spawn(const vector<string>& arguments) {
+  vector<char*> argv;
+  for (const string& argument : arguments)
+    argv.push_back(const_cast<char*>(argument.c_str()));
+  argv.push_back(NULL);
+  pid_t child = fork();
+  if (child == 0) {
+    execv(argv[0], &argv[0]);
+    _exit(127); }
+  return(child);
+}
+
+int main(int argc, char **argv)
+{
+  string tool, dir, driver, output = "sweep.txt";
+  int workers = 1, threads = 1, port = 0, lease = 30;
+  int option;
+
+  while ((option = getopt(argc, argv, "t:d:x:n:j:p:l:o:")) != -1)
+    if (option == 't') tool = optarg;
+    else if (option == 'd') dir = optarg;
+    else if (option == 'x') driver = optarg;
+    else if (option == 'n') workers = atoi(optarg);
+    else if (option == 'j') threads = atoi(optarg);
+    else if (option == 'p') port = atoi(optarg);
+    else if (option == 'l') lease = atoi(optarg);
+    else if (option == 'o') output = optarg;
+    else {
+      argc = 0;
+      break; }
+  if ((argc - optind < 1) || dir.empty() || ((tool != "ecq") && (tool != "pow") && (tool != "pos"))
+      || (workers < 0) || (lease < 2)) {
+    cout << "Usage: " << argv[0] << " -t ecq|pow|pos -d queue_dir [-x sweep_driver] [-n local_workers] [-j threads]" << endl
+	 << "       [-p port] [-l lease_seconds] [-o output] <grid>" << endl;
+    cout << "  -x  the tool's sweep driver (default ../<tool>/<tool>-sweep beside this program)" << endl;
+    cout << "  -n  local workers (default 1), each running the driver with -j threads (default 1)" << endl;
+    cout << "  -p  also serve remote sweep-workers on this TCP port" << endl;
+    cout << "  -l  requeue a unit whose worker has not beaten for this long (default 30)" << endl;
+    cout << "  -o  merged results (default sweep.txt)" << endl;
+    return 0;
+  }
+  if (driver.empty()) driver = beside_me("../" + tool + "/" + tool + "-sweep");
+
+  if (WorkQueue::exists(dir))
+    cout << "Resuming the queue in " << dir << endl;
+  else {
+    ifstream spec(argv[optind]);
+    if (!spec) {
+      cout << "Cannot read " << argv[optind] << endl;
+      return 1; }
+    WorkQueue::create(dir, shard(read_axes(spec), tool)); }
+  WorkQueue queue(dir);
+  const int units = queue.units();
+
+  if (port > 0)
+    thread(listen_for_workers, port, dir).detach();
+  vector<string> arguments = {beside_me("sweep-worker"), "-d", dir, "-x", driver,
+			      "-j", to_string(threads), "-b", to_string(max(lease / 4, 1))};
+  set<pid_t> children;
+  for (int worker = 0; worker < workers; worker++)
+    children.insert(spawn(arguments));
+  int respawns = 2 * workers;
+
+  int done = queue.done(), reported = -1;
+  while (done < units) {
+    sleep(1);
+    int requeued = queue.reap(lease);
+    if (requeued > 0)
+      cout << "Requeued " << requeued << " unit(s) of silent workers" << endl;
+    int status;
+    pid_t child;
+    while ((child = waitpid(-1, &status, WNOHANG)) > 0) {
+      children.erase(child);
+      if (!(WIFEXITED(status) && (WEXITSTATUS(status) == 0)) && (respawns > 0)) {
+	cout << "Local worker " << child << " died; starting another" << endl;
+	children.insert(spawn(arguments));
+	respawns--; }}
+    done = queue.done();
+    if (done != reported)
+      cout << done << " of " << units << " units done" << endl << std::flush;
+    reported = done;
+    if (children.empty() && (port == 0) && (done < units)) {
+      cout << "No workers left, " << units - done << " units to go; rerun to resume" << endl;
+      return 1; }}
+
+  for (pid_t child : children)
+    waitpid(child, NULL, 0);
+  queue.merge(output);
+  cout << "Results of " << units << " units in " << output << endl;
+  return 0;
+}
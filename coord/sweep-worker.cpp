@@ -0,0 +1,61 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include "worker.h"
+
+using namespace std;
+
+// Works through the units of a sweep-coord queue, either straight from
+// its directory (as the coordinator's local workers do) or through the
+// coordinator over TCP.
+
+int main(int argc, char **argv)
+{
+  string dir, address, driver;
+  int threads = 1, beat = 5;
+  int option;
+
+  while ((option = getopt(argc, argv, "d:H:x:j:b:")) != -1)
+    if (option == 'd') dir = optarg;
+    else if (option == 'H') address = optarg;
+    else if (option == 'x') driver = optarg;
+    else if (option == 'j') threads = atoi(optarg);
+    else if (option == 'b') beat = atoi(optarg);
+    else {
+      argc = 0;
+      break; }
+  if ((argc == 0) || (dir.empty() == address.empty()) || driver.empty() || (beat < 1)) {
+    cout << "Usage: " << argv[0] << " (-d queue_dir | -H coordinator_host:port) -x sweep_driver [-j threads] [-b beat_seconds]" << endl;
+    return 0;
+  }
+  try {
+    UnitSource* source;
+    if (!dir.empty())
+      source = new QueueSource(dir, worker_name());
+    else
+      source = new SocketSource(address, worker_name());
+    int result = run_worker(source, driver, threads, beat);
+    delete(source);
+    return(result); }
+  catch (std::exception& failure) {
+    cerr << "sweep-worker: " << failure.what() << endl;
+    return 1; }
+}
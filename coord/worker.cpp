@@ -0,0 +1,289 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <netinet/in.h>
+#include "worker.h"
+
+using namespace std;
+
+/*
+  Protocol between a remote worker (W) and the coordinator (C), one
+  request and one reply at a time on a connection:
+
+    W: CLAIM <worker>                     C: UNIT <id> <bytes>, then the unit
+                                          C: WAIT | FINISHED
+    W: BEAT <id> <worker>                 C: OK | LOST
+    W: RESULT <id> <worker> <bytes>, then the results
+                                          C: OK
+    W: RELEASE <id> <worker>              C: OK
+
+  The coordinator carries each request out on its queue directory, so
+  a remote worker holds a lease like any local one.
+*/
+
+//class Connection
+
+Connection::Connection(int init_socket) : socket(init_socket) {}
+
+Connection::Connection(const string& address) : socket(-1) {
+  size_t colon = address.rfind(':');
+  if (colon == string::npos) throw std::invalid_argument("CONNECTION: expected host:port, got " + address);
+  struct addrinfo hints, *found;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(address.substr(0, colon).c_str(), address.substr(colon + 1).c_str(), &hints, &found) != 0)
+    throw std::runtime_error("CONNECTION: cannot resolve " + address);
+  socket = ::socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+  if ((socket < 0) || (connect(socket, found->ai_addr, found->ai_addrlen) != 0)) {
+    freeaddrinfo(found);
+    if (socket >= 0) close(socket);
+    throw std::runtime_error("CONNECTION: cannot reach " + address); }
+  freeaddrinfo(found);
+}
+
+Connection::~Connection() {
+  if (socket >= 0) close(socket);
+}
+
+bool Connection::fill() {
+  char chunk[65536];
+  ssize_t got;
+  do got = ::recv(socket, chunk, sizeof(chunk), 0);
+  while ((got < 0) && (errno == EINTR));
+  if (got <= 0) return(false);
+  buffered.append(chunk, got);
+  return(true);
+}
+
+bool Connection::read_line(string& line) {
+  size_t newline;
+  while ((newline = buffered.find('\n')) == string::npos)
+    if (!fill()) return(false);
+  line = buffered.substr(0, newline);
+  buffered.erase(0, newline + 1);
+  return(true);
+}
+
+string Connection::read_bytes(size_t length) {
+  while (buffered.size() < length)
+    if (!fill()) throw std::runtime_error("CONNECTION: closed in the middle of a block");
+  string block = buffered.substr(0, length);
+  buffered.erase(0, length);
+  return(block);
+}
+
+void Connection::write(const string& text) {
+  const char* from = text.data();
+  size_t left = text.size();
+  while (left > 0) {
+    ssize_t sent = ::send(socket, from, left, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error("CONNECTION: send failed: " + string(strerror(errno))); }
+    from = from + sent;
+    left = left - sent; }
+}
+
+//class UnitSource
+
+UnitSource::~UnitSource() {}
+
+QueueSource::QueueSource(const string& dir, const string& init_worker) : queue(dir),
+									 worker(init_worker) {}
+
+WorkQueue::Claim QueueSource::claim(string& id, string& text) {
+  return(queue.claim(worker, id, text));
+}
+
+bool QueueSource::beat(const string& id) {
+  return(queue.beat(id, worker));
+}
+
+void QueueSource::complete(const string& id, const string& results) {
+  queue.complete(id, worker, results);
+}
+
+void QueueSource::release(const string& id) {
+  queue.release(id, worker);
+}
+
+SocketSource::SocketSource(const string& address,
+			   const string& init_worker) : coordinator(address),
+							worker(init_worker) {}
+
+string SocketSource::reply() {
+  string line;
+  if (!coordinator.read_line(line)) return("FINISHED");  // coordinator gone: its sweep is over
+  return(line);
+}
+
+WorkQueue::Claim SocketSource::claim(string& id, string& text) {
+  coordinator.write("CLAIM " + worker + "\n");
+  istringstream answer(reply());
+  string word;
+  size_t length;
+  answer >> word;
+  if (word == "WAIT") return(WorkQueue::wait);
+  if (word != "UNIT") return(WorkQueue::finished);
+  answer >> id >> length;
+  text = coordinator.read_bytes(length);
+  return(WorkQueue::claimed);
+}
+
+bool SocketSource::beat(const string& id) {
+  coordinator.write("BEAT " + id + " " + worker + "\n");
+  return(reply() == "OK");
+}
+
+void SocketSource::complete(const string& id, const string& results) {
+  coordinator.write("RESULT " + id + " " + worker + " " + to_string(results.size()) + "\n" + results);
+  reply();
+}
+
+void SocketSource::release(const string& id) {
+  coordinator.write("RELEASE " + id + " " + worker + "\n");
+  reply();
+}
+
+//worker loop
+
+string worker_name() {
+  char host[256];
+  if (gethostname(host, sizeof(host)) != 0) strcpy(host, "host");
+  host[sizeof(host) - 1] = 0;
+  string name = string(host) + "-" + to_string(getpid());
+  for (char& letter : name)
+    if ((letter == '/') || (letter == '@') || (letter == ' ')) letter = '_';
+  return(name);
+}
+
+// The unit running, for stop_unit(): its driver and scratch files.
+static volatile pid_t running_child = 0;
+static char running_scratch[64];
+static char running_files[2][96];
+
+// On SIGTERM or SIGINT, stops the driver, removes the scratch
+// directory and dies of the signal; the lease is left to be reaped.
+static void stop_unit(int signal_number) {
+  pid_t child = running_child;
+  if (child > 0) {
+    kill(child, SIGTERM);
+    waitpid(child, NULL, 0);
+    unlink(running_files[0]);
+    unlink(running_files[1]);
+    rmdir(running_scratch); }
+  signal(signal_number, SIG_DFL);
+  raise(signal_number);
+}
+
+// Runs one unit in a scratch directory; false if it failed or its
+// lease was lost.
+static bool run_unit(UnitSource* source,
+		     const string& id,
+		     const string& text,
+		     const string& sweep,
+		     int threads,
+		     int beat_seconds,
+		     string& results) {
+  char scratch[] = "/tmp/sweep-unit-XXXXXX";
+  if (mkdtemp(scratch) == NULL) throw std::runtime_error("WORKER: cannot make a scratch directory");
+  string grid = string(scratch) + "/unit.grid";
+  string log = string(scratch) + "/unit.txt";
+  {
+    ofstream out(grid.c_str());
+    out << text;
+  }
+  strncpy(running_scratch, scratch, sizeof(running_scratch) - 1);
+  strncpy(running_files[0], grid.c_str(), sizeof(running_files[0]) - 1);
+  strncpy(running_files[1], log.c_str(), sizeof(running_files[1]) - 1);
+  pid_t parent = getpid();
+  pid_t child = fork();
+  if (child == 0) {
+    // Dies with the worker, even of SIGKILL.
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != parent) _exit(1);
+    int quiet = open("/dev/null", O_WRONLY);
+    dup2(quiet, 1);
+    string jobs = to_string(threads);
+    execl(sweep.c_str(), sweep.c_str(), "-j", jobs.c_str(), "-o", log.c_str(), grid.c_str(), (char*) NULL);
+    _exit(127); }
+  running_child = child;
+  bool ok = false, lost = false;
+  time_t last_beat = time(NULL);
+  while (true) {
+    int status;
+    pid_t done = waitpid(child, &status, WNOHANG);
+    if (done == child) {
+      running_child = 0;
+      ok = !lost && WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+      break; }
+    if (!lost && (time(NULL) - last_beat >= beat_seconds)) {
+      last_beat = time(NULL);
+      if (!source->beat(id)) {
+	lost = true;
+	kill(child, SIGTERM); }}
+    usleep(100000); }
+  if (ok) {
+    ifstream in(log.c_str());
+    ostringstream all;
+    all << in.rdbuf();
+    results = all.str(); }
+  unlink(grid.c_str());
+  unlink(log.c_str());
+  rmdir(scratch);
+  if (lost) cerr << "worker: lease on unit " << id << " lost, giving it up" << endl;
+  return(ok);
+}
+
+int run_worker(UnitSource* source,
+	       const string& sweep,
+	       int threads,
+	       int beat_seconds) {
+  string id, text, results;
+  struct sigaction stopping;
+  memset(&stopping, 0, sizeof(stopping));
+  stopping.sa_handler = stop_unit;
+  sigaction(SIGTERM, &stopping, NULL);
+  sigaction(SIGINT, &stopping, NULL);
+  while (true) {
+    WorkQueue::Claim claim = source->claim(id, text);
+    if (claim == WorkQueue::finished) return(0);
+    if (claim == WorkQueue::wait) {
+      sleep(1);
+      continue; }
+    if (run_unit(source, id, text, sweep, threads, beat_seconds, results))
+      source->complete(id, results);
+    else if (source->beat(id)) {
+      // Still ours, so the driver itself failed: hand the unit back and stop.
+      source->release(id);
+      cerr << "worker: " << sweep << " failed on unit " << id << endl;
+      return(1); }}
+}
@@ -0,0 +1,90 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __WORKER_H
+#define __WORKER_H
+
+#include <string>
+#include "workqueue.h"
+
+// One end of a TCP connection speaking the coordinator's protocol:
+// lines of words, the last word of some of them giving the length of
+// a block of bytes that follows.
+class Connection {
+public:
+  Connection(int);                       // connected socket, owned
+  Connection(const std::string&);        // host:port to connect to
+  ~Connection();
+  bool        read_line(std::string&);   // false at end of stream
+  std::string read_bytes(size_t);
+  void        write(const std::string&);
+private:
+  int         socket;
+  std::string buffered;
+  bool        fill();
+};
+
+// Where a worker gets its units: the queue directory itself, or a
+// coordinator over TCP.
+class UnitSource {
+public:
+  virtual ~UnitSource();
+  virtual WorkQueue::Claim claim(std::string&,            // unit id
+				 std::string&) = 0;       // unit text
+  virtual bool beat(const std::string&) = 0;
+  virtual void complete(const std::string&,               // unit id
+			const std::string&) = 0;          // results
+  virtual void release(const std::string&) = 0;
+};
+
+class QueueSource : public UnitSource {
+public:
+  QueueSource(const std::string&,   // queue directory
+	      const std::string&);  // worker name
+  WorkQueue::Claim claim(std::string&, std::string&);
+  bool beat(const std::string&);
+  void complete(const std::string&, const std::string&);
+  void release(const std::string&);
+private:
+  WorkQueue   queue;
+  std::string worker;
+};
+
+class SocketSource : public UnitSource {
+public:
+  SocketSource(const std::string&,  // coordinator host:port
+	       const std::string&); // worker name
+  WorkQueue::Claim claim(std::string&, std::string&);
+  bool beat(const std::string&);
+  void complete(const std::string&, const std::string&);
+  void release(const std::string&);
+private:
+  Connection  coordinator;
+  std::string worker;
+  std::string reply();
+};
+
+// Claims and runs units until the source has none left: each unit is
+// a grid run by the sweep driver, with heartbeats while it runs.
+// Returns non-zero if a unit failed.
+int run_worker(UnitSource*,
+	       const std::string&,  // sweep driver
+	       int,                 // its threads
+	       int);                // seconds between heartbeats
+
+std::string worker_name();          // host and process, unique enough
+
+#endif
@@ -0,0 +1,165 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdexcept>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "workqueue.h"
+
+using namespace std;
+
+/*
+  Queue directory layout:
+
+    units          number of units, written last by create()
+    todo/<id>      unclaimed units; ids are zero-padded claiming order
+    leased/<id>@<worker>
+                   claimed units, the mtime being the last heartbeat
+    done/<id>      results of finished units
+
+  A worker claims a unit by renaming it from todo/ into leased/ under
+  its own name, beats by touching that file and finishes by writing
+  done/<id> (through a temporary and a rename) before removing its
+  lease. The coordinator reaps leases whose heartbeat is too old,
+  renaming them back into todo/, and removes leases of units already
+  done. A worker whose lease has been reaped finds its beat failing
+  and gives the unit up; if it finished anyway its results are as good
+  as anyone's, done/<id> being written whole.
+*/
+
+static void write_file(const string& path, const string& text) {
+  string temporary = path + ".tmp" + to_string(getpid());
+  ofstream out(temporary.c_str(), ios::binary);
+  out << text;
+  out.close();
+  if (!out) throw std::runtime_error("WORK QUEUE: cannot write " + temporary);
+  if (rename(temporary.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("WORK QUEUE: cannot rename into " + path + ": " + strerror(errno));
+}
+
+static string read_file(const string& path) {
+  ifstream in(path.c_str(), ios::binary);
+  if (!in) throw std::runtime_error("WORK QUEUE: cannot read " + path);
+  ostringstream text;
+  text << in.rdbuf();
+  return(text.str());
+}
+
+bool WorkQueue::exists(const string& dir) {
+  struct stat status;
+  return(stat((dir + "/units").c_str(), &status) == 0);
+}
+
+void WorkQueue::create(const string& dir, const vector<string>& units) {
+  for (const string& sub : {string(""), string("/todo"), string("/leased"), string("/done")})
+    if ((mkdir((dir + sub).c_str(), 0755) != 0) && (errno != EEXIST))
+      throw std::runtime_error("WORK QUEUE: cannot make " + dir + sub + ": " + strerror(errno));
+  for (size_t unit = 0; unit < units.size(); unit++) {
+    ostringstream id;
+    id << setw(6) << setfill('0') << unit;
+    write_file(dir + "/todo/" + id.str(), units[unit]); }
+  write_file(dir + "/units", to_string(units.size()) + "\n");
+}
+
+WorkQueue::WorkQueue(const string& init_dir) : dir(init_dir) {
+  if (!exists(dir)) throw std::invalid_argument("WORK QUEUE: no queue in " + dir);
+}
+
+vector<string> WorkQueue::list(const string& sub) const {
+  vector<string> names;
+  DIR* listing = opendir((dir + "/" + sub).c_str());
+  if (listing == NULL) throw std::runtime_error("WORK QUEUE: cannot list " + dir + "/" + sub);
+  struct dirent* entry;
+  while ((entry = readdir(listing)) != NULL) {
+    string name = entry->d_name;
+    if ((name[0] != '.') && (name.find(".tmp") == string::npos)) names.push_back(name); }
+  closedir(listing);
+  sort(names.begin(), names.end());
+  return(names);
+}
+
+string WorkQueue::lease(const string& id, const string& worker) const {
+  return(dir + "/leased/" + id + "@" + worker);
+}
+
+WorkQueue::Claim WorkQueue::claim(const string& worker, string& id, string& text) {
+  if (worker.find_first_of("/@") != string::npos) throw std::invalid_argument("WORK QUEUE: bad worker name " + worker);
+  for (const string& unit : list("todo")) {
+    string from = dir + "/todo/" + unit;
+    // Touch first: rename keeps the mtime, which is the heartbeat.
+    if (utimensat(AT_FDCWD, from.c_str(), NULL, 0) != 0) continue;
+    if (rename(from.c_str(), lease(unit, worker).c_str()) == 0) {
+      id = unit;
+      text = read_file(lease(unit, worker));
+      return(claimed); }}
+  // Leased before todo: reap() and release() move units from leased
+  // to todo, so a unit in neither listing has been completed.
+  if (!list("leased").empty() || !list("todo").empty()) return(wait);
+  return(finished);
+}
+
+bool WorkQueue::beat(const string& id, const string& worker) {
+  return(utimensat(AT_FDCWD, lease(id, worker).c_str(), NULL, 0) == 0);
+}
+
+void WorkQueue::complete(const string& id, const string& worker, const string& results) {
+  write_file(dir + "/done/" + id, results);
+  unlink(lease(id, worker).c_str());
+}
+
+void WorkQueue::release(const string& id, const string& worker) {
+  rename(lease(id, worker).c_str(), (dir + "/todo/" + id).c_str());
+}
+
+int WorkQueue::reap(int timeout) {
+  int requeued = 0;
+  time_t now = time(NULL);
+  for (const string& name : list("leased")) {
+    struct stat status;
+    string path = dir + "/leased/" + name;
+    string id = name.substr(0, name.find('@'));
+    if (access((dir + "/done/" + id).c_str(), F_OK) == 0)
+      unlink(path.c_str());
+    else if ((stat(path.c_str(), &status) == 0) && (now - status.st_mtime >= timeout)
+	     && (rename(path.c_str(), (dir + "/todo/" + id).c_str()) == 0))
+      requeued++; }
+  return(requeued);
+}
+
+int WorkQueue::units() const {
+  return(atoi(read_file(dir + "/units").c_str()));
+}
+
+int WorkQueue::done() const {
+  return(list("done").size());
+}
+
+void WorkQueue::merge(const string& output) const {
+  string merged;
+  for (const string& id : list("done"))
+    merged = merged + read_file(dir + "/done/" + id);
+  write_file(output, merged);
+}
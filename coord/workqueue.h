@@ -0,0 +1,55 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __WORKQUEUE_H
+#define __WORKQUEUE_H
+
+#include <string>
+#include <vector>
+
+// Work units of a sweep, kept in a directory that any number of
+// processes on the host (or on hosts sharing the file system) claim
+// from. Every change is a rename, so the queue survives the death of
+// any process using it, the coordinator's included.
+class WorkQueue {
+public:
+  enum Claim {claimed, wait, finished};
+  const std::string dir;
+  WorkQueue(const std::string&);                 // existing queue directory
+  static bool exists(const std::string&);
+  static void create(const std::string&,         // directory, made here
+		     const std::vector<std::string>&);  // units, in claiming order
+  Claim claim(const std::string&,    // worker
+	      std::string&,          // unit id, set if claimed
+	      std::string&);         // unit text, set if claimed
+  bool  beat(const std::string&,     // unit id
+	     const std::string&);    // worker; false once the lease is lost
+  void  complete(const std::string&,   // unit id
+		 const std::string&,   // worker
+		 const std::string&);  // results
+  void  release(const std::string&,    // unit id
+		const std::string&);   // worker
+  int   reap(int);                     // requeues leases idle this many seconds
+  int   units() const;
+  int   done() const;
+  void  merge(const std::string&) const;  // all results, in unit order, to this file
+
+private:
+  std::vector<std::string> list(const std::string&) const;  // sorted entries of a subdirectory
+  std::string lease(const std::string&, const std::string&) const;
+};
+
+#endif
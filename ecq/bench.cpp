@@ -0,0 +1,123 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <unistd.h>
+#include "disttools.h"
+#include "evolvepool.h"
+#include "bench.h"
+
+using namespace std;
+
+/*
+  Times the ecq kernels over a matrix of delta and sizes:
+
+    evolve       one step of a whole Distribution
+    evolve_rows  ten steps of the tiled kernel on buffers of `rows' rows
+    pdensity     the positive density of a whole Distribution
+    pool_evolve  ten steps of an EvolutionPool, for 1, 2, 4 ... threads
+
+  and evolve again as throughput of independent distributions on 1, 2,
+  4 ... threads. An update is one (beta, h_transition) cell of one
+  step; the bytes are one read and one write of each cell a sweep
+  passes over (one read for pdensity).
+*/
+
+static const double hon_stake = 0.95, f = 0.05;
+
+int main(int argc, char **argv)
+{
+  string output = "bench-ecq.json", baseline;
+  double noise = 0.10, min_seconds = 0.5;
+  bool quick = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "o:c:n:t:q")) != -1)
+    if (option == 'o') output = optarg;
+    else if (option == 'c') baseline = optarg;
+    else if (option == 'n') noise = atof(optarg);
+    else if (option == 't') min_seconds = atof(optarg);
+    else if (option == 'q') quick = true;
+    else {
+      cout << "Usage: " << argv[0] << " [-q] [-t seconds_per_case] [-o results.json] [-c baseline.json [-n noise]]" << endl;
+      cout << "  -q  fewer cases;  -c  flag cases slower than the baseline by more than noise (default 0.10)" << endl;
+      return 1; }
+
+  double hon_prob = 1-pow((1-f),hon_stake);
+  double adv_prob = 1 - pow((1-f),1 - hon_stake);
+  BenchReport report("ecq");
+  report.measure_stream(thread_counts());
+
+  vector<int> deltas = quick ? vector<int>{1, 10} : vector<int>{1, 2, 5, 10, 20};
+  vector<int> sizes = quick ? vector<int>{4096, footprint} : vector<int>{4096, 65536, footprint};
+  double cells = footprint;
+  for (int delta : deltas) {
+    string params = "delta=" + to_string(delta);
+    Distribution* distributions[2] = {new Distribution(delta, identity), new Distribution(delta, zero)};
+    evolve(distributions[0], distributions[1], adv_prob, hon_prob, 50);
+    double updates = cells * (delta + 1);
+
+    report.add({"evolve", params, 1,
+	  time_throughput(1, [&](int) { evolve(distributions[1], distributions[0], adv_prob, hon_prob); }, min_seconds),
+	  updates, 16 * updates});
+    report.add({"pdensity", params, 1,
+	  time_kernel([&] { distributions[0]->pdensity(); }, min_seconds),
+	  updates, 8 * updates});
+
+    for (int rows : sizes) {
+      int stride = delta + 1;
+      vector<double> source(size_t(rows + 2) * stride, 0.0), target(size_t(rows + 2) * stride, 0.0);
+      source[size_t(rows / 2) * stride] = 1.0;
+      EvolveStencil stencil(delta, adv_prob, hon_prob, stride);
+      report.add({"evolve_rows", params + " rows=" + to_string(rows) + " steps=10", 1,
+	    time_kernel([&] { evolve_rows(&source[0], &target[0], stencil, 1, rows, rows + 2, 10); }, min_seconds),
+	    10.0 * rows * stride, 16.0 * rows * stride}); }
+
+    for (int threads : thread_counts(pool_blocks)) {
+      EvolutionPool pool(delta, threads);
+      pool.load(distributions[0]);
+      report.add({"pool_evolve", params + " steps=10", threads,
+	    time_kernel([&] { pool.evolve(adv_prob, hon_prob, 10); }, min_seconds),
+	    10 * updates, 16 * updates}); }
+    delete(distributions[0]);
+    delete(distributions[1]); }
+
+  // Throughput of independent evolutions, as a sweep runs them.
+  for (int threads : thread_counts()) {
+    vector<Distribution*> sources, targets;
+    for (int thread = 0; thread < threads; thread++) {
+      sources.push_back(new Distribution(5, identity));
+      targets.push_back(new Distribution(5, zero)); }
+    report.add({"evolve", "delta=5 independent", threads,
+	  time_throughput(threads, [&](int thread) { evolve(sources[thread], targets[thread], adv_prob, hon_prob); }, min_seconds),
+	  cells * 6, 16 * cells * 6});
+    for (int thread = 0; thread < threads; thread++) {
+      delete(sources[thread]);
+      delete(targets[thread]); }}
+
+  ofstream json(output.c_str());
+  report.write(json);
+  json.close();
+  cout << "Results in " << output << endl;
+  if (!baseline.empty())
+    return(report.compare(baseline, noise, cout) > 0 ? 1 : 0);
+  return 0;
+}
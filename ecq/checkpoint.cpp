@@ -0,0 +1,200 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdexcept>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "checkpoint.h"
+
+using namespace std;
+
+/*
+  Checkpoint file layout, native byte order:
+
+    char     magic[8]        "ECQCKPT1"
+    int32    delta
+    int32    step
+    double   hon_stake
+    double   f
+    int32    low, high       active beta range, high < low if empty
+    double   sites[high-low+1][delta+1]
+    uint64   FNV-1a hash of everything above
+
+  Only rows with some non-zero mass are stored; everything outside
+  [low ... high] is zero. Doubles are stored bit for bit, so a resumed
+  evolution continues exactly where the interrupted one stopped.
+*/
+
+static const char checkpoint_magic[8] = {'E','C','Q','C','K','P','T','1'};
+
+static uint64_t fnv1a(const vector<char>& bytes) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char byte : bytes) {
+    hash = hash ^ (unsigned char) byte;
+    hash = hash * 1099511628211ULL; }
+  return(hash);
+}
+
+template <class T> static void put(vector<char>& bytes, const T& value) {
+  const char* raw = (const char*) &value;
+  bytes.insert(bytes.end(), raw, raw + sizeof(T));
+}
+
+template <class T> static T take(const vector<char>& bytes, size_t& at) {
+  T value;
+  if (at + sizeof(T) > bytes.size()) throw std::runtime_error("CHECKPOINT: file truncated");
+  memcpy(&value, &bytes[at], sizeof(T));
+  at = at + sizeof(T);
+  return(value);
+}
+
+void write_checkpoint(const string& path,
+		      const CheckpointParams& params,
+		      const Distribution* dist) {
+  if (params.delta != dist->delta) throw std::invalid_argument("CHECKPOINT: Delta mismatch");
+  int32_t low = maxsteps + 1, high = -maxsteps - 1;
+  for (int beta = -maxsteps; beta <= maxsteps; beta++)
+    for (int transition = 0; transition <= dist->delta; transition++)
+      if (dist->sites[beta + maxsteps + 1][transition] != 0.0) {
+	low  = min(low, int32_t(beta));
+	high = max(high, int32_t(beta)); }
+  if (high < low) {
+    low = 0;
+    high = -1; }
+  vector<char> bytes(checkpoint_magic, checkpoint_magic + 8);
+  put(bytes, int32_t(params.delta));
+  put(bytes, int32_t(params.step));
+  put(bytes, params.hon_stake);
+  put(bytes, params.f);
+  put(bytes, low);
+  put(bytes, high);
+  for (int beta = low; beta <= high; beta++)
+    for (int transition = 0; transition <= dist->delta; transition++)
+      put(bytes, dist->sites[beta + maxsteps + 1][transition]);
+  put(bytes, fnv1a(bytes));
+
+  string scratch = path + ".tmp";
+  int fd = open(scratch.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) throw std::runtime_error("CHECKPOINT: cannot create " + scratch + ": " + strerror(errno));
+  size_t written = 0;
+  while (written < bytes.size()) {
+    ssize_t chunk = write(fd, &bytes[written], bytes.size() - written);
+    if (chunk < 0) {
+      if (errno == EINTR) continue;
+      close(fd);
+      throw std::runtime_error("CHECKPOINT: write failed: " + string(strerror(errno))); }
+    written = written + chunk; }
+  if ((fsync(fd) != 0) | (close(fd) != 0))
+    throw std::runtime_error("CHECKPOINT: cannot flush " + scratch);
+  if (rename(scratch.c_str(), path.c_str()) != 0)
+    throw std::runtime_error("CHECKPOINT: cannot rename onto " + path + ": " + strerror(errno));
+  string directory = path.substr(0, path.find_last_of('/') + 1);
+  int dirfd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY);
+  if (dirfd >= 0) {
+    fsync(dirfd);
+    close(dirfd); }
+}
+
+bool read_checkpoint(const string& path,
+		     CheckpointParams& params,
+		     Distribution* dist) {
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    if (errno == ENOENT) return(false);
+    throw std::runtime_error("CHECKPOINT: cannot open " + path + ": " + strerror(errno)); }
+  vector<char> bytes;
+  char buffer[65536];
+  size_t chunk;
+  while ((chunk = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    bytes.insert(bytes.end(), buffer, buffer + chunk);
+  bool failed = ferror(file);
+  fclose(file);
+  if (failed) throw std::runtime_error("CHECKPOINT: cannot read " + path);
+
+  if ((bytes.size() < 8) || (memcmp(&bytes[0], checkpoint_magic, 8) != 0))
+    throw std::runtime_error("CHECKPOINT: " + path + " is not an ecq checkpoint");
+  if (bytes.size() < 8 + sizeof(uint64_t)) throw std::runtime_error("CHECKPOINT: file truncated");
+  size_t end = bytes.size() - sizeof(uint64_t);
+  uint64_t stored;
+  memcpy(&stored, &bytes[end], sizeof(stored));
+  bytes.resize(end);
+  if (fnv1a(bytes) != stored) throw std::runtime_error("CHECKPOINT: checksum mismatch in " + path);
+
+  size_t at = 8;
+  params.delta     = take<int32_t>(bytes, at);
+  params.step      = take<int32_t>(bytes, at);
+  params.hon_stake = take<double>(bytes, at);
+  params.f         = take<double>(bytes, at);
+  int32_t low      = take<int32_t>(bytes, at);
+  int32_t high     = take<int32_t>(bytes, at);
+  if (params.delta != dist->delta) throw std::invalid_argument("CHECKPOINT: Delta mismatch");
+  if ((high >= low) && ((low < -maxsteps) || (high > maxsteps)))
+    throw std::runtime_error("CHECKPOINT: margin range exceeds maxsteps");
+  for (int row = 0; row < footprint + 2; row++)
+    for (int transition = 0; transition <= dist->delta; transition++)
+      dist->sites[row][transition] = 0.0;
+  for (int beta = low; beta <= high; beta++)
+    for (int transition = 0; transition <= dist->delta; transition++)
+      dist->sites[beta + maxsteps + 1][transition] = take<double>(bytes, at);
+  if (at != bytes.size()) throw std::runtime_error("CHECKPOINT: trailing bytes in " + path);
+  return(true);
+}
+
+EvolutionHistory* history_for(double hon_stake,
+			      double f,
+			      int delta,
+			      double adv_prob,
+			      double hon_prob,
+			      int spacing,
+			      size_t budget) {
+  return(new EvolutionHistory(delta + 1, spacing, budget,
+			      {{"hon_stake", hon_stake}, {"f", f}, {"delta", double(delta)},
+			       {"adv_prob", adv_prob}, {"hon_prob", hon_prob}}));
+}
+
+void history_keyframe(EvolutionHistory& history,
+		      int step,
+		      const Distribution* dist) {
+  if (history.row_width() != dist->delta + 1) throw std::invalid_argument("HISTORY: Delta mismatch");
+  history.keyframe(step, dist->site_data(), footprint, maxdelta + 1);
+}
+
+Distribution* history_replay(const EvolutionHistory& history,
+			     int step,
+			     int* replayed) {
+  int delta = int(history.param("delta"));
+  if ((delta < 0) || (delta > maxdelta) || (history.row_width() != delta + 1))
+    throw std::runtime_error("HISTORY: not an ecq history");
+  Distribution* keyed = new Distribution(delta,zero);
+  Distribution* result = NULL;
+  try {
+    int from = history.restore(step, &keyed->sites[1][0], footprint, maxdelta + 1);
+    if (replayed != NULL) *replayed = step - from;
+    if (step == from) return(keyed);
+    result = new Distribution(delta,zero);
+    evolve(keyed, result, history.param("adv_prob"), history.param("hon_prob"), step - from); }
+  catch (...) {
+    delete(keyed);
+    delete(result);
+    throw; }
+  delete(keyed);
+  return(result);
+}
@@ -0,0 +1,67 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __CHECKPOINT_H
+#define __CHECKPOINT_H
+
+#include <string>
+#include "disttools.h"
+#include "history.h"
+
+// What a checkpoint records besides the distribution itself.
+struct CheckpointParams {
+  double hon_stake;
+  double f;
+  int    delta;
+  int    step;     // number of evolution steps behind the distribution
+};
+
+// Writes the active beta range of the distribution, the parameters and
+// a checksum to path; the file is written next to path and renamed
+// over it, so a crash leaves either the old or the new checkpoint.
+void write_checkpoint(const std::string&,      // path
+		      const CheckpointParams&,
+		      const Distribution*);
+
+// Returns false if there is no file at path; throws on a damaged or
+// foreign file. The distribution must have the delta of the file.
+bool read_checkpoint(const std::string&,       // path
+		     CheckpointParams&,
+		     Distribution*);
+
+// A history (history.h) of an evolution from hon_stake, f and delta,
+// rows of delta + 1 cells: the parameters its replays need.
+EvolutionHistory* history_for(double,    // hon_stake
+			      double,    // f
+			      int,       // delta
+			      double,    // adversarial prob
+			      double,    // honest prob
+			      int,       // spacing
+			      size_t);   // budget, bytes
+
+// Takes the distribution after step steps as a keyframe of the history.
+void history_keyframe(EvolutionHistory&,
+		      int,                    // step
+		      const Distribution*);
+
+// The distribution after step steps, the keyframe at or before it
+// evolved the rest of the way (replayed, if given, is set to how many
+// steps that took). The caller deletes it.
+Distribution* history_replay(const EvolutionHistory&,
+			     int,              // step
+			     int* replayed = NULL);
+
+#endif
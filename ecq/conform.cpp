@@ -0,0 +1,144 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <sstream>
+#include <unistd.h>
+#include "disttools.h"
+#include "evolvepool.h"
+#include "conform.h"
+
+using namespace std;
+
+/*
+  Replays the runs recorded in results.txt, as ecq-pg prints them,
+  and checks every reported density against the recorded one. The
+  densities there have six significant digits, so the default
+  relative tolerance is 1e-5; the absolute one, 1e-300, lets the
+  subnormal densities far out in the long runs through.
+
+  By default only the first 200 steps of each run are replayed, which
+  takes seconds; -w sets another limit, -f replays the runs whole. -t
+  evolves through an EvolutionPool of that many threads instead of the
+  single-threaded kernel. The evolution conserves mass while the walk
+  stays inside the footprint, so tdensity() is also checked against 1
+  within -m at each reported step.
+*/
+
+struct RecordedRun {
+  double           hon_stake;
+  double           f;
+  int              delta;
+  int              w;
+  map<int, double> density;
+};
+
+// strtod, not stod, which refuses the subnormal densities.
+static double field_after(const string& line, const string& tag) {
+  size_t at = line.find(tag);
+  if (at == string::npos) throw std::invalid_argument("CONFORM: no " + tag + " in " + line);
+  return(strtod(line.c_str() + at + tag.size(), NULL));
+}
+
+static vector<RecordedRun> read_runs(istream& in) {
+  vector<RecordedRun> runs;
+  string line;
+  while (getline(in, line)) {
+    if (line.compare(0, 12, "hon_stake = ") == 0) {
+      runs.push_back(RecordedRun());
+      runs.back().hon_stake = field_after(line, "= "); }
+    else if (runs.empty())
+      continue;
+    else if (line.compare(0, 12, "f         = ") == 0)
+      runs.back().f = field_after(line, "= ");
+    else if (line.compare(0, 12, "delta     = ") == 0)
+      runs.back().delta = int(field_after(line, "= "));
+    else if (line.compare(0, 12, "w         = ") == 0)
+      runs.back().w = int(field_after(line, "= "));
+    else if (line.find("step: ") != string::npos)
+      runs.back().density[int(field_after(line, "step: "))] = field_after(line, "density: "); }
+  return(runs);
+}
+
+int main(int argc, char **argv)
+{
+  string golden = "results.txt";
+  Tolerance tolerance = {1e-5, 1e-300};
+  double mass_allowed = 1e-9;
+  int limit = 200;
+  int threads = 0;
+  int option;
+
+  while ((option = getopt(argc, argv, "g:r:a:m:w:t:f")) != -1)
+    if (option == 'g') golden = optarg;
+    else if (option == 'r') tolerance.relative = atof(optarg);
+    else if (option == 'a') tolerance.absolute = atof(optarg);
+    else if (option == 'm') mass_allowed = atof(optarg);
+    else if (option == 'w') limit = atoi(optarg);
+    else if (option == 't') threads = atoi(optarg);
+    else if (option == 'f') limit = maxsteps;
+    else {
+      cout << "Usage: " << argv[0] << " [-f | -w steps] [-t threads] [-g results] [-r relative] [-a absolute] [-m mass]" << endl;
+      cout << "  replays the first 200 steps of each recorded run, or `steps', or (-f) all of them" << endl;
+      return 1; }
+
+  ifstream in(golden.c_str());
+  if (!in) {
+    cerr << "Cannot read " << golden << endl;
+    return 1; }
+  vector<RecordedRun> runs = read_runs(in);
+  ConformReport report(cout);
+  for (const RecordedRun& run : runs) {
+    if ((run.delta < 1) || (run.delta > maxdelta) || (run.w > maxsteps))
+      throw std::invalid_argument("CONFORM: recorded delta or w out of range");
+    double hon_prob = 1-pow((1-run.f),run.hon_stake);
+    double adv_prob = 1 - pow((1-run.f),1 - run.hon_stake);
+    ostringstream name;
+    name << "hon_stake=" << run.hon_stake << " f=" << run.f << " delta=" << run.delta;
+    Distribution* distributions[2] = {new Distribution(run.delta, identity), new Distribution(run.delta, zero)};
+    EvolutionPool* pool = NULL;
+    if (threads > 0) {
+      pool = new EvolutionPool(run.delta, threads);
+      pool->load(distributions[0]); }
+    int latest = 0, at = 0, checked = 0;
+    for (const pair<const int, double>& recorded : run.density) {
+      if (recorded.first > limit) break;
+      if (pool != NULL)
+	pool->evolve(adv_prob, hon_prob, recorded.first - at);
+      else {
+	evolve(distributions[latest], distributions[1 - latest], adv_prob, hon_prob, recorded.first - at);
+	latest = 1 - latest; }
+      at = recorded.first;
+      string what = name.str() + " step " + to_string(at);
+      report.value(what + " density", recorded.second,
+		   (pool != NULL) ? pool->pdensity() : distributions[latest]->pdensity(), tolerance);
+      report.invariant(what + " mass", 1.0,
+		       (pool != NULL) ? pool->tdensity() : distributions[latest]->tdensity(), mass_allowed);
+      checked++; }
+    cout << name.str() << ": " << checked << " of " << run.density.size() << " recorded densities checked" << endl;
+    delete(pool);
+    delete(distributions[0]);
+    delete(distributions[1]); }
+  return(report.finish((limit >= maxsteps) ? "ecq conformance (full)" : "ecq conformance (to step " + to_string(limit) + ")"));
+}
@@ -17,6 +17,8 @@ limitations under the License.
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <algorithm>
+#include <vector>
 #include "disttools.h"
 
 using namespace std;
@@ -83,6 +85,50 @@ Dist_index* Dist_index::evolve(int adversarial,
 
 // End of distribution index object.
 
+/* The chain of markov.h for ecq, read off Dist_index::evolve so that
+   the transition rule still lives in one place: each move is evolved
+   once from beta = 0. Beta is unbounded; the buffers carry a zero ghost
+   row at each end, which catches what would leave them. The weights
+   are doubles, or Duals for dual_pdensity(). */
+
+template <class Scalar> class EcqChainOf {
+public:
+  EcqChainOf(int init_delta,
+	     Scalar adv_prob,
+	     Scalar hon_prob) : delta(init_delta) {
+    h_transitions[0] = 1- hon_prob;
+    h_transitions[1] = hon_prob;
+    a_transitions[0] = 1- adv_prob;
+    a_transitions[1] = adv_prob;
+  }
+  int    phases() const { return(delta + 1); }
+  int    column(int phase) const { return(phase); }
+  int    honest_outcomes() const { return(2); }
+  Scalar honest_weight(int hon) const { return(h_transitions[hon]); }
+  int    adversarial_outcomes() const { return(2); }
+  Scalar adversarial_weight(int adv) const { return(a_transitions[adv]); }
+  MarkovMove move(int transition, int hon) const {
+    Dist_index source_index(delta,0,transition);
+    Dist_index* target_index = source_index.evolve(0,hon);
+    MarkovMove result = {target_index->get_transition(), target_index->get_internal() - maxsteps};
+    delete(target_index);
+    return(result);
+  }
+  int    barrier() const { return(0); }
+  int    land(int, MarkovMove, int) const { return(-1); }
+  int    first_regular() const { return(-markov_unbounded); }
+  int    last_regular(int) const { return(markov_unbounded); }
+  bool   fold() const { return(true); }
+  int    fixed_rows() const { return(0); }
+  Scalar fixed(const Scalar*, int, int, int) const { return(0.0); }
+private:
+  const int delta;
+  Scalar    h_transitions[2];
+  Scalar    a_transitions[2];
+};
+
+typedef EcqChainOf<double> EcqChain;
+
 //class Distribution;
 
 
@@ -91,7 +137,7 @@ void Distribution::show() const {
   for (int beta=-15; beta < 15; beta++) {
     cout << beta << " : ";
     for (int offset=0; offset <= delta; offset++)
-      cout << sites[beta + maxsteps][offset] << " ";
+      cout << sites[beta + maxsteps + 1][offset] << " ";
     cout << "\n";
   }
 }
@@ -105,37 +151,34 @@ int Distribution::rcheck_transition(int transition) const {
   return(transition); }
 
 double Distribution::get(Dist_index* ind) const {
-  return(sites[rcheck_internal(ind->get_internal())][rcheck_transition(ind->get_transition())]);
+  return(sites[rcheck_internal(ind->get_internal()) + 1][rcheck_transition(ind->get_transition())]);
 }
 
 void Distribution::set(Dist_index* ind, double value) {
-  sites[rcheck_internal(ind->get_internal())][rcheck_transition(ind->get_transition())] = value;
+  sites[rcheck_internal(ind->get_internal()) + 1][rcheck_transition(ind->get_transition())] = value;
+}
+
+const double* Distribution::site_data() const {
+  return(&sites[1][0]);
 }
 
 double Distribution::pdensity() const {
-  double result = 0.0;
-  Dist_index* index;
-  index = new Dist_index(delta,0,0);
-  for(int beta = 0; beta <= maxsteps; beta++)
-    for (int transition = 0; transition <= delta; transition++) {
-      index->set(beta,transition);
-      result = result + get(index);
-    }
-  delete(index);
-  return(result); 
+  return(markov_sum(&sites[0][0], maxdelta+1, maxsteps+1, footprint,
+		    markov_columns(EcqChain(delta,0,0))));
 }
 
 double Distribution::tdensity() const {
-  double result = 0.0;
-  Dist_index* index;
-  index = new Dist_index(delta,0,0);
-  for(int beta = -maxsteps; beta <= maxsteps; beta++)
-    for (int transition = 0; transition <= delta; transition++) {
-      index->set(beta,transition);
-      result = result + get(index);
-    }
-  delete(index);
-  return(result); 
+  return(markov_sum(&sites[0][0], maxdelta+1, 1, footprint,
+		    markov_columns(EcqChain(delta,0,0))));
+}
+
+void Distribution::margin_tail(MarginTail& tail) const {
+  vector<int> columns = markov_columns(EcqChain(delta,0,0));
+  ReduceCells cells = {&sites[0][0], NULL, 0, size_t(maxdelta+1), columns.data(), int(columns.size())};
+  vector<double> row_sums(footprint);
+  for (int row = 1; row <= footprint; row++)
+    row_sums[row - 1] = reduce_value(reduce_row<false>(cells, row));
+  tail.build(&row_sums[0]);
 }
 
 // Initial constructor, "structure" variable determines if zero or distribution at 0.
@@ -148,6 +191,9 @@ Distribution::Distribution(int init_delta,InitializationType structure) : delta(
       index->set(beta,transition);
       set(index,0.0);
     }
+  for(int transition = 0; transition <= maxdelta; transition++) {
+    sites[0][transition] = 0.0;
+    sites[footprint + 1][transition] = 0.0; }
   if (structure==identity) {
     index->set(0, 0);
     set(index,1.0); }
@@ -162,36 +208,127 @@ Distribution::Distribution(const Distribution* orig) : delta(orig->delta) {
     for(int transition = 0; transition <= delta; transition++) {
       index->set(beta,transition);
       set(index,orig->get(index)); }
+  for(int transition = 0; transition <= maxdelta; transition++) {
+    sites[0][transition] = 0.0;
+    sites[footprint + 1][transition] = 0.0; }
   delete(index);
 }
 
+//class MarginTail
+
+MarginTail::MarginTail() : tail(footprint, 0.0) {}
+
+double MarginTail::at(int depth) const {
+  if (depth < -maxsteps) return(0.0);
+  return(tail[min(depth, maxsteps) + maxsteps]);
+}
+
+void MarginTail::build(const double* row_sums) {
+  ReducePartial running = reduce_zero();
+  for (int beta = maxsteps; beta >= -maxsteps; beta--) {
+    reduce_add<true>(running, row_sums[beta + maxsteps]);
+    tail[maxsteps - beta] = reduce_value(running); }
+}
+
+EvolveStencil::EvolveStencil(int    init_delta,
+			     double adv_prob,
+			     double hon_prob,
+			     int    init_stride) : MarkovStencil(EcqChain(init_delta,adv_prob,hon_prob),
+								  init_stride) {
+}
+
+void evolve_rows(const double* source,
+		 double* target,
+		 const EvolveStencil& stencil,
+		 int first,
+		 int last) {
+  markov_evolve_rows(stencil,source,target,first,last);
+}
+
+void evolve_rows(const double* source,
+		 double* target,
+		 const EvolveStencil& stencil,
+		 int first,
+		 int last,
+		 int rows,
+		 int steps) {
+  markov_evolve_rows(stencil,source,target,first,last,rows,steps);
+}
+
 Distribution* evolve(const Distribution* source,
 		     double adv_prob,
 		     double hon_prob) {
-  double h_transitions[2];
-  double a_transitions[2];
   Distribution* result;
-  Dist_index* source_index;
-  Dist_index* target_index;
-  
-  h_transitions[0] = 1- hon_prob;
-  h_transitions[1] = hon_prob;
-  a_transitions[0] = 1- adv_prob;
-  a_transitions[1] = adv_prob;
-  source_index = new Dist_index(source->delta,0,0);
   result = new Distribution(source->delta,zero);
-  for (int hon : {0, 1}) // Honest move
-    for (int adv : {0, 1})  // Adversarial move
-      for (int beta=-(maxsteps-hon); beta <= (maxsteps-adv); beta++)
-	for (int transition=0; transition <= source->delta; transition++) {
-	  source_index->set(beta,transition);
-	  target_index = source_index->evolve(adv,hon);
-	  result->set(target_index,result->get(target_index)
-		      + (source->get(source_index)
-			 * a_transitions[adv]
-			 * h_transitions[hon])); 
-	  delete(target_index);	};
-  delete(source_index);
+  evolve(source,result,adv_prob,hon_prob);
   return(result);
 }
 
+void evolve(const Distribution* source,
+	    Distribution* target,
+	    double adv_prob,
+	    double hon_prob) {
+  if (target->delta != source->delta) throw std::invalid_argument("EVOLVE: Delta mismatch");
+  EvolveStencil stencil(source->delta,adv_prob,hon_prob,maxdelta+1);
+  evolve_rows(&source->sites[0][0],&target->sites[0][0],stencil,1,footprint);
+}
+
+void evolve(const Distribution* source,
+	    Distribution* target,
+	    double adv_prob,
+	    double hon_prob,
+	    int steps) {
+  if (target->delta != source->delta) throw std::invalid_argument("EVOLVE: Delta mismatch");
+  if (steps < 1) throw std::invalid_argument("EVOLVE: need at least one step");
+  EvolveStencil stencil(source->delta,adv_prob,hon_prob,maxdelta+1);
+  evolve_rows(&source->sites[0][0],&target->sites[0][0],stencil,1,footprint,
+	      footprint+2,steps);
+}
+
+static const int dualsteps = 64;  // steps per multi-step sweep of dual_pdensity()
+
+Dual dual_pdensity(int delta,
+		   Dual adv_prob,
+		   Dual hon_prob,
+		   int steps) {
+  if ((delta < 0) || (delta > maxdelta)) throw std::invalid_argument("DUAL PDENSITY: Delta index out of range");
+  if ((steps < 0) || (steps > maxsteps)) throw std::invalid_argument("DUAL PDENSITY: steps out of range");
+  const int stride = delta + 1;
+  const int rows = footprint + 2;
+  MarkovStencilOf<Dual> stencil(EcqChainOf<Dual>(delta, adv_prob, hon_prob), stride);
+  vector<Dual> buffers[2];
+  buffers[0].resize(size_t(rows) * stride);
+  buffers[1].resize(size_t(rows) * stride);
+  buffers[0][size_t(maxsteps + 1) * stride] = 1.0;
+  // Mass from beta = 0 moves at most reach rows a step, so only that
+  // band is swept; the rows beyond it stay zero in both buffers.
+  int current = 0;
+  for (int done = 0; done < steps; done = done + dualsteps) {
+    int chunk = min(dualsteps, steps - done);
+    int band  = stencil.reach * (done + chunk);
+    markov_evolve_rows(stencil, &buffers[current][0], &buffers[1 - current][0],
+		       max(maxsteps + 1 - band, 1), min(maxsteps + 1 + band, footprint), rows, chunk);
+    current = 1 - current; }
+  // Read as doubles: a row is 2 stride of them, value then slope.
+  vector<int> values, slopes;
+  for (int transition = 0; transition <= delta; transition++) {
+    values.push_back(2 * transition);
+    slopes.push_back(2 * transition + 1); }
+  const double* cells = &buffers[current][0].value;
+  return(Dual(markov_sum(cells, 2 * stride, maxsteps + 1, footprint, values),
+	      markov_sum(cells, 2 * stride, maxsteps + 1, footprint, slopes)));
+}
+
+DensityBounds pdensity_bounds(int delta,
+			      double adv_prob,
+			      double hon_prob,
+			      int steps) {
+  if ((delta < 0) || (delta > maxdelta)) throw std::invalid_argument("PDENSITY BOUNDS: Delta index out of range");
+  BoundWalk walk(EcqChain(delta,adv_prob,hon_prob));
+  BoundStart start = [&walk](double) {
+    vector<double> result(walk.phases, -HUGE_VAL);
+    result[0] = 0.0;  // all at beta = 0, transition 0
+    return(result); };
+  DensityBounds result = {1 - walk.lower_tail(start, -1, steps), walk.upper_tail(start, 0, steps)};
+  return(result);
+}
@@ -17,11 +17,18 @@ limitations under the License.
 #ifndef __DISTCLASS_H
 #define __DISTCLASS_H
 
+#include <string>
+#include <vector>
+#include "markov.h"
+#include "dual.h"
+#include "bound.h"
+
 enum InitializationType {zero, identity};
 
 const int maxsteps = 50000;
 const int footprint = 2 * maxsteps + 1;
 const int maxdelta = 20;
+const int blockrows = reduce_blockrows;  // rows per block of the parallel evolution and reductions
 
 class Dist_index {
 public:
@@ -40,6 +47,56 @@ private:
   int  h_transition;  // in range [0 ... delta]
 };
 
+// Gather form of a single evolution step, compiled by the engine in
+// markov.h from the transition rule of Dist_index. Each target
+// (beta, transition) collects from a few source cells at fixed offsets
+// in a row-major buffer of the given row stride; the weights already
+// fold together the honest and adversarial probabilities of every
+// move that lands there.
+struct EvolveStencil : public MarkovStencil {
+  EvolveStencil(int,      // delta
+		double,   // adversarial prob
+		double,   // honest prob
+		int);     // row stride of the buffers it is applied to
+};
+
+// Applies the stencil to rows [first ... last] of a row-major buffer;
+// rows first-1 and last+1 of the source must be readable.
+void evolve_rows(const double*,         // source rows
+		 double*,               // target rows
+		 const EvolveStencil&,
+		 int,                   // first row
+		 int);                  // last row
+
+// Advances rows [first ... last] by several steps in one sweep over the
+// buffers, tile by tile in cache. Rows 0 and rows-1 are ghost rows; the
+// source must be readable over the whole [0 ... rows-1].
+void evolve_rows(const double*,         // source rows
+		 double*,               // target rows
+		 const EvolveStencil&,
+		 int,                   // first row
+		 int,                   // last row
+		 int,                   // rows in the buffers, ghosts included
+		 int);                  // steps
+
+/* The tail curve of a distribution: P(beta >= -m) for every depth m
+   in [-maxsteps ... maxsteps], the settlement probabilities of all
+   confirmation depths at once. It is built in one read of the rows,
+   summed from the top of the range down, compensated, so each at() is
+   a lookup. at(0) is pdensity() to rounding, not to the bit: the rows
+   are added in another order than reduce.h's tree. */
+class MarginTail {
+public:
+  MarginTail();
+  double at(int) const;          // depth m: 0 below -maxsteps, the total above maxsteps
+  void   build(const double*);   // row sums, footprint of them from beta = -maxsteps
+private:
+  std::vector<double> tail;      // tail[m + maxsteps]
+};
+
+struct CheckpointParams;
+class EvolutionHistory;
+
 class Distribution {
   
 public:
@@ -50,12 +107,36 @@ public:
   void show() const;
   double pdensity() const;
   double tdensity() const;
+  void   margin_tail(MarginTail&) const;
+  const double* site_data() const;  // sites from beta = -maxsteps, row-major, read-only
   friend Distribution* evolve(const Distribution*,
 			      double,  // adversarial Poisson param
 			      double); // honest prob
+  friend void evolve(const Distribution*,  // source
+		     Distribution*,        // target, overwritten
+		     double,  // adversarial Poisson param
+		     double); // honest prob
+  friend void evolve(const Distribution*,  // source
+		     Distribution*,        // target, overwritten
+		     double,  // adversarial Poisson param
+		     double,  // honest prob
+		     int);    // steps
+  friend void write_checkpoint(const std::string&,
+			       const CheckpointParams&,
+			       const Distribution*);
+  friend bool read_checkpoint(const std::string&,
+			      CheckpointParams&,
+			      Distribution*);
+  friend Distribution* history_replay(const EvolutionHistory&,
+				      int,
+				      int*);
+  friend class EvolutionPool;
+  friend class LaggedDistribution;
   
 private:
-  double sites[footprint][maxdelta+1];
+  // One zero ghost row on either side of [-maxsteps ... maxsteps], so
+  // the evolution kernel can read beta-1 and beta+1 unchecked.
+  double sites[footprint + 2][maxdelta+1];
   int    rcheck_internal(int) const;
   int    rcheck_transition(int) const;
   // accessor functions
@@ -63,4 +144,20 @@ private:
   void   set(Dist_index*, double);  // index object, value
 };
 
+// pdensity() after steps steps from the identity, with its derivative:
+// the probabilities carry the derivatives, by the chain rule, of the
+// parameter it is taken along (ecq-sweep -i).
+Dual dual_pdensity(int,    // delta
+		   Dual,   // adversarial prob
+		   Dual,   // honest prob
+		   int);   // steps
+
+// Bounds on pdensity() after steps steps from the identity, from the
+// tails of the margin walk (bound.h): P(beta >= 0) at most the upper
+// tail, at least 1 - P(beta <= -1).
+DensityBounds pdensity_bounds(int,     // delta
+			      double,  // adversarial prob
+			      double,  // honest prob
+			      int);    // steps
+
 #endif
@@ -0,0 +1,171 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include "disttools.h"
+#include "transport.h"
+#include "slabdist.h"
+
+using namespace std;
+
+// Same parameters and output as ecq-pg, with the distribution split by
+// beta over several processes. Without -R the processes are forked
+// here; with -R each rank is started by hand, on any host in -H.
+
+struct Run {
+  double hon_stake, f;
+  int    delta, w, margin, halo;
+};
+
+static int run_rank(Transport* transport, const Run& run) {
+  double hon_prob = 1-pow((1-run.f),run.hon_stake);
+  double adv_stake = 1 - run.hon_stake;
+  double adv_prob = 1 - pow((1-run.f),adv_stake);
+  bool speaker = (transport->rank == 0);
+  if (speaker) {
+    cout << "hon_stake = " << run.hon_stake << endl;
+    cout << "f         = " << run.f << endl;
+    cout << "delta     = " << run.delta << endl;
+    cout << "w         = " << run.w << endl;
+    cout << "Probability of honest success: " <<  hon_prob << "\n";
+    cout << "Effective rate of honest advancement: " << 1/(run.delta-1+1/hon_prob) << "\n";
+    cout << "Adversarial stake ratio: " << adv_stake << "\n";
+    cout << "Adversarial success probability: " <<  adv_prob << "\n";
+    cout << "...equal to expected rate of adversarial advancement: " << adv_prob << "\n";
+    cout << "Evolution beginning...\n"; }
+  SlabDistribution slab(transport, run.delta, run.margin, run.halo, identity);
+  for (int step = 1; step <= run.w; step++) {
+    int ahead = (step % 10 == 0) ? 0 : min(10 - step % 10, run.w - step);
+    while (ahead + 1 > run.halo) {
+      slab.evolve(adv_prob, hon_prob, run.halo);
+      step = step + run.halo;
+      ahead = ahead - run.halo; }
+    slab.evolve(adv_prob, hon_prob, ahead + 1);
+    step = step + ahead;
+    if (step % 10 == 0) {
+      double new_density = slab.pdensity();
+      if (speaker)
+	cout << "("
+	     << "adv. stake: " << adv_stake << ", "
+	     << "f: " << run.f << ", "
+	     << "delta: " << run.delta << ", "
+	     << "step: " << step << ", "
+	     << "density: " << new_density << ")\n" << std::flush; }}
+  if (speaker)
+    cout <<  "========================================================================================================================" << endl;
+  return 0;
+}
+
+static vector<string> split(const string& list) {
+  vector<string> result;
+  size_t start = 0, comma;
+  while ((comma = list.find(',', start)) != string::npos) {
+    result.push_back(list.substr(start, comma - start));
+    start = comma + 1; }
+  result.push_back(list.substr(start));
+  return(result);
+}
+
+int main(int argc, char **argv)
+{
+  Run run;
+  int processes = 1;
+  int rank = -1;
+  int port = 47000;
+  string medium = "shm";
+  vector<string> hosts;
+  int margin = 0;
+  int option;
+
+  run.halo = 10;
+  while ((option = getopt(argc, argv, "n:T:p:H:R:k:m:")) != -1)
+    if (option == 'n') processes = atoi(optarg);
+    else if (option == 'T') medium = optarg;
+    else if (option == 'p') port = atoi(optarg);
+    else if (option == 'H') hosts = split(optarg);
+    else if (option == 'R') rank = atoi(optarg);
+    else if (option == 'k') run.halo = atoi(optarg);
+    else if (option == 'm') margin = atoi(optarg);
+    else {
+      argc = 0;
+      break; }
+  if ((argc - optind < 4) || ((rank >= 0) && hosts.empty())
+      || ((medium != "shm") && (medium != "tcp"))) {
+    cout << "Usage: " << argv[0] << " [-n processes] [-T shm|tcp] [-p base_port] [-k halo] [-m margin]" << endl
+	 << "       [-R rank -H host:port,...] <hon_stake * 100> <f * 100> <delta> <walk_length>" << endl;
+    cout << "  -n  fork this many ranks on this host (default 1), talking over -T (default shm)" << endl;
+    cout << "  -R  run only this rank, talking over TCP to the ranks listed in -H" << endl;
+    cout << "  -k  rows swapped with each neighbour, and steps between swaps (default 10)" << endl;
+    cout << "  -m  beta range [-margin ... margin] (default: enough for walk_length and the ranks)" << endl;
+    return 0;
+  }
+  run.hon_stake = atoi(argv[optind])/100.0;
+  run.f = atoi(argv[optind+1])/100.0;
+  run.delta = atoi(argv[optind+2]);
+  run.w = atoi(argv[optind+3]);
+  if (rank >= 0) processes = hosts.size();
+  // Every rank needs a whole block of rows, at least as wide as the halo.
+  run.margin = max(margin > 0 ? margin : run.w, (processes * blockrows) / 2 + 1);
+
+  if (rank >= 0) {
+    TcpTransport transport(rank, hosts);
+    return(run_rank(&transport, run)); }
+
+  string segment = "/ecq-dd-" + to_string(getpid());
+  if (medium == "shm")
+    ShmTransport::create(segment, processes);
+  else
+    for (int peer = 0; peer < processes; peer++)
+      hosts.push_back("127.0.0.1:" + to_string(port + peer));
+  cout << std::flush;
+  vector<pid_t> children;
+  for (int child = 0; child < processes; child++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      int status = 1;
+      try {
+	if (medium == "shm") {
+	  ShmTransport transport(segment, child, processes);
+	  status = run_rank(&transport, run); }
+	else {
+	  TcpTransport transport(child, hosts);
+	  status = run_rank(&transport, run); }}
+      catch (std::exception& failure) {
+	cerr << "rank " << child << ": " << failure.what() << endl; }
+      cout << std::flush;
+      _exit(status); }
+    children.push_back(pid); }
+  // If one rank fails the others would wait for it forever.
+  int result = 0;
+  for (int left = processes; left > 0; left--) {
+    int status;
+    pid_t done = wait(&status);
+    if ((done > 0) && !(WIFEXITED(status) && (WEXITSTATUS(status) == 0)) && (result == 0)) {
+      result = 1;
+      for (pid_t pid : children)
+	if (pid != done) kill(pid, SIGTERM); }}
+  if (medium == "shm")
+    ShmTransport::destroy(segment);
+  return(result);
+}
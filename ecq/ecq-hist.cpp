@@ -0,0 +1,134 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <unistd.h>
+#include "disttools.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+/*
+  Looks at the distributions of a finished ecq-pg run again, from the
+  history it kept (ecq-pg -y): for each step asked for, the density,
+  with -m the tail P(beta >= -m) at the depths listed, and with -a the
+  active rows themselves, "beta : cells" by h_transition. Each step is
+  replayed from the keyframe before it, at most the history's spacing
+  less one evolution steps; a density the run recorded at the step is
+  checked against the replayed one.
+*/
+
+// "0,6,12" or "0:100,200" (ranges inclusive), as ecq-pg -m.
+static vector<int> parse_depths(const string& list) {
+  vector<int> result;
+  stringstream items(list);
+  string item;
+  while (getline(items, item, ',')) {
+    size_t colon = item.find(':');
+    int low = atoi(item.substr(0, colon).c_str());
+    int high = (colon == string::npos) ? low : atoi(item.substr(colon + 1).c_str());
+    if ((low > high) || (low < -maxsteps) || (high > maxsteps))
+      throw std::invalid_argument("ECQ-HIST: depths " + item + " out of range");
+    for (int depth = low; depth <= high; depth++)
+      result.push_back(depth); }
+  return(result);
+}
+
+int main(int argc, char **argv)
+{
+  vector<int> depths;
+  bool rows = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "m:a")) != -1)
+    if (option == 'm') depths = parse_depths(optarg);
+    else if (option == 'a') rows = true;
+    else {
+      argc = 0;
+      break; }
+  if (argc - optind < 2) {
+    cout << "Usage: " << argv[0] << " [-m depths] [-a] <history> <step> ..." << endl;
+    cout << "  -m  with each density, P(beta >= -m) for the depths m listed, as 0,6,12 or 0:100" << endl;
+    cout << "  -a  with each density, the rows of the distribution that hold some mass" << endl;
+    return 0;
+  }
+
+  EvolutionHistory history(argv[optind]);
+  double f = history.param("f");
+  int delta = int(history.param("delta"));
+  cout << "hon_stake = " << history.param("hon_stake") << endl;
+  cout << "f         = " << f << endl;
+  cout << "delta     = " << delta << endl;
+  cout << "steps " << history.first() << " to " << history.latest() << ", "
+       << history.keyframes() << " keyframes every " << history.every() << " steps" << endl;
+
+  double adv_stake = 1 - history.param("hon_stake");
+  MarginTail tail;
+  int failed = 0;
+  for (int arg = optind + 1; arg < argc; arg++) {
+    int step = atoi(argv[arg]);
+    int replayed;
+    Distribution* dist;
+    try {
+      dist = history_replay(history, step, &replayed); }
+    catch (std::invalid_argument& failure) {
+      cout << failure.what() << endl;
+      failed++;
+      continue; }
+    double density = dist->pdensity();
+    double recorded = history.density(step);
+    cout << "("
+	 << "adv. stake: " << adv_stake << ", "
+	 << "f: " << f << ", "
+	 << "delta: " << delta << ", "
+	 << "step: " << step << ", "
+	 << "density: " << density << ", "
+	 << "replayed: " << replayed << ")\n";
+    if (!std::isnan(recorded) && (recorded != density)) {
+      cout << setprecision(17) << "Step " << step << " was recorded with density " << recorded
+	   << ", replayed as " << density << setprecision(6) << "\n";
+      failed++; }
+    if (!depths.empty()) {
+      dist->margin_tail(tail);
+      for (int depth : depths)
+	cout << "("
+	     << "step: " << step << ", "
+	     << "depth: " << depth << ", "
+	     << "density: " << tail.at(depth) << ")\n"; }
+    if (rows) {
+      const double* sites = dist->site_data();
+      cout << setprecision(17);
+      for (int beta = -maxsteps; beta <= maxsteps; beta++) {
+	const double* row = sites + size_t(beta + maxsteps) * (maxdelta + 1);
+	bool held = false;
+	for (int transition = 0; transition <= delta; transition++)
+	  held = held || (row[transition] != 0.0);
+	if (!held) continue;
+	cout << beta << " :";
+	for (int transition = 0; transition <= delta; transition++)
+	  cout << " " << row[transition];
+	cout << "\n"; }
+      cout << setprecision(6); }
+    delete(dist); }
+  return(failed > 0 ? 2 : 0);
+}
@@ -18,10 +18,38 @@ limitations under the License.
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <limits>
+#include <unistd.h>
 #include "disttools.h"
+#include "evolvepool.h"
+#include "laggeddist.h"
+#include "checkpoint.h"
+#include "streamdist.h"
+#include "sink.h"
+#define PROBE_ALLOCATIONS
+#include "probe.h"
 
 using namespace std;
 
+// "0,6,12" or "0:100,200" (ranges inclusive): the depths of -m.
+static vector<int> parse_depths(const string& list) {
+  vector<int> result;
+  stringstream items(list);
+  string item;
+  while (getline(items, item, ',')) {
+    size_t colon = item.find(':');
+    int low = atoi(item.substr(0, colon).c_str());
+    int high = (colon == string::npos) ? low : atoi(item.substr(colon + 1).c_str());
+    if ((low > high) || (low < -maxsteps) || (high > maxsteps))
+      throw std::invalid_argument("ECQ-PG: depths " + item + " out of range");
+    for (int depth = low; depth <= high; depth++)
+      result.push_back(depth); }
+  return(result);
+}
+
 int main(int argc, char **argv)
 {
   double hon_stake;
@@ -31,22 +59,89 @@ int main(int argc, char **argv)
   int delta;
   double f;
   int w, step;
+  int threads = 0;
+  int latest = 0;
   Distribution* distributions[2];
+  bool lag = false;
+  EvolutionPool* pool = NULL;
+  LaggedDistribution* lagged = NULL;
+  string checkpoint;
+  int checkpoint_every = 1000;
+  int checkpoint_last;
+  bool resume = false;
+  string state_dir;
+  MappedDistribution* streams[2] = {NULL, NULL};
+  SinkFormat format = sink_human;
+  string output;
+  int every = 10;
+  double ratio = 0;
+  vector<int> depths;
+  MarginTail* tail = NULL;
+  string history_path;
+  int history_every = 1000;
+  double history_megabytes = 256;
+  EvolutionHistory* history = NULL;
+  int option;
   
-  if (argc < 5) {
-    cout << "Usage: " << argv[0] << " <hon_stake * 100> <f * 100> <delta> <walk_length>" << endl;
+  while ((option = getopt(argc, argv, "t:lc:k:rs:O:o:e:D:m:y:K:B:")) != -1)
+    if (option == 't') threads = atoi(optarg);
+    else if (option == 'l') lag = true;
+    else if (option == 'c') checkpoint = optarg;
+    else if (option == 'k') checkpoint_every = atoi(optarg);
+    else if (option == 'r') resume = true;
+    else if (option == 's') state_dir = optarg;
+    else if (option == 'O') format = sink_format(optarg);
+    else if (option == 'o') output = optarg;
+    else if (option == 'e') every = max(1, atoi(optarg));
+    else if (option == 'D') ratio = atof(optarg);
+    else if (option == 'm') depths = parse_depths(optarg);
+    else if (option == 'y') history_path = optarg;
+    else if (option == 'K') history_every = max(1, atoi(optarg));
+    else if (option == 'B') history_megabytes = atof(optarg);
+    else {
+      argc = 0;
+      break; }
+  if ((argc - optind < 4) || (resume && checkpoint.empty())) {
+    cout << "Usage: " << argv[0] << " [-t threads | -l | -s state_dir] [-c checkpoint [-k every] [-r]] [-O format] [-o output] [-e every] [-D ratio] [-m depths] [-y history [-K every] [-B megabytes]] <hon_stake * 100> <f * 100> <delta> <walk_length>" << endl;
+    cout << "  -c  write the distribution to checkpoint every `every' steps (default 1000) and at the end" << endl;
+    cout << "  -r  continue from the checkpoint if it exists; walk_length may exceed the checkpointed one" << endl;
+    cout << "  -s  keep the distributions in memory-mapped files in state_dir, with margin walk_length;" << endl;
+    cout << "      walk_length is then not limited by " << maxsteps << endl;
+    cout << "  -O  human (default), csv or binary densities, to -o output (default standard output)," << endl;
+    cout << "      every -e steps (default 10), only at steps -D ratio apart if ratio > 1" << endl;
+    cout << "  -m  with each density, P(beta >= -m) for the depths m listed, as 0,6,12 or 0:100" << endl;
+    cout << "  -y  keep the distribution every `every' steps (default 1000), within megabytes (default 256)," << endl;
+    cout << "      spacing them out as needed, and write them to history at the end, for ecq-hist" << endl;
     return 0;
   }
+  if (!state_dir.empty() && ((threads > 0) || lag || !checkpoint.empty())) {
+    cout << "Streaming (-s) runs on its own, without -t, -l or -c." << endl;
+    return 1;
+  }
+  if (!depths.empty() && (!state_dir.empty() || lag)) {
+    cout << "Depths (-m) are read off a plain or pooled (-t) evolution, without -s or -l." << endl;
+    return 1;
+  }
+  if (!history_path.empty() && (!state_dir.empty() || lag)) {
+    cout << "A history (-y) is kept of a plain or pooled (-t) evolution, without -s or -l." << endl;
+    return 1;
+  }
+  if (lag && !checkpoint.empty()) {
+    cout << "Checkpoints hold a plain distribution and cannot resume a lagged (-l) evolution." << endl;
+    return 1;
+  }
 
-  hon_stake = atoi(argv[1])/100.0;
-  f = atoi(argv[2])/100.0;
-  delta = atoi(argv[3]);
-  w = atoi(argv[4]);
+  // With machine-readable results on standard output, the rest goes to stderr.
+  ostream& talk = ((format != sink_human) && (output.empty() || (output == "-"))) ? cerr : cout;
+  hon_stake = atoi(argv[optind])/100.0;
+  f = atoi(argv[optind+1])/100.0;
+  delta = atoi(argv[optind+2]);
+  w = atoi(argv[optind+3]);
   
-  cout << "hon_stake = " << hon_stake << endl;
-  cout << "f         = " << f << endl;
-  cout << "delta     = " << delta << endl;
-  cout << "w         = " << w << endl;
+  talk << "hon_stake = " << hon_stake << endl;
+  talk << "f         = " << f << endl;
+  talk << "delta     = " << delta << endl;
+  talk << "w         = " << w << endl;
   
   //cout << "Enter honest stake ratio: (between 0 and 1): ";
   //cin  >> hon_stake;
@@ -56,38 +151,150 @@ int main(int argc, char **argv)
   //cin  >> delta;
   
   hon_prob = 1-pow((1-f),hon_stake);
-  cout << "Probability of honest success: " <<  hon_prob << "\n"; 
-  cout << "Effective rate of honest advancement: " << 1/(delta-1+1/hon_prob) << "\n";
+  talk << "Probability of honest success: " <<  hon_prob << "\n"; 
+  talk << "Effective rate of honest advancement: " << 1/(delta-1+1/hon_prob) << "\n";
   
   adv_stake = 1 - hon_stake;
   adv_prob = 1 - pow((1-f),adv_stake);
-  cout << "Adversarial stake ratio: " << adv_stake << "\n";
-  cout << "Adversarial success probability: " <<  adv_prob << "\n";
-  cout << "...equal to expected rate of adversarial advancement: " << adv_prob << "\n";
+  talk << "Adversarial stake ratio: " << adv_stake << "\n";
+  talk << "Adversarial success probability: " <<  adv_prob << "\n";
+  talk << "...equal to expected rate of adversarial advancement: " << adv_prob << "\n";
   
 
   //cout << "Enter number of steps of evolution (no more than " << maxsteps << "): ";
   //cin  >> w;
   
-  distributions[0] = new Distribution(delta,identity);
-  cout << "Evolution beginning...\n";
-  for (step = 1; step <= w; step++) {
-    distributions[step % 2] = evolve(distributions[(step - 1) % 2],
-				     adv_prob, hon_prob);
-    delete(distributions[(step - 1) % 2]);
-    if (step % 10 == 0) {
-      double new_density = distributions[step % 2]->pdensity();
+  if (!state_dir.empty()) {
+    streams[0] = new MappedDistribution(state_dir + "/ecq-0.state", delta, max(w, 1), identity);
+    streams[1] = new MappedDistribution(state_dir + "/ecq-1.state", delta, max(w, 1), zero);
+    distributions[0] = distributions[1] = NULL; }
+  else {
+    distributions[0] = new Distribution(delta,identity);
+    distributions[1] = new Distribution(delta,zero); }
+  checkpoint_last = 0;
+  if (resume) {
+    CheckpointParams saved;
+    bool found;
+    try {
+      found = read_checkpoint(checkpoint, saved, distributions[0]); }
+    catch (std::exception& failure) {
+      // A damaged file, or one of another Delta.
+      talk << "Cannot resume from " << checkpoint << ": " << failure.what() << "\n";
+      return 1; }
+    if (found) {
+      if ((saved.hon_stake != hon_stake) || (saved.f != f)) {
+	talk << "Checkpoint " << checkpoint << " was written for hon_stake = " << saved.hon_stake
+	     << ", f = " << saved.f << "\n";
+	return 1; }
+      if (saved.step > w) {
+	talk << "Checkpoint " << checkpoint << " is already at step " << saved.step << "\n";
+	return 1; }
+      checkpoint_last = saved.step;
+      talk << "Resuming from step " << saved.step << "\n"; }}
+  if (!history_path.empty()) {
+    history = history_for(hon_stake, f, delta, adv_prob, hon_prob, history_every,
+			  size_t(history_megabytes * 1024 * 1024));
+    history_keyframe(*history, checkpoint_last, distributions[0]); }
+  if (threads > 0) {
+    pool = new EvolutionPool(delta,threads);
+    pool->load(distributions[0]); }
+  else if (lag && (delta >= 2))  // below Delta = 2 there is no countdown
+    lagged = new LaggedDistribution(distributions[0], adv_prob, hon_prob);
+  probe_start("ecq-pg");
+  double cells = double((streams[0] != NULL) ? 2 * streams[0]->margin + 1 : footprint) * (delta + 1);
+  ResultSink sink(format, output,
+		  {{"hon_stake", hon_stake}, {"f", f}, {"delta", double(delta)}},
+		  [&](ostream& out, const SinkRecord& record) {
+		    out << "("
+			<< "adv. stake: " << adv_stake << ", "
+			<< "f: " << f << ", "
+			<< "delta: " << delta << ", "
+			<< "step: " << record.step << ", ";
+		    if (record.kind == 'm')
+		      out << "depth: " << record.index << ", ";
+		    out << "density: " << record.value << ")\n";
+		  },
+		  every, ratio, depths.empty() ? "" : "m");
+  // Depth records come with the densities, all of a step at once.
+  sink.pace('m', 1, 0);
+  if (!depths.empty()) tail = new MarginTail();
+  talk << "Evolution beginning...\n";
+  for (step = checkpoint_last + 1; step <= w; step++) {
+    // Each pass runs up to the next reported step in a single sweep.
+    int ahead = (step % every == 0) ? 0 : min(every - step % every, w - step);
+    if (history != NULL) ahead = min(ahead, history->next(step) - step);
+    {
+      ProbePhase phase("evolve", cells * (ahead + 1));
+      if (streams[0] != NULL) {
+	evolve(streams[latest], streams[1 - latest], adv_prob, hon_prob, ahead + 1);
+	latest = 1 - latest; }
+      else if (lagged != NULL)
+	lagged->evolve(ahead + 1);
+      else if (pool != NULL)
+	pool->evolve(adv_prob, hon_prob, ahead + 1);
+      else {
+	evolve(distributions[latest], distributions[1 - latest],
+	       adv_prob, hon_prob, ahead + 1);
+	latest = 1 - latest; }
+    }
+    step = step + ahead;
+    double new_density = std::numeric_limits<double>::quiet_NaN();
+    if (sink.wants('d', step)) {
+      {
+	ProbePhase phase("pdensity", cells);
+	new_density = (streams[0] != NULL) ? streams[latest]->pdensity()
+	  : (pool != NULL) ? pool->pdensity()
+	  : (lagged != NULL) ? lagged->pdensity()
+	  : distributions[latest]->pdensity();
+      }
+      probe_trace("density", step, new_density);
       //    double new_density_t = distributions[step % 2]->tdensity();
-      cout << "(" 
-        << "adv. stake: " << adv_stake << ", " 
-        << "f: " << f << ", " 
-        << "delta: " << delta << ", " 
-        << "step: " << step << ", " 
-        << "density: " << new_density << ")\n" << std::flush;
+      sink.put('d', step, new_density);
+      if (tail != NULL) {
+	{
+	  ProbePhase phase("margin_tail", cells);
+	  if (pool != NULL) pool->margin_tail(*tail);
+	  else distributions[latest]->margin_tail(*tail);
+	}
+	for (int depth : depths)
+	  sink.put('m', step, tail->at(depth), depth); }
     }
+    if (history != NULL) {
+      history->note(step, new_density);
+      if (history->due(step)) {
+	ProbePhase phase("keyframe");
+	if (pool != NULL) {
+	  pool->store(distributions[1 - latest]);
+	  history_keyframe(*history, step, distributions[1 - latest]); }
+	else
+	  history_keyframe(*history, step, distributions[latest]); }}
+    if (!checkpoint.empty() && ((step - checkpoint_last >= checkpoint_every) || (step == w))) {
+      ProbePhase phase("checkpoint");
+      CheckpointParams params = {hon_stake, f, delta, step};
+      if (pool != NULL) {
+	pool->store(distributions[1 - latest]);
+	write_checkpoint(checkpoint, params, distributions[1 - latest]); }
+      else
+	write_checkpoint(checkpoint, params, distributions[latest]);
+      checkpoint_last = step; }
   }
-  delete(distributions[w % 2]);
-  cout <<  "========================================================================================================================" << endl;
+  if (history != NULL) {
+    history->save(history_path);
+    talk << "History in " << history_path << ": " << history->keyframes() << " keyframes every "
+	 << history->every() << " steps, " << double(history->bytes()) / (1024 * 1024) << " MB\n";
+    delete(history); }
+  delete(tail);
+  delete(pool);
+  delete(lagged);
+  if (streams[0] != NULL) {
+    delete(streams[0]);
+    delete(streams[1]);
+    unlink((state_dir + "/ecq-0.state").c_str());
+    unlink((state_dir + "/ecq-1.state").c_str()); }
+  delete(distributions[0]);
+  delete(distributions[1]);
+  sink.drain();
+  talk <<  "========================================================================================================================" << endl;
   return 0;
 }
 
@@ -0,0 +1,378 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <unistd.h>
+#include "disttools.h"
+#include "sweep.h"
+#include "inverse.h"
+#include "surrogate.h"
+
+using namespace std;
+
+/*
+  Sweeps ecq-pg over a grid of (hon_stake, f, delta, w), with hon_stake
+  and f as fractions rather than percentages. Each finished point adds
+  a line to the result log: its key, a tab, and the densities at steps
+  every, 2 every, ... and w (only at w by default).
+
+  Points that differ only in w share one evolution, run to the largest
+  w still missing and read off at the smaller ones on the way. A
+  group's cost is (delta + 1) w, the cells it updates.
+
+  With -i target the grid is over (f, delta, w) and each point is
+  solved for the largest adversarial stake, 1 - hon_stake, whose
+  density at w is at most target, to 1e-6. Each trial evolves a Dual
+  distribution that carries the derivative along the stake, for the
+  Newton steps of inverse.h. The point's line has the key with
+  target=..., then the stake, the density there and its derivative,
+  the number of evolutions, and "infeasible" if even stake 0 is above
+  the target; or, with no answer, "not bracketed" and the density at
+  stake 0.5 if even that is within the target, or "not monotone" and
+  the slope where the density fell.
+
+  With -T table the grid has a single w, and instead of a log the
+  densities at steps every, 2 every, ... and w of each (hon_stake, f,
+  delta) go into a surrogate table (surrogate.h) over those axes and
+  the step. With -Q table the points on standard input, one
+  "hon_stake f delta step" per line (the table's axes in order), are
+  answered from it, or by an evolution where its bound in log-density
+  is above -t (default 0.01).
+
+  With -b target each point is first bounded (bound.h), which settles
+  in about a millisecond whether the density at w is at most target
+  when the point is far from it; the points the bounds leave open are
+  evolved, grouped as above. The point's line has the key with
+  threshold=..., then the density or the bound that settled it,
+  "below" or "above" the target, and "exact" or "bound".
+*/
+
+struct Group {
+  double            hon_stake, f;
+  int               delta;
+  vector<GridPoint> points;
+};
+
+static void run_group(const Group& group, int every, double target, ResultLog& log) {
+  double hon_prob = 1-pow((1-group.f),group.hon_stake);
+  double adv_prob = 1 - pow((1-group.f),1 - group.hon_stake);
+  int w = 0;
+  for (const GridPoint& point : group.points)
+    w = max(w, int(point.get("w")));
+  map<int, double> density;  // at every reported step of the group
+  for (const GridPoint& point : group.points) {
+    int point_w = point.get("w");
+    for (int step = every; step < point_w; step = step + every)
+      density[step] = 0.0;
+    density[point_w] = 0.0; }
+
+  Distribution* distributions[2];
+  distributions[0] = new Distribution(group.delta, identity);
+  distributions[1] = new Distribution(group.delta, zero);
+  int latest = 0, step = 0;
+  for (map<int, double>::iterator report = density.begin(); report != density.end(); report++) {
+    if (report->first > step) {
+      evolve(distributions[latest], distributions[1 - latest], adv_prob, hon_prob, report->first - step);
+      latest = 1 - latest;
+      step = report->first; }
+    report->second = distributions[latest]->pdensity(); }
+  delete(distributions[0]);
+  delete(distributions[1]);
+
+  for (const GridPoint& point : group.points) {
+    int point_w = point.get("w");
+    if (target > 0) {
+      log.record(bound_key(point.key(), target), bound_result(density[point_w], target, true));
+      continue; }
+    ostringstream result;
+    result << setprecision(17);
+    for (int step = every; step < point_w; step = step + every)
+      result << density[step] << " ";
+    result << density[point_w];
+    log.record(point.key(), result.str()); }
+}
+
+// -b: the bounds of every point first, then evolutions for those left open.
+static void bound_grid(const vector<GridPoint>& points, double target, int threads, ResultLog& log) {
+  BoundTally tally;
+  mutex lock;
+  map<string, Group> groups;
+  int skipped = 0;
+  WorkStealingPool bounds(threads);
+  for (const GridPoint& point : points) {
+    int delta = point.get("delta");
+    int w = point.get("w");
+    if ((delta < 0) || (delta > maxdelta) || (w < 1) || (w > maxsteps))
+      throw std::invalid_argument("ECQ-SWEEP: delta or w out of range in " + point.key());
+    if (log.done(bound_key(point.key(), target))) {
+      skipped++;
+      continue; }
+    const GridPoint* at = &point;
+    bounds.submit(double(delta + 1) * (delta + 1) * (delta + 1),
+		  [at, delta, w, target, &tally, &lock, &groups, &log] {
+		    double hon_stake = at->get("hon_stake"), f = at->get("f");
+		    double hon_prob = 1-pow((1-f),hon_stake);
+		    double adv_prob = 1 - pow((1-f),1 - hon_stake);
+		    DensityBounds found = pdensity_bounds(delta, adv_prob, hon_prob, w);
+		    BoundVerdict verdict = bound_verdict(found, target);
+		    if (verdict != bound_open) {
+		      tally.count(verdict);
+		      log.record(bound_key(at->key(), target),
+				 bound_result((verdict == bound_below) ? found.upper : found.lower, target, false));
+		      return; }
+		    ostringstream name;
+		    name << setprecision(12) << hon_stake << " " << f << " " << delta;
+		    lock_guard<mutex> hold(lock);
+		    Group& group = groups[name.str()];
+		    group.hon_stake = hon_stake;
+		    group.f = f;
+		    group.delta = delta;
+		    group.points.push_back(*at);
+		    tally.count(bound_open); }); }
+  cout << points.size() << " points, " << skipped << " already done, bounding on " << threads << " threads" << endl;
+  bounds.run();
+  cout << tally.report() << endl;
+
+  WorkStealingPool pool(threads);
+  for (map<string, Group>::iterator at = groups.begin(); at != groups.end(); at++) {
+    const Group* group = &at->second;
+    int w = 0;
+    for (const GridPoint& point : group->points)
+      w = max(w, int(point.get("w")));
+    pool.submit(double(group->delta + 1) * w,
+		[group, target, &log] { run_group(*group, maxsteps + 1, target, log); }); }
+  pool.run();
+}
+
+static void run_inverse(const GridPoint& point, const string& key, double target, ResultLog& log) {
+  double f = point.get("f");
+  int delta = point.get("delta");
+  int w = point.get("w");
+  InverseResult found = inverse_solve([f, delta, w](double stake) {
+      Dual adv_stake(stake, 1.0);
+      Dual hon_prob = 1 - pow(1 - f, 1 - adv_stake);
+      Dual adv_prob = 1 - pow(1 - f, adv_stake);
+      return(dual_pdensity(delta, adv_prob, hon_prob, w)); },
+    target, 0.0, 0.5, 1e-6);
+  string trouble = inverse_trouble(found);
+  ostringstream result;
+  if (!trouble.empty()) result << trouble;
+  else result << setprecision(17) << found.parameter << " " << found.density.value << " "
+	      << found.density.slope << " " << found.evaluations << (found.feasible ? "" : " infeasible");
+  log.record(key, result.str());
+}
+
+// The log-densities of one (hon_stake, f, delta) at the steps given.
+static void table_row(double hon_stake, double f, int delta, const vector<double>& steps, float* row) {
+  double hon_prob = 1-pow((1-f),hon_stake);
+  double adv_prob = 1 - pow((1-f),1 - hon_stake);
+  Distribution* distributions[2];
+  distributions[0] = new Distribution(delta, identity);
+  distributions[1] = new Distribution(delta, zero);
+  int latest = 0, step = 0;
+  for (size_t at = 0; at < steps.size(); at++) {
+    evolve(distributions[latest], distributions[1 - latest], adv_prob, hon_prob, int(steps[at]) - step);
+    latest = 1 - latest;
+    step = int(steps[at]);
+    row[at] = float(log(distributions[latest]->pdensity())); }
+  delete(distributions[0]);
+  delete(distributions[1]);
+}
+
+static void build_table(const GridAxes& grid, int every, int threads, const string& path) {
+  GridAxes axes;
+  vector<double> steps;
+  for (const pair<string, vector<double> >& axis : grid)
+    if (axis.first == "w") {
+      if ((axis.second.size() != 1) || (axis.second[0] < 1) || (axis.second[0] > maxsteps))
+	throw std::invalid_argument("ECQ-SWEEP: -T needs a single w in range");
+      int w = axis.second[0];
+      for (int step = every; step < w; step = step + every)
+	steps.push_back(step);
+      steps.push_back(w); }
+    else if ((axis.first == "hon_stake") || (axis.first == "f") || (axis.first == "delta")) {
+      axes.push_back(axis);
+      sort(axes.back().second.begin(), axes.back().second.end()); }
+    else
+      throw std::invalid_argument("ECQ-SWEEP: -T tables are over hon_stake, f, delta and w, not " + axis.first);
+  if ((axes.size() != 3) || steps.empty()) throw std::invalid_argument("ECQ-SWEEP: -T needs hon_stake, f, delta and w");
+  vector<GridPoint> points = expand_grid(axes);
+  axes.push_back(make_pair(string("step"), steps));
+  vector<float> cells(points.size() * steps.size());
+  WorkStealingPool pool(threads);
+  for (size_t at = 0; at < points.size(); at++) {
+    const GridPoint* point = &points[at];
+    float* row = &cells[at * steps.size()];
+    int delta = point->get("delta");
+    if ((delta < 0) || (delta > maxdelta)) throw std::invalid_argument("ECQ-SWEEP: delta out of range in " + point->key());
+    pool.submit(double(delta + 1) * steps.back(),
+		[point, row, delta, &steps] { table_row(point->get("hon_stake"), point->get("f"), delta, steps, row); }); }
+  cout << points.size() << " evolutions of " << steps.size() << " steps on " << threads << " threads" << endl;
+  pool.run();
+  surrogate_write(path, axes, cells);
+  cout << cells.size() << " densities in " << path << endl;
+}
+
+// The density at a query point, by evolution.
+static double exact_density(const SurrogateTable& table, const vector<double>& point) {
+  double hon_stake = 0, f = 0, delta = 0, step = 0;
+  for (size_t axis = 0; axis < table.axes.size(); axis++)
+    if (table.axes[axis].first == "hon_stake") hon_stake = point[axis];
+    else if (table.axes[axis].first == "f") f = point[axis];
+    else if (table.axes[axis].first == "delta") delta = point[axis];
+    else if (table.axes[axis].first == "step") step = point[axis];
+  if ((delta != floor(delta)) || (delta < 0) || (delta > maxdelta) || (step != floor(step)) || (step < 1) || (step > maxsteps))
+    throw std::invalid_argument("ECQ-SWEEP: an exact answer needs whole delta and step in range");
+  Distribution* distributions[2];
+  double hon_prob = 1-pow((1-f),hon_stake);
+  double adv_prob = 1 - pow((1-f),1 - hon_stake);
+  distributions[0] = new Distribution(int(delta), identity);
+  distributions[1] = new Distribution(int(delta), zero);
+  evolve(distributions[0], distributions[1], adv_prob, hon_prob, int(step));
+  double density = distributions[1]->pdensity();
+  delete(distributions[0]);
+  delete(distributions[1]);
+  return(density);
+}
+
+int main(int argc, char **argv)
+{
+  int threads = thread::hardware_concurrency();
+  int every = 0;
+  double target = 0;
+  double threshold = 0;
+  double tolerance = 0.01;
+  string results = "sweep.txt";
+  string table, queried;
+  int option;
+
+  while ((option = getopt(argc, argv, "j:e:o:i:b:T:Q:t:")) != -1)
+    if (option == 'j') threads = atoi(optarg);
+    else if (option == 'e') every = atoi(optarg);
+    else if (option == 'o') results = optarg;
+    else if (option == 'i') target = atof(optarg);
+    else if (option == 'b') threshold = atof(optarg);
+    else if (option == 'T') table = optarg;
+    else if (option == 'Q') queried = optarg;
+    else if (option == 't') tolerance = atof(optarg);
+    else {
+      argc = 0;
+      break; }
+  if (!queried.empty() && (argc > 0)) {
+    SurrogateTable surrogate(queried);
+    surrogate_serve(surrogate, cin, cout, tolerance,
+		    [&surrogate](const vector<double>& point) { return(exact_density(surrogate, point)); });
+    return 0; }
+  if (argc - optind < 1) {
+    cout << "Usage: " << argv[0] << " [-j threads] [-e every | -i target | -b target] [-o results | -T table] <grid>" << endl;
+    cout << "       " << argv[0] << " -Q table [-t tolerance] < queries" << endl;
+    cout << "  grid lines: hon_stake = 0.95, 0.90   f = 0.05   delta = 5:20:5   w = 1000, 50000" << endl;
+    cout << "  -e  also record the density every `every' steps (default: only at w)" << endl;
+    cout << "  -i  instead find, for each (f, delta, w), the largest adversarial stake" << endl;
+    cout << "      whose density at w is at most target; the grid has no hon_stake" << endl;
+    cout << "  -b  instead tell whether each density at w is at most target, from bounds where" << endl;
+    cout << "      they settle it and by evolution where they do not" << endl;
+    cout << "  -o  result log (default sweep.txt); points already in it are skipped" << endl;
+    cout << "  -T  build a surrogate table over hon_stake, f, delta and the steps every ... w" << endl;
+    cout << "  -Q  answer \"hon_stake f delta step\" lines from the table, or exactly where" << endl;
+    cout << "      its error bound in log-density is over tolerance (default 0.01)" << endl;
+    return 0;
+  }
+  ifstream spec(argv[optind]);
+  if (!spec) {
+    cout << "Cannot read " << argv[optind] << endl;
+    return 1;
+  }
+  if (!table.empty()) {
+    if (every < 1) throw std::invalid_argument("ECQ-SWEEP: -T needs -e");
+    build_table(read_axes(spec), every, threads, table);
+    return 0; }
+  vector<GridPoint> points = read_grid(spec);
+  ResultLog log(results);
+
+  if (threshold > 0) {
+    bound_grid(points, threshold, threads, log);
+    cout << log.count() << " points in " << results << endl;
+    return 0; }
+
+  if (target > 0) {
+    WorkStealingPool pool(threads);
+    int skipped = 0, solves = 0;
+    for (const GridPoint& point : points) {
+      int delta = point.get("delta");
+      int w = point.get("w");
+      if ((delta < 0) || (delta > maxdelta) || (w < 1) || (w > maxsteps))
+	throw std::invalid_argument("ECQ-SWEEP: delta or w out of range in " + point.key());
+      if (point.has("hon_stake")) throw std::invalid_argument("ECQ-SWEEP: -i solves for the stake; the grid may not fix hon_stake");
+      ostringstream key;
+      key << point.key() << " target=" << setprecision(12) << target;
+      if (log.done(key.str())) {
+	skipped++;
+	continue; }
+      solves++;
+      const GridPoint* at = &point;
+      string name = key.str();
+      pool.submit(double(delta + 1) * w,
+		  [at, name, target, &log] { run_inverse(*at, name, target, log); }); }
+    cout << points.size() << " points, " << skipped << " already done, "
+	 << solves << " solves on " << threads << " threads" << endl;
+    pool.run();
+    cout << log.count() << " points in " << results << endl;
+    return 0; }
+
+  map<string, Group> groups;
+  int skipped = 0;
+  for (const GridPoint& point : points) {
+    int delta = point.get("delta");
+    int w = point.get("w");
+    if ((delta < 0) || (delta > maxdelta) || (w < 1) || (w > maxsteps))
+      throw std::invalid_argument("ECQ-SWEEP: delta or w out of range in " + point.key());
+    if (log.done(point.key())) {
+      skipped++;
+      continue; }
+    ostringstream name;
+    name << setprecision(12) << point.get("hon_stake") << " " << point.get("f") << " " << delta;
+    Group& group = groups[name.str()];
+    group.hon_stake = point.get("hon_stake");
+    group.f = point.get("f");
+    group.delta = delta;
+    group.points.push_back(point); }
+  cout << points.size() << " points, " << skipped << " already done, "
+       << groups.size() << " evolutions on " << threads << " threads" << endl;
+
+  WorkStealingPool pool(threads);
+  for (map<string, Group>::iterator at = groups.begin(); at != groups.end(); at++) {
+    const Group* group = &at->second;
+    int w = 0;
+    for (const GridPoint& point : group->points)
+      w = max(w, int(point.get("w")));
+    pool.submit(double(group->delta + 1) * w,
+		[group, every, &log] { run_group(*group, every > 0 ? every : maxsteps + 1, 0, log); }); }
+  pool.run();
+  cout << log.count() << " points in " << results << endl;
+  return 0;
+}
@@ -57,17 +57,18 @@ int main()
   cin  >> w;
   
   distributions[0] = new Distribution(delta,identity);
+  distributions[1] = new Distribution(delta,zero);
   cout << "Evolution beginning...\n";
   for (step = 1; step <= w; step++) {
-    distributions[step % 2] = evolve(distributions[(step - 1) % 2],
-				     adv_prob, hon_prob);
-    delete(distributions[(step - 1) % 2]);
-    double new_density = distributions[step % 2]->pdensity();
+    evolve(distributions[(step - 1) % 2], distributions[step % 2],
+	   adv_prob, hon_prob);
     //    double new_density_t = distributions[step % 2]->tdensity();
-    if (step % 10 == 0)
-      cout << "(" << step << ", " << new_density << ")\n" << std::flush;}
+    if (step % 10 == 0) {
+      double new_density = distributions[step % 2]->pdensity();
+      cout << "(" << step << ", " << new_density << ")\n" << std::flush;}}
   // cout << "(" << step << ", " << new_density << "," << new_density_t  << ")\n" << std::flush;}
-  delete(distributions[w % 2]);
+  delete(distributions[0]);
+  delete(distributions[1]);
   return 0;
 }
 
@@ -0,0 +1,208 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <map>
+#include <set>
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include "disttools.h"
+#include "batch.h"
+#include "daemon.h"
+
+using namespace std;
+
+/*
+  Answers ecq queries over a Unix-domain socket (or a loopback TCP
+  port). A query is a job record (see batch.h)
+
+    tool=ecq hon_stake=0.95 f=0.05 delta=5 w=1000 [every=10]
+
+  with hon_stake and f as fractions, as in ecq-sweep; the reply has a
+  "step=... density=..." line every `every' steps, as ecq-pg prints.
+
+  Every (hon_stake, f, delta) evolution is kept: its latest
+  distribution and the densities computed so far. A query beyond the
+  latest step evolves on from there, several steps to a sweep between
+  the steps it reports. A query for steps passed over without a
+  density is answered by a separate evolution from the start, whose
+  densities are kept as well. The evolutions share an LRU cache with
+  a memory budget; each holds two full distributions. tool=stats
+  reports the cache.
+
+  A query the cache answers is answered at once; any other evolves a
+  copy of the cached evolution on one of -j worker threads (see
+  daemon.h), whose densities then join the cache.
+*/
+
+struct Walk {
+  Distribution*    latest;     // at step `step'
+  Distribution*    spare;
+  int              step;
+  map<int, double> density;
+  Walk(int delta) : latest(new Distribution(delta, identity)),
+		    spare(new Distribution(delta, zero)),
+		    step(0) {}
+  ~Walk() {
+    delete(latest);
+    delete(spare);
+  }
+  size_t bytes() const {
+    return(2 * sizeof(Distribution) + density.size() * 48);
+  }
+  // Evolves from `from' (at step `at') through the wanted steps, noting their densities.
+  void advance(Distribution*& from, Distribution*& to, int& at,
+	       const set<int>& wanted, double adv_prob, double hon_prob) {
+    for (int report : wanted) {
+      if (report <= at) continue;
+      evolve(from, to, adv_prob, hon_prob, report - at);
+      swap(from, to);
+      at = report;
+      density[at] = from->pdensity(); }
+  }
+};
+
+static LruCache<Walk>* walks;
+
+/* The densities of the (hon_stake, f, delta) evolution at the steps
+   wanted. With cached_only, under cache_lock(), those of the cached
+   evolution, NULL if it lacks any. Otherwise the evolution goes on
+   from a copy of the cached one, without the lock, into own, and its
+   densities join the cached ones, as does its latest distribution if
+   it got further. */
+static const map<int, double>* densities(double hon_stake, double f, int delta,
+					 const set<int>& wanted, bool cached_only,
+					 map<int, double>& own) {
+  string key = cache_key({hon_stake, f, double(delta)});
+  Walk* walk = NULL;
+  Walk* extended = NULL;
+  {
+    unique_lock<mutex> guard(cache_lock(), defer_lock);
+    if (!cached_only) guard.lock();
+    walk = walks->find(key);
+    bool covered = (walk != NULL);
+    for (int step : wanted)
+      covered = covered && (walk->density.count(step) > 0);
+    if (cached_only) return(covered ? &walk->density : NULL);
+    if (covered) {
+      own = walk->density;
+      return(&own); }
+    if (walk != NULL) {
+      extended = new Walk(delta);
+      delete(extended->latest);
+      extended->latest = new Distribution(walk->latest);
+      extended->step = walk->step;
+      extended->density = walk->density; }
+  }
+  if (extended == NULL) extended = new Walk(delta);
+  double hon_prob = 1-pow((1-f),hon_stake);
+  double adv_prob = 1 - pow((1-f),1 - hon_stake);
+  set<int> missing, ahead;
+  for (int step : wanted)
+    if (extended->density.count(step) == 0)
+      (step <= extended->step ? missing : ahead).insert(step);
+  if (!missing.empty()) {
+    Distribution* from = new Distribution(delta, identity);
+    Distribution* to = new Distribution(delta, zero);
+    int at = 0;
+    extended->advance(from, to, at, missing, adv_prob, hon_prob);
+    delete(from);
+    delete(to); }
+  extended->advance(extended->latest, extended->spare, extended->step, ahead, adv_prob, hon_prob);
+  own = extended->density;
+  lock_guard<mutex> guard(cache_lock());
+  walk = walks->find(key);
+  if (walk == NULL)
+    walks->insert(key, extended, extended->bytes());
+  else {
+    walk->density.insert(extended->density.begin(), extended->density.end());
+    if (extended->step > walk->step) {
+      swap(walk->latest, extended->latest);
+      swap(walk->spare, extended->spare);
+      walk->step = extended->step; }
+    walks->resize(key, walk->bytes());
+    delete(extended); }
+  return(&own);
+}
+
+// Answers a job, into out only if it is answered in full; with
+// cached_only, from the cache or not at all.
+static bool respond(const JobRecord& job, ostream& out, bool cached_only) {
+  string tool = job.text("tool");
+  if (tool == "stats") {
+    unique_lock<mutex> guard(cache_lock(), defer_lock);
+    if (!cached_only) guard.lock();
+    out << job.lead() << " entries=" << walks->size() << " bytes=" << walks->used()
+	<< " hits=" << walks->hits << " misses=" << walks->misses << "\n";
+    return(true); }
+  if (tool != "ecq") throw std::invalid_argument("JOB: unknown tool " + tool);
+  double hon_stake = job.number("hon_stake");
+  double f = job.number("f");
+  int delta = job.integer("delta");
+  int w = job.integer("w");
+  int every = job.integer("every", 10);
+  if ((delta < 0) || (delta > maxdelta) || (w < 0) || (w > maxsteps) || (every < 1))
+    throw std::invalid_argument("JOB: delta, w or every out of range");
+  set<int> wanted;
+  for (int step = every; step <= w; step = step + every)
+    wanted.insert(step);
+  map<int, double> own;
+  const map<int, double>* density = densities(hon_stake, f, delta, wanted, cached_only, own);
+  if (density == NULL) return(false);
+  for (int step : wanted)
+    out << job.lead() << " step=" << step << " density=" << density->at(step) << "\n";
+  return(true);
+}
+
+static bool lookup(const JobRecord& job, ostream& out) {
+  return(respond(job, out, true));
+}
+
+static void answer(const JobRecord& job, ostream& out) {
+  respond(job, out, false);
+}
+
+int main(int argc, char **argv)
+{
+  string path = "/tmp/ecqd.sock";
+  int port = 0;
+  long megabytes = 1024;
+  int precision = 17;
+  int workers = max(1u, thread::hardware_concurrency());
+  int option;
+
+  while ((option = getopt(argc, argv, "s:P:m:p:j:")) != -1)
+    if (option == 's') path = optarg;
+    else if (option == 'P') port = atoi(optarg);
+    else if (option == 'm') megabytes = atol(optarg);
+    else if (option == 'p') precision = atoi(optarg);
+    else if (option == 'j') workers = atoi(optarg);
+    else {
+      cout << "Usage: " << argv[0] << " [-s socket_path | -P localhost_port] [-m cache_megabytes] [-p precision] [-j workers]" << endl;
+      cout << "  serves ecq job records, one per line; each reply ends with a line \".\"" << endl;
+      return 1; }
+  walks = new LruCache<Walk>(1 << 20, megabytes << 20);
+  int listener = (port > 0) ? listen_local_tcp(port) : listen_unix(path);
+  cout << "ecqd: serving on " << ((port > 0) ? "localhost:" + to_string(port) : path) << endl;
+  serve_queries(listener, lookup, answer, precision, workers);
+  return 0;
+}
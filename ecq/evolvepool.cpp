@@ -0,0 +1,207 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <pthread.h>
+#include <sched.h>
+#include "evolvepool.h"
+
+using namespace std;
+
+//class StepBarrier
+
+StepBarrier::StepBarrier(int init_parties) : parties(init_parties),
+					     waiting(0),
+					     generation(0) {}
+
+void StepBarrier::wait() {
+  unique_lock<mutex> guard(lock);
+  unsigned long arrived = generation;
+  if (++waiting == parties) {
+    waiting = 0;
+    generation++;
+    released.notify_all(); }
+  else
+    released.wait(guard, [&] { return generation != arrived; });
+}
+
+//class EvolutionPool
+
+/* Buffers use the compact row stride delta+1, not the maxdelta+1 of
+   Distribution, so a sweep only moves the columns in use. Row r holds
+   beta = r - maxsteps - 1; rows 0 and footprint+1 are ghost rows.
+
+   evolve() advances a whole block of steps in one dispatch: every
+   worker sweeps its slab once with the multi-step kernel, reading the
+   halo it needs from the source buffer, and the workers only meet at
+   the barrier closing the dispatch.
+
+   The rows are cut into blocks of blockrows, and worker i owns blocks
+   [slab_first[i] ... slab_first[i+1]). The first block starts at row
+   0, so the ghost rows are zeroed along with the block that holds
+   them and never written again. */
+
+EvolutionPool::EvolutionPool(int init_delta,
+			     int init_threads) : delta(init_delta),
+						 threads(min(init_threads, pool_blocks)),
+						 stride(init_delta + 1),
+						 rows(footprint + 2),
+						 current(0),
+						 start(min(init_threads, pool_blocks) + 1),
+						 finish(min(init_threads, pool_blocks) + 1),
+						 command(idle),
+						 stencil(NULL),
+						 steps(0) {
+  if (init_delta > maxdelta) throw std::invalid_argument("POOL CONSTRUCTOR: Delta index out of range");
+  if (init_threads < 1) throw std::invalid_argument("POOL CONSTRUCTOR: need at least one thread");
+  int blocks = pool_blocks;
+  if (init_threads > blocks)
+    cerr << "POOL CONSTRUCTOR: " << init_threads << " threads asked for, running " << blocks
+	 << ", one per block of " << blockrows << " rows" << endl;
+  for (int buffer : {0, 1}) {
+    void* map = mmap(NULL, size_t(rows) * stride * sizeof(double),
+		     PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) throw std::runtime_error("POOL CONSTRUCTOR: buffer allocation failed");
+    buffers[buffer] = (double*) map; }
+  for (int worker = 0; worker <= threads; worker++)
+    slab_first.push_back((worker * blocks) / threads);
+  for (int transition = 0; transition <= delta; transition++)
+    columns.push_back(transition);
+  block_sums.resize(blocks);
+  row_sums.resize(footprint);
+  for (int worker = 0; worker < threads; worker++)
+    workers.push_back(std::thread(&EvolutionPool::work, this, worker));
+  dispatch(idle);  // returns once every slab has been first touched
+}
+
+EvolutionPool::~EvolutionPool() {
+  dispatch(quit);
+  for (std::thread& worker : workers)
+    worker.join();
+  for (int buffer : {0, 1})
+    munmap(buffers[buffer], size_t(rows) * stride * sizeof(double));
+}
+
+void EvolutionPool::block_rows(int block, int& first, int& last) const {
+  first = block * blockrows;
+  last  = min(first + blockrows, rows) - 1;
+}
+
+void EvolutionPool::dispatch(Command next) {
+  command = next;
+  start.wait();
+  finish.wait();
+}
+
+void EvolutionPool::work(int worker) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+    int cpus = CPU_COUNT(&allowed);
+    int target = worker % cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+      if (CPU_ISSET(cpu, &allowed) && (target-- == 0)) {
+	cpu_set_t pinned;
+	CPU_ZERO(&pinned);
+	CPU_SET(cpu, &pinned);
+	pthread_setaffinity_np(pthread_self(), sizeof(pinned), &pinned);
+	break; }}
+  int first, last, slab_start, slab_end;
+  block_rows(slab_first[worker], slab_start, last);
+  block_rows(slab_first[worker + 1] - 1, first, slab_end);
+  // First touch: this worker's slab of both buffers lives on its node.
+  for (int buffer : {0, 1})
+    for (size_t cell = size_t(slab_start) * stride; cell < size_t(slab_end + 1) * stride; cell++)
+      buffers[buffer][cell] = 0.0;
+  int interior_start = max(slab_start, 1);
+  int interior_end   = min(slab_end, footprint);
+  bool live = true;
+  while (live) {
+    start.wait();
+    switch (command) {
+    case run:
+      // One sweep of the slab advances all the steps; the halo rows it
+      // needs from the neighbouring slabs are only read, from the source.
+      evolve_rows(buffers[current], buffers[1 - current], *stencil,
+		  interior_start, interior_end, rows, steps);
+      break;
+    case reduce_positive:
+    case reduce_total:
+      {
+	ReduceCells cells = {buffers[current], NULL, 0, size_t(stride), columns.data(), delta + 1};
+	int low = (command == reduce_positive) ? maxsteps + 1 : 0;
+	for (int block = slab_first[worker]; block < slab_first[worker + 1]; block++)
+	  block_sums[block] = reduce_block<false>(cells, block, low, rows - 1); }
+      break;
+    case reduce_rows:
+      {
+	ReduceCells cells = {buffers[current], NULL, 0, size_t(stride), columns.data(), delta + 1};
+	for (int row = interior_start; row <= interior_end; row++)
+	  row_sums[row - 1] = reduce_value(reduce_row<false>(cells, row)); }
+      break;
+    case quit:
+      live = false;
+      break;
+    case idle:
+      break; }
+    finish.wait(); }
+}
+
+void EvolutionPool::load(const Distribution* source) {
+  if (source->delta != delta) throw std::invalid_argument("POOL LOAD: Delta mismatch");
+  for (int row = 0; row < rows; row++)
+    for (int transition = 0; transition <= delta; transition++)
+      buffers[current][size_t(row) * stride + transition] = source->sites[row][transition];
+}
+
+void EvolutionPool::store(Distribution* target) const {
+  if (target->delta != delta) throw std::invalid_argument("POOL STORE: Delta mismatch");
+  for (int row = 0; row < rows; row++)
+    for (int transition = 0; transition <= delta; transition++)
+      target->sites[row][transition] = buffers[current][size_t(row) * stride + transition];
+}
+
+void EvolutionPool::evolve(double adv_prob,
+			   double hon_prob,
+			   int    count) {
+  if (count <= 0) return;
+  EvolveStencil step_stencil(delta, adv_prob, hon_prob, stride);
+  stencil = &step_stencil;
+  steps   = count;
+  dispatch(run);
+  current = 1 - current;
+  stencil = NULL;
+}
+
+double EvolutionPool::reduce(Command which) {
+  dispatch(which);
+  vector<ReducePartial> sums(block_sums);
+  return(reduce_blocks<false>(sums));
+}
+
+double EvolutionPool::pdensity() {
+  return(reduce(reduce_positive));
+}
+
+double EvolutionPool::tdensity() {
+  return(reduce(reduce_total));
+}
+
+void EvolutionPool::margin_tail(MarginTail& tail) {
+  dispatch(reduce_rows);
+  tail.build(&row_sums[0]);
+}
@@ -0,0 +1,90 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __EVOLVEPOOL_H
+#define __EVOLVEPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "disttools.h"
+
+class StepBarrier {
+public:
+  StepBarrier(int);  // number of participants
+  void wait();
+private:
+  std::mutex              lock;
+  std::condition_variable released;
+  const int               parties;
+  int                     waiting;
+  unsigned long           generation;
+};
+
+// A persistent pool of worker threads evolving one ecq distribution.
+// Each worker is pinned to a cpu and owns a contiguous slab of beta
+// rows in both buffers; the buffers are mapped untouched and zeroed by
+// the owning worker, so on a NUMA machine each slab is placed on the
+// node of the worker that sweeps it. Workers meet at a barrier after
+// every block of steps, and densities are reduced over the fixed row
+// blocks of reduce.h, so the result does not depend on the number of
+// threads, and is that of Distribution::pdensity() to the bit.
+//
+// A worker owns at least one block, so a pool runs at most pool_blocks
+// workers; asked for more, it runs that many and says so on stderr.
+const int pool_blocks = (footprint + 2 + blockrows - 1) / blockrows;
+
+class EvolutionPool {
+
+public:
+  const int delta;
+  const int threads;  // workers running, at most pool_blocks
+  EvolutionPool(int,   // delta
+		int);  // threads
+  ~EvolutionPool();
+  //
+  void   load(const Distribution*);
+  void   store(Distribution*) const;
+  void   evolve(double,  // adversarial prob
+		double,  // honest prob
+		int);    // steps
+  double pdensity();
+  double tdensity();
+  void   margin_tail(MarginTail&);  // the row sums in parallel, the curve in this thread
+
+private:
+  enum Command {idle, run, reduce_positive, reduce_total, reduce_rows, quit};
+  const int      stride;
+  const int      rows;       // footprint + 2 ghost rows
+  double*        buffers[2];
+  int            current;    // buffer holding the latest distribution
+  std::vector<int>    slab_first;  // first block of each worker
+  std::vector<int>    columns;     // 0 ... delta, the cells of a row
+  std::vector<ReducePartial> block_sums;
+  std::vector<double> row_sums;    // of rows 1 ... footprint, for margin_tail()
+  std::vector<std::thread> workers;
+  StepBarrier    start, finish;
+  Command        command;
+  const EvolveStencil* stencil;
+  int            steps;
+  void   work(int);       // worker index
+  void   dispatch(Command);
+  double reduce(Command);
+  void   block_rows(int, int&, int&) const;  // block, first row, last row
+};
+
+#endif
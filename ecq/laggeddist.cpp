@@ -0,0 +1,183 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdexcept>
+#include "laggeddist.h"
+
+using namespace std;
+
+/*
+  While h_transition < delta-1, Dist_index::evolve ignores the honest
+  slot and moves deterministically to h_transition+1; only the
+  adversary moves beta. Mass that enters column 0 after an honest
+  advance therefore sits out delta-1 steps during which it is only
+  shifted by a Binomial(delta-1, adv_prob) number of adversarial
+  successes.
+
+  LaggedDistribution keeps each countdown column as the vector it had
+  when it was filled (a "slot"), together with the column it had then
+  ("base"). A slot now at column t stands for its vector convolved
+  with Binomial(t - base, adv_prob). Only when the slot reaches column
+  delta-2 and moves on to delta-1 is the whole accumulated shift
+  applied, as one convolution, and the slot is reused for the mass
+  entering column 0. Slots filled by a step have base 0; slots loaded
+  from a Distribution have base equal to their column.
+
+  A step thus touches one slot and the two settled columns delta-1
+  and delta, instead of all delta+1 columns; the densities sum the
+  slots when asked for them, by the tree of reduce.h, and add delta-1
+  short sums per slot for the mass still to move. The slots still occupy
+  memory: the mass that entered in each of the last delta-1 steps
+  cannot be merged before it leaves the countdown.
+
+  Column vectors run over [-maxsteps-lagpad ... maxsteps+lagpad]; the
+  lagpad rows on each side stay zero so the convolution can read
+  below -maxsteps.
+*/
+
+static const int lagrows = footprint + 2 * lagpad;
+
+static double* new_column() {
+  double* result = new double[lagrows];
+  for (int row = 0; row < lagrows; row++)
+    result[row] = 0.0;
+  return(result + maxsteps + lagpad);
+}
+
+static void delete_column(double* column) {
+  delete[] (column - maxsteps - lagpad);
+}
+
+LaggedDistribution::LaggedDistribution(const Distribution* orig,
+				       double init_adv_prob,
+				       double init_hon_prob) : delta(orig->delta),
+							       adv_prob(init_adv_prob),
+							       hon_prob(init_hon_prob),
+							       countdown(orig->delta - 1),
+							       head(0) {
+  if (delta < 2) throw std::invalid_argument("LAGGED CONSTRUCTOR: no countdown below Delta = 2");
+  Dist_index* index;
+  index = new Dist_index(delta,0,0);
+  for (int which : {0, 1}) {
+    settled[which] = new_column();
+    for (int beta = -maxsteps; beta <= maxsteps; beta++) {
+      index->set(beta, delta - 1 + which);
+      settled[which][beta] = orig->get(index); }}
+  slots    = new double*[countdown];
+  base     = new int[countdown];
+  for (int slot = 0; slot < countdown; slot++) {
+    slots[slot] = new_column();
+    base[slot]  = slot;
+    for (int beta = -maxsteps; beta <= maxsteps; beta++) {
+      index->set(beta, slot);
+      slots[slot][beta] = orig->get(index); }}
+  delete(index);
+  kernels[0][0] = 1.0;
+  for (int n = 1; n < delta; n++)
+    for (int k = 0; k <= n; k++) {
+      double stay  = (k < n) ? kernels[n-1][k] : 0.0;
+      double shift = (k > 0) ? kernels[n-1][k-1] : 0.0;
+      kernels[n][k] = (1 - adv_prob) * stay + adv_prob * shift; }
+}
+
+LaggedDistribution::~LaggedDistribution() {
+  for (int which : {0, 1})
+    delete_column(settled[which]);
+  for (int slot = 0; slot < countdown; slot++)
+    delete_column(slots[slot]);
+  delete[] slots;
+  delete[] base;
+}
+
+int LaggedDistribution::column_of(int slot) const {
+  return((slot - head + countdown) % countdown);
+}
+
+// Sum of a column over beta in [first ... last], by the tree of reduce.h
+// over the column's rows.
+static double column_sum(const double* column, int first, int last) {
+  static const int single[1] = {0};
+  ReduceCells cells = {column - maxsteps - lagpad, NULL, 0, 1, single, 1};
+  return(reduce_rows<false>(cells, first + maxsteps + lagpad, last + maxsteps + lagpad));
+}
+
+/* One descending sweep per step. At row beta it reads the old settled
+   values at beta and beta-1 (and carries the old values at beta+1),
+   convolves the leaving slot at beta ... beta-lag, and overwrites that
+   slot at beta with the entering column 0. Going down, nothing read
+   later has been written yet. */
+void LaggedDistribution::evolve(int steps) {
+  const double a0 = 1 - adv_prob, a1 = adv_prob;
+  const double h0 = 1 - hon_prob, h1 = hon_prob;
+  for (int s = 0; s < steps; s++) {
+    int leaving = (head + countdown - 1) % countdown;
+    int lag     = delta - 1 - base[leaving];
+    const double* kernel = kernels[lag];
+    double* from  = slots[leaving];
+    double* lower = settled[0];
+    double* upper = settled[1];
+    double  above = 0.0;   // old settled mass at beta+1
+    for (int beta = maxsteps; beta >= -maxsteps; beta--) {
+      double leave = 0.0;
+      for (int k = 0; k <= lag; k++)
+	leave += kernel[k] * from[beta - k];
+      double here = lower[beta] + upper[beta];
+      double enter = h1 * (a0 * above + a1 * here);
+      lower[beta] = leave + h0 * (a0 * lower[beta] + a1 * lower[beta - 1]);
+      upper[beta] = h0 * (a0 * upper[beta] + a1 * upper[beta - 1]);
+      from[beta] = enter;
+      above = here; }
+    base[leaving] = 0;
+    head = leaving; }
+}
+
+void LaggedDistribution::store(Distribution* target) const {
+  if (target->delta != delta) throw std::invalid_argument("LAGGED STORE: Delta mismatch");
+  Dist_index* index;
+  index = new Dist_index(delta,0,0);
+  for (int which : {0, 1})
+    for (int beta = -maxsteps; beta <= maxsteps; beta++) {
+      index->set(beta, delta - 1 + which);
+      target->set(index, settled[which][beta]); }
+  for (int slot = 0; slot < countdown; slot++) {
+    int t   = column_of(slot);
+    int lag = t - base[slot];
+    for (int beta = -maxsteps; beta <= maxsteps; beta++) {
+      double value = 0.0;
+      for (int k = 0; k <= lag; k++)
+	value += kernels[lag][k] * slots[slot][beta - k];
+      index->set(beta, t);
+      target->set(index, value); }}
+  delete(index);
+}
+
+double LaggedDistribution::pdensity() const {
+  double result = column_sum(settled[0], 0, maxsteps) + column_sum(settled[1], 0, maxsteps);
+  for (int slot = 0; slot < countdown; slot++) {
+    int    lag  = column_of(slot) - base[slot];
+    double tail = column_sum(slots[slot], 0, maxsteps);  // slot mass at beta >= -k
+    for (int k = 0; k <= lag; k++) {
+      if (k > 0) tail = tail + slots[slot][-k];
+      result = result + kernels[lag][k] * tail; }}
+  return(result);
+}
+
+double LaggedDistribution::tdensity() const {
+  double result = column_sum(settled[0], -maxsteps, maxsteps) + column_sum(settled[1], -maxsteps, maxsteps);
+  for (int slot = 0; slot < countdown; slot++)
+    result = result + column_sum(slots[slot], -maxsteps, maxsteps);
+  return(result);
+}
@@ -0,0 +1,52 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __LAGGEDDIST_H
+#define __LAGGEDDIST_H
+
+#include "disttools.h"
+
+const int lagpad = maxdelta;  // zero rows below and above each column
+
+// The same distribution as Distribution, held so that the countdown
+// columns cost nothing while they count down. See laggeddist.cpp.
+class LaggedDistribution {
+
+public:
+  const int    delta;
+  const double adv_prob;
+  const double hon_prob;
+  LaggedDistribution(const Distribution*,  // initial distribution
+		     double,               // adversarial prob
+		     double);              // honest prob
+  ~LaggedDistribution();
+  //
+  void   evolve(int);                      // steps
+  void   store(Distribution*) const;
+  double pdensity() const;
+  double tdensity() const;
+
+private:
+  const int countdown;              // delta-1 columns in [0 ... delta-2]
+  double*   settled[2];             // columns delta-1 and delta, indexed by beta
+  double**  slots;                  // countdown columns, lagged, indexed by beta
+  int*      base;                   // column each slot held when filled
+  int       head;                   // slot now holding column 0
+  double    kernels[maxdelta][maxdelta];  // Binomial(n, adv_prob), n < delta
+  int       column_of(int) const;         // slot -> current column
+};
+
+#endif
@@ -0,0 +1,109 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <string>
+#include <stdexcept>
+#include "disttools.h"
+#include "libecq.h"
+
+using namespace std;
+
+static thread_local string last_error;
+
+static const Distribution* unwrap(const ecq_distribution* distribution) {
+  if (distribution == NULL) throw std::invalid_argument("ECQ: NULL distribution");
+  return(reinterpret_cast<const Distribution*>(distribution));
+}
+
+static Distribution* unwrap(ecq_distribution* distribution) {
+  if (distribution == NULL) throw std::invalid_argument("ECQ: NULL distribution");
+  return(reinterpret_cast<Distribution*>(distribution));
+}
+
+static ecq_distribution* wrap(Distribution* distribution) {
+  return(reinterpret_cast<ecq_distribution*>(distribution));
+}
+
+template <class Value> static Value* result_pointer(Value* pointer) {
+  if (pointer == NULL) throw std::invalid_argument("ECQ: NULL result pointer");
+  return(pointer);
+}
+
+SPIKE_EXPORT int ecq_abi_version(void) {
+  return(SPIKE_ABI_VERSION);
+}
+
+SPIKE_EXPORT const char* ecq_last_error(void) {
+  return(last_error.c_str());
+}
+
+SPIKE_EXPORT int ecq_create(int delta, int initial, ecq_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	if ((delta < 1) || (delta > maxdelta)) throw std::invalid_argument("ECQ: delta out of range");
+	if ((initial != ECQ_ZERO) && (initial != ECQ_IDENTITY)) throw std::invalid_argument("ECQ: unknown initial distribution");
+	*result_pointer(created) = wrap(new Distribution(delta, (initial == ECQ_ZERO) ? zero : identity)); }));
+}
+
+SPIKE_EXPORT int ecq_copy(const ecq_distribution* source, ecq_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(created) = wrap(new Distribution(unwrap(source))); }));
+}
+
+SPIKE_EXPORT void ecq_destroy(ecq_distribution* distribution) {
+  delete(reinterpret_cast<Distribution*>(distribution));
+}
+
+SPIKE_EXPORT int ecq_evolve(const ecq_distribution* source, ecq_distribution* target,
+			    double adv_prob, double hon_prob, int steps) {
+  return(cabi_guard(last_error, [&] {
+	if (source == target) throw std::invalid_argument("ECQ: evolution target is the source");
+	evolve(unwrap(source), unwrap(target), adv_prob, hon_prob, steps); }));
+}
+
+SPIKE_EXPORT int ecq_pdensity(const ecq_distribution* distribution, double* density) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(density) = unwrap(distribution)->pdensity(); }));
+}
+
+SPIKE_EXPORT int ecq_tdensity(const ecq_distribution* distribution, double* density) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(density) = unwrap(distribution)->tdensity(); }));
+}
+
+SPIKE_EXPORT int ecq_tail(const ecq_distribution* distribution, int count, const int* depths, double* tails) {
+  return(cabi_guard(last_error, [&] {
+	if (count < 0) throw std::invalid_argument("ECQ: negative depth count");
+	if (count == 0) return;
+	MarginTail tail;
+	unwrap(distribution)->margin_tail(tail);
+	for (int at = 0; at < count; at++)
+	  result_pointer(tails)[at] = tail.at(result_pointer(depths)[at]); }));
+}
+
+SPIKE_EXPORT int ecq_view(const ecq_distribution* distribution, spike_view* view) {
+  return(cabi_guard(last_error, [&] {
+	const Distribution* source = unwrap(distribution);
+	spike_view* result = result_pointer(view);
+	result->data = source->site_data();
+	result->rank = 2;
+	result->shape[0] = footprint;
+	result->shape[1] = maxdelta + 1;
+	result->strides[0] = sizeof(double) * (maxdelta + 1);
+	result->strides[1] = sizeof(double);
+	result->used[0] = footprint;
+	result->used[1] = source->delta + 1; }));
+}
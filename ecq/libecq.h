@@ -0,0 +1,65 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __LIBECQ_H
+#define __LIBECQ_H
+
+/*
+  C interface to the ecq distributions, built as libecq.so. Result
+  codes and views are those of cabi.h. Distributions made here are
+  freed with ecq_destroy(); pointer arguments may not be NULL.
+
+  A view has rank 2: row beta + maxsteps, for beta in [-50000 ...
+  50000] (maxsteps, fixed at build time), column the transition, of
+  which the first delta + 1 are used.
+*/
+
+#include "cabi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct ecq_distribution ecq_distribution;
+
+#define ECQ_ZERO      0
+#define ECQ_IDENTITY  1
+
+int         ecq_abi_version(void);
+const char* ecq_last_error(void);
+
+int  ecq_create(int delta, int initial, ecq_distribution** created);  /* ECQ_ZERO or ECQ_IDENTITY */
+int  ecq_copy(const ecq_distribution* source, ecq_distribution** created);
+void ecq_destroy(ecq_distribution* distribution);
+
+/* steps steps from source into target, which must have the same delta
+   and be another distribution; source is left as it was. */
+int  ecq_evolve(const ecq_distribution* source, ecq_distribution* target,
+		double adv_prob, double hon_prob, int steps);
+
+int  ecq_pdensity(const ecq_distribution* distribution, double* density);
+int  ecq_tdensity(const ecq_distribution* distribution, double* density);
+/* tails[i] = P(beta >= -depths[i]) for count depths, from one read of
+   the distribution; a depth past the range gives 0 below it and the
+   total mass above it. */
+int  ecq_tail(const ecq_distribution* distribution, int count, const int* depths, double* tails);
+int  ecq_view(const ecq_distribution* distribution, spike_view* view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdexcept>
+#include <algorithm>
+#include "slabdist.h"
+
+using namespace std;
+
+/*
+  Global rows run over [0 ... 2 margin + 2], row r holding beta =
+  r - margin - 1, with ghost rows at both ends as in Distribution. The
+  rows are cut into blocks of blockrows and every rank owns a
+  contiguous run of whole blocks; each sums its blocks and rank 0 adds
+  them all by the tree of reduce.h, so the densities are EvolutionPool's
+  to the bit, whatever the number of ranks.
+
+  Each rank stores its slab [first ... last] plus halo rows on either
+  side (and one zero row beyond them, which the multi-step kernel
+  treats as a ghost row and never reads). Before each evolve() the
+  ranks swap their outermost halo rows with their neighbours; halo
+  rows are then enough for up to halo steps of the multi-step kernel
+  without talking again.
+
+  The swap goes pairwise, first between ranks (2i, 2i+1) and then
+  between (2i+1, 2i+2), the lower rank of a pair sending first, so it
+  cannot deadlock however little a transport buffers.
+*/
+
+SlabDistribution::SlabDistribution(Transport* init_transport,
+				   int init_delta,
+				   int init_margin,
+				   int init_halo,
+				   InitializationType structure) : delta(init_delta),
+								   margin(init_margin),
+								   halo(init_halo),
+								   transport(init_transport),
+								   stride(init_delta + 1),
+								   current(0) {
+  if (init_delta > maxdelta) throw std::invalid_argument("SLAB CONSTRUCTOR: Delta index out of range");
+  if ((init_margin < 1) || (init_halo < 1)) throw std::invalid_argument("SLAB CONSTRUCTOR: margin or halo out of range");
+  const int global_rows = 2 * margin + 3;
+  const int blocks = (global_rows + blockrows - 1) / blockrows;
+  if (transport->size > blocks) throw std::invalid_argument("SLAB CONSTRUCTOR: more ranks than row blocks");
+  first_block = (transport->rank * blocks) / transport->size;
+  end_block   = ((transport->rank + 1) * blocks) / transport->size;
+  first  = max(first_block * blockrows, 1);
+  last   = min(end_block * blockrows - 1, global_rows - 2);
+  if (last - first + 1 < halo) throw std::invalid_argument("SLAB CONSTRUCTOR: slab narrower than the halo");
+  origin = max(first - halo - 1, 0);
+  rows   = min(last + halo + 1, global_rows - 1) - origin + 1;
+  for (int buffer : {0, 1}) {
+    buffers[buffer] = new double[size_t(rows) * stride];
+    for (size_t cell = 0; cell < size_t(rows) * stride; cell++)
+      buffers[buffer][cell] = 0.0; }
+  if ((structure == identity) && (first <= margin + 1) && (margin + 1 <= last))
+    buffers[current][size_t(margin + 1 - origin) * stride] = 1.0;
+}
+
+SlabDistribution::~SlabDistribution() {
+  delete[] buffers[0];
+  delete[] buffers[1];
+}
+
+void SlabDistribution::exchange() {
+  const int rank = transport->rank;
+  const size_t length = size_t(halo) * stride * sizeof(double);
+  double* sites = buffers[current];
+  for (int phase : {0, 1}) {
+    // Lower rank of this phase's pair, if any, and whether we are it.
+    bool lower = ((rank % 2) == phase);
+    int  peer  = lower ? rank + 1 : rank - 1;
+    if ((peer < 0) || (peer >= transport->size)) continue;
+    double* outgoing = sites + size_t((lower ? last - halo + 1 : first) - origin) * stride;
+    double* incoming = sites + size_t((lower ? last + 1 : first - halo) - origin) * stride;
+    if (lower) {
+      transport->send(peer, outgoing, length);
+      transport->recv(peer, incoming, length); }
+    else {
+      transport->recv(peer, incoming, length);
+      transport->send(peer, outgoing, length); }}
+}
+
+void SlabDistribution::evolve(double adv_prob,
+			      double hon_prob,
+			      int steps) {
+  if ((steps < 1) || (steps > halo)) throw std::invalid_argument("SLAB EVOLVE: steps out of range");
+  exchange();
+  EvolveStencil stencil(delta, adv_prob, hon_prob, stride);
+  evolve_rows(buffers[current], buffers[1 - current], stencil,
+	      first - origin, last - origin, rows, steps);
+  current = 1 - current;
+}
+
+double SlabDistribution::reduce(bool positive_only) {
+  const int global_rows = 2 * margin + 3;
+  const int blocks = (global_rows + blockrows - 1) / blockrows;
+  vector<int> columns;
+  for (int transition = 0; transition <= delta; transition++)
+    columns.push_back(transition);
+  ReduceCells cells = {buffers[current], NULL, origin, size_t(stride), columns.data(), delta + 1};
+  int low = positive_only ? margin + 1 : 0;
+  vector<ReducePartial> sums(blocks, reduce_zero());
+  for (int block = first_block; block < end_block; block++)
+    sums[block] = reduce_block<false>(cells, block, low, global_rows - 1);
+
+  double result = 0.0;
+  if (transport->rank == 0) {
+    for (int peer = 1; peer < transport->size; peer++) {
+      int begin = (peer * blocks) / transport->size;
+      int end   = ((peer + 1) * blocks) / transport->size;
+      transport->recv(peer, &sums[begin], (end - begin) * sizeof(ReducePartial)); }
+    result = reduce_blocks<false>(sums);
+    for (int peer = 1; peer < transport->size; peer++)
+      transport->send(peer, &result, sizeof(result)); }
+  else {
+    transport->send(0, &sums[first_block], (end_block - first_block) * sizeof(ReducePartial));
+    transport->recv(0, &result, sizeof(result)); }
+  return(result);
+}
+
+double SlabDistribution::pdensity() {
+  return(reduce(true));
+}
+
+double SlabDistribution::tdensity() {
+  return(reduce(false));
+}
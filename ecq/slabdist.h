@@ -0,0 +1,59 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __SLABDIST_H
+#define __SLABDIST_H
+
+#include <vector>
+#include "disttools.h"
+#include "transport.h"
+
+// One process's share of an ecq distribution split by beta across the
+// ranks of a Transport. All members other than the constructor are
+// collective: every rank calls them in the same order.
+class SlabDistribution {
+
+public:
+  const int delta;
+  const int margin;   // beta ranges over [-margin ... margin]
+  const int halo;     // rows exchanged, and most steps per evolve()
+  SlabDistribution(Transport*,
+		   int,   // delta
+		   int,   // margin
+		   int,   // halo
+		   InitializationType);
+  ~SlabDistribution();
+  //
+  void   evolve(double,  // adversarial prob
+		double,  // honest prob
+		int);    // steps, at most halo
+  double pdensity();     // the global value, on every rank
+  double tdensity();
+
+private:
+  Transport* transport;
+  int        stride;
+  int        first, last;     // global rows of the slab
+  int        origin;          // global row of local row 0
+  int        rows;            // local rows, halos included
+  double*    buffers[2];
+  int        current;
+  int        first_block, end_block;  // reduction blocks of this rank
+  void   exchange();
+  double reduce(bool);        // positive only?
+};
+
+#endif
@@ -0,0 +1,169 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "streamdist.h"
+
+using namespace std;
+
+/*
+  Streaming evolution. The source file is read front to back in windows
+  of streamwindow bytes: the window ahead is requested with
+  MADV_WILLNEED while the current one is evolved, pages more than a
+  halo behind are dropped from the mapping, and finished target windows
+  are handed to writeback at once, so neither file needs to fit in
+  memory. Within a window the multi-step kernel of disttools works tile
+  by tile in cache, reading the one-row-per-step halo across window
+  boundaries straight from the mapped source.
+
+  Only rows that can hold mass are swept: mass starting in [low ...
+  high] reaches at most [low-steps ... high+steps]. Target rows that
+  held mass before but fall outside the new range are cleared.
+
+  The densities of the result are summed window by window as it is
+  written, by the tree of reduce.h, so they are those of
+  Distribution::pdensity() to the bit when margin is maxsteps.
+*/
+
+static const char   stream_magic[8] = {'E','C','Q','M','A','P','0','1'};
+static const size_t headerbytes = 4096;
+static const size_t streamwindow = 16 << 20;
+
+static void advise(void* start, size_t length, int advice) {
+  size_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t first = uintptr_t(start) & ~(page - 1);
+  uintptr_t last  = uintptr_t(start) + length;
+  if (length > 0) madvise((void*) first, last - first, advice);
+}
+
+MappedDistribution::MappedDistribution(const string& path,
+				       int init_delta,
+				       int init_margin,
+				       InitializationType structure) : delta(init_delta),
+								       margin(init_margin) {
+  if (init_delta > maxdelta) throw std::invalid_argument("MAPPED CONSTRUCTOR: Delta index out of range");
+  if (init_margin < 1) throw std::invalid_argument("MAPPED CONSTRUCTOR: margin out of range");
+  bytes = headerbytes + (size_t(2) * margin + 3) * (delta + 1) * sizeof(double);
+  fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) throw std::runtime_error("MAPPED CONSTRUCTOR: cannot create " + path + ": " + strerror(errno));
+  // A fresh file is sparse: rows read as zero and take no space until written.
+  if (ftruncate(fd, bytes) != 0) {
+    close(fd);
+    throw std::runtime_error("MAPPED CONSTRUCTOR: cannot size " + path + ": " + strerror(errno)); }
+  void* map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    throw std::runtime_error("MAPPED CONSTRUCTOR: cannot map " + path + ": " + strerror(errno)); }
+  header = (MappedHeader*) map;
+  sites  = (double*) ((char*) map + headerbytes);
+  memcpy(header->magic, stream_magic, 8);
+  header->delta  = delta;
+  header->margin = margin;
+  header->step   = 0;
+  header->low    = 0;
+  header->high   = -1;
+  header->positive = 0.0;
+  header->total    = 0.0;
+  if (structure == identity) {
+    sites[row_offset(0)] = 1.0;
+    header->high     = 0;
+    header->positive = 1.0;
+    header->total    = 1.0; }
+}
+
+MappedDistribution::~MappedDistribution() {
+  munmap(header, bytes);
+  close(fd);
+}
+
+size_t MappedDistribution::row_offset(int64_t beta) const {
+  return(size_t(beta + margin + 1) * (delta + 1));
+}
+
+int64_t MappedDistribution::step() const {
+  return(header->step);
+}
+
+double MappedDistribution::pdensity() const {
+  return(header->positive);
+}
+
+double MappedDistribution::tdensity() const {
+  return(header->total);
+}
+
+void evolve(const MappedDistribution* source,
+	    MappedDistribution* target,
+	    double adv_prob,
+	    double hon_prob,
+	    int steps) {
+  if ((target->delta != source->delta) || (target->margin != source->margin))
+    throw std::invalid_argument("STREAM EVOLVE: shape mismatch");
+  if (steps < 1) throw std::invalid_argument("STREAM EVOLVE: need at least one step");
+  const int     stride = source->delta + 1;
+  const int     rows   = 2 * source->margin + 3;
+  const int64_t old_low = target->header->low, old_high = target->header->high;
+  int64_t low  = max(source->header->low - steps, int64_t(-source->margin));
+  int64_t high = min(source->header->high + steps, int64_t(source->margin));
+  EvolveStencil stencil(source->delta, adv_prob, hon_prob, stride);
+
+  for (int64_t beta = old_low; beta <= old_high; beta++)
+    if ((beta < low) || (beta > high))
+      for (int transition = 0; transition < stride; transition++)
+	target->sites[target->row_offset(beta) + transition] = 0.0;
+
+  advise(source->sites, size_t(rows) * stride * sizeof(double), MADV_SEQUENTIAL);
+  const int window = max(int(streamwindow / (stride * sizeof(double))), 4 * steps);
+  vector<int> columns;
+  for (int transition = 0; transition < stride; transition++)
+    columns.push_back(transition);
+  ReduceCells cells = {target->sites, NULL, 0, size_t(stride), columns.data(), stride};
+  ReduceStream<false> positive, total;
+  int64_t dropped = -source->margin - 1;
+  for (int64_t first = low; first <= high; first = first + window) {
+    int64_t last  = min(first + window - 1, high);
+    int64_t ahead = min(last + window + steps, int64_t(source->margin) + 1);
+    if (last + steps < ahead)
+      advise(source->sites + source->row_offset(last + steps),
+	     (ahead - last - steps) * stride * sizeof(double), MADV_WILLNEED);
+    evolve_rows(source->sites, target->sites, stencil,
+		first + source->margin + 1, last + source->margin + 1, rows, steps);
+    for (int64_t beta = first; beta <= last; beta++) {
+      int row = int(beta + source->margin + 1);
+      ReducePartial value = reduce_row<false>(cells, row);
+      if (beta >= 0) positive.add(row, value);
+      total.add(row, value); }
+    sync_file_range(target->fd, headerbytes + target->row_offset(first) * sizeof(double),
+		    (last - first + 1) * stride * sizeof(double), SYNC_FILE_RANGE_WRITE);
+    int64_t needed = last - steps;   // the next window reads source rows from here up
+    if (needed > dropped) {
+      advise(source->sites + source->row_offset(dropped),
+	     (needed - dropped) * stride * sizeof(double), MADV_DONTNEED);
+      dropped = needed; }}
+
+  target->header->step     = source->header->step + steps;
+  target->header->low      = low;
+  target->header->high     = high;
+  target->header->positive = positive.result();
+  target->header->total    = total.result();
+}
@@ -0,0 +1,67 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __STREAMDIST_H
+#define __STREAMDIST_H
+
+#include <string>
+#include <cstdint>
+#include "disttools.h"
+
+// Header page of a state file; the rows start one page in.
+struct MappedHeader {
+  char    magic[8];     // "ECQMAP01"
+  int32_t delta;
+  int32_t margin;       // beta ranges over [-margin ... margin]
+  int64_t step;
+  int64_t low, high;    // all mass lies in beta [low ... high]
+  double  positive;     // mass at beta >= 0
+  double  total;
+};
+
+// An ecq distribution kept in a memory-mapped file, for margins that
+// do not fit in memory (or in the static Distribution). The margin is
+// chosen at run time; rows use the compact stride delta+1 with one
+// ghost row at either end, as in EvolutionPool.
+class MappedDistribution {
+
+public:
+  const int delta;
+  const int margin;
+  MappedDistribution(const std::string&,     // path, created or truncated
+		     int,                    // delta
+		     int,                    // margin
+		     InitializationType);
+  ~MappedDistribution();
+  //
+  int64_t step() const;
+  double  pdensity() const;
+  double  tdensity() const;
+  friend void evolve(const MappedDistribution*,  // source
+		     MappedDistribution*,        // target, overwritten
+		     double,  // adversarial prob
+		     double,  // honest prob
+		     int);    // steps
+
+private:
+  int           fd;
+  size_t        bytes;
+  MappedHeader* header;
+  double*       sites;    // row r holds beta = r - margin - 1
+  size_t        row_offset(int64_t) const;  // beta -> index of its first cell
+};
+
+#endif
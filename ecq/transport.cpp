@@ -0,0 +1,257 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "transport.h"
+
+using namespace std;
+
+//class Transport
+
+Transport::Transport(int init_rank, int init_size) : rank(init_rank),
+						     size(init_size) {
+  if ((init_size < 1) || (init_rank < 0) || (init_rank >= init_size))
+    throw std::invalid_argument("TRANSPORT: rank out of range");
+}
+
+Transport::~Transport() {}
+
+// Neighbouring slabs exchange halos; rank 0 gathers the reductions.
+bool Transport::linked(int a, int b) {
+  return((a != b) && ((abs(a - b) == 1) || (a == 0) || (b == 0)));
+}
+
+//class ShmTransport
+
+/* The mailbox from rank a to rank b is boxes[a * size + b]. A message
+   longer than a slot goes in slot-sized pieces, each handed over with
+   the full/empty semaphore pair, so both sides cut it the same way. */
+
+size_t ShmTransport::segment_bytes(int size) {
+  return(size_t(size) * size * sizeof(Mailbox));
+}
+
+void ShmTransport::create(const string& name, int size) {
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) throw std::runtime_error("SHM TRANSPORT: cannot create " + name + ": " + strerror(errno));
+  if (ftruncate(fd, segment_bytes(size)) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("SHM TRANSPORT: cannot size " + name); }
+  void* map = mmap(NULL, segment_bytes(size), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name.c_str());
+    throw std::runtime_error("SHM TRANSPORT: cannot map " + name); }
+  Mailbox* boxes = (Mailbox*) map;
+  for (int box = 0; box < size * size; box++) {
+    sem_init(&boxes[box].full, 1, 0);
+    sem_init(&boxes[box].empty, 1, 1); }
+  munmap(map, segment_bytes(size));
+}
+
+void ShmTransport::destroy(const string& name) {
+  shm_unlink(name.c_str());
+}
+
+ShmTransport::ShmTransport(const string& name,
+			   int init_rank,
+			   int init_size) : Transport(init_rank, init_size),
+					    bytes(segment_bytes(init_size)) {
+  int fd = shm_open(name.c_str(), O_RDWR, 0600);
+  if (fd < 0) throw std::runtime_error("SHM TRANSPORT: cannot open " + name + ": " + strerror(errno));
+  void* map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) throw std::runtime_error("SHM TRANSPORT: cannot map " + name);
+  boxes = (Mailbox*) map;
+}
+
+ShmTransport::~ShmTransport() {
+  munmap(boxes, bytes);
+}
+
+static void sem_take(sem_t* semaphore) {
+  while (sem_wait(semaphore) != 0)
+    if (errno != EINTR) throw std::runtime_error("SHM TRANSPORT: semaphore failed");
+}
+
+void ShmTransport::send(int peer, const void* message, size_t length) {
+  Mailbox* box = &boxes[rank * size + peer];
+  const char* from = (const char*) message;
+  do {
+    size_t piece = min(length, slotbytes);
+    sem_take(&box->empty);
+    memcpy(box->data, from, piece);
+    box->length = piece;
+    sem_post(&box->full);
+    from = from + piece;
+    length = length - piece;
+  } while (length > 0);
+}
+
+void ShmTransport::recv(int peer, void* message, size_t length) {
+  Mailbox* box = &boxes[peer * size + rank];
+  char* to = (char*) message;
+  do {
+    sem_take(&box->full);
+    if (box->length != min(length, slotbytes)) {
+      sem_post(&box->empty);
+      throw std::runtime_error("SHM TRANSPORT: message length mismatch"); }
+    memcpy(to, box->data, box->length);
+    to = to + box->length;
+    length = length - box->length;
+    sem_post(&box->empty);
+  } while (length > 0);
+}
+
+//class TcpTransport
+
+static void split_address(const string& address, string& host, string& port) {
+  size_t colon = address.rfind(':');
+  if (colon == string::npos) throw std::invalid_argument("TCP TRANSPORT: expected host:port, got " + address);
+  host = address.substr(0, colon);
+  port = address.substr(colon + 1);
+}
+
+static void no_delay(int socket) {
+  int one = 1;
+  setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+static void write_all(int socket, const void* data, size_t length) {
+  const char* from = (const char*) data;
+  while (length > 0) {
+    ssize_t sent = ::send(socket, from, length, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error("TCP TRANSPORT: send failed: " + string(strerror(errno))); }
+    from = from + sent;
+    length = length - sent; }
+}
+
+static void read_all(int socket, void* data, size_t length) {
+  char* to = (char*) data;
+  while (length > 0) {
+    ssize_t got = ::recv(socket, to, length, 0);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      throw std::runtime_error("TCP TRANSPORT: receive failed: " + string(strerror(errno))); }
+    if (got == 0) throw std::runtime_error("TCP TRANSPORT: peer closed the connection");
+    to = to + got;
+    length = length - got; }
+}
+
+TcpTransport::TcpTransport(int init_rank,
+			   const vector<string>& addresses) : Transport(init_rank, addresses.size()),
+							      sockets(addresses.size(), -1) {
+  string host, port;
+  struct addrinfo hints, *found;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family   = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  split_address(addresses[rank], host, port);
+  hints.ai_flags = AI_PASSIVE;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0)
+    throw std::runtime_error("TCP TRANSPORT: cannot resolve " + addresses[rank]);
+  int listener = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+  int one = 1;
+  if (listener >= 0) setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if ((listener < 0) || (bind(listener, found->ai_addr, found->ai_addrlen) != 0)
+      || (listen(listener, size) != 0)) {
+    if (listener >= 0) close(listener);
+    freeaddrinfo(found);
+    throw std::runtime_error("TCP TRANSPORT: cannot listen on " + addresses[rank]); }
+  freeaddrinfo(found);
+  hints.ai_flags = 0;
+
+  // The destructor does not run for a constructor that throws: close
+  // what is open here.
+  try {
+    // Connect downwards, retrying while the peer is still starting up.
+    for (int peer = 0; peer < rank; peer++)
+      if (linked(rank, peer)) {
+	split_address(addresses[peer], host, port);
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0)
+	  throw std::runtime_error("TCP TRANSPORT: cannot resolve " + addresses[peer]);
+	int connection = -1;
+	for (int attempt = 0; (connection < 0) && (attempt < 600); attempt++) {
+	  connection = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+	  if (connect(connection, found->ai_addr, found->ai_addrlen) != 0) {
+	    close(connection);
+	    connection = -1;
+	    usleep(100000); }}
+	freeaddrinfo(found);
+	if (connection < 0) throw std::runtime_error("TCP TRANSPORT: cannot reach " + addresses[peer]);
+	sockets[peer] = connection;
+	no_delay(connection);
+	int32_t me = rank;
+	write_all(connection, &me, sizeof(me)); }
+
+    // Accept the higher ranks, which say who they are.
+    int expected = 0;
+    for (int peer = rank + 1; peer < size; peer++)
+      if (linked(rank, peer)) expected++;
+    while (expected > 0) {
+      int connection = accept(listener, NULL, NULL);
+      if (connection < 0) {
+	if (errno == EINTR) continue;
+	throw std::runtime_error("TCP TRANSPORT: accept failed"); }
+      int32_t peer = -1;
+      try {
+	read_all(connection, &peer, sizeof(peer)); }
+      catch (...) {
+	close(connection);
+	throw; }
+      if ((peer <= rank) || (peer >= size) || !linked(rank, peer) || (sockets[peer] >= 0)) {
+	close(connection);
+	throw std::runtime_error("TCP TRANSPORT: unexpected peer"); }
+      no_delay(connection);
+      sockets[peer] = connection;
+      expected--; }}
+  catch (...) {
+    close(listener);
+    for (int peer = 0; peer < size; peer++)
+      if (sockets[peer] >= 0) close(sockets[peer]);
+    throw; }
+  close(listener);
+}
+
+TcpTransport::~TcpTransport() {
+  for (int connection : sockets)
+    if (connection >= 0) close(connection);
+}
+
+void TcpTransport::send(int peer, const void* message, size_t length) {
+  if (sockets[peer] < 0) throw std::invalid_argument("TCP TRANSPORT: no link to peer");
+  write_all(sockets[peer], message, length);
+}
+
+void TcpTransport::recv(int peer, void* message, size_t length) {
+  if (sockets[peer] < 0) throw std::invalid_argument("TCP TRANSPORT: no link to peer");
+  read_all(sockets[peer], message, length);
+}
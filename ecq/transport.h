@@ -0,0 +1,83 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __TRANSPORT_H
+#define __TRANSPORT_H
+
+#include <string>
+#include <vector>
+#include <semaphore.h>
+
+// Point-to-point messages between the processes of one evolution,
+// numbered 0 ... size-1. A message is received with the length it was
+// sent with; messages between two processes arrive in order.
+class Transport {
+public:
+  const int rank;
+  const int size;
+  Transport(int,   // rank
+	    int);  // size
+  virtual ~Transport();
+  virtual void send(int,             // peer
+		    const void*,
+		    size_t) = 0;
+  virtual void recv(int,             // peer
+		    void*,
+		    size_t) = 0;
+  static bool linked(int, int);      // does the evolution talk between these ranks?
+};
+
+// Processes on one host, through a POSIX shared memory segment holding
+// a one-slot mailbox per ordered pair of ranks. The segment is created
+// once, before the ranks attach to it, and removed after they are done.
+class ShmTransport : public Transport {
+public:
+  static const size_t slotbytes = 256 * 1024;
+  static void create(const std::string&,  // segment name, "/..."
+		     int);                // size
+  static void destroy(const std::string&);
+  ShmTransport(const std::string&,        // segment name
+	       int,                       // rank
+	       int);                      // size
+  ~ShmTransport();
+  void send(int, const void*, size_t);
+  void recv(int, void*, size_t);
+private:
+  struct Mailbox {
+    sem_t  full;
+    sem_t  empty;
+    size_t length;
+    char   data[slotbytes];
+  };
+  Mailbox* boxes;
+  size_t   bytes;
+  static size_t segment_bytes(int);
+};
+
+// Processes anywhere, over TCP. Every rank listens on its own entry of
+// the host:port list and connects to the lower ranks it talks to.
+class TcpTransport : public Transport {
+public:
+  TcpTransport(int,                                 // rank
+	       const std::vector<std::string>&);    // host:port of every rank
+  ~TcpTransport();
+  void send(int, const void*, size_t);
+  void recv(int, void*, size_t);
+private:
+  std::vector<int> sockets;  // by peer rank, -1 where not linked
+};
+
+#endif
@@ -18,6 +18,8 @@ limitations under the License.
 #include <stdexcept>
 #include <cmath>
 #include "barriertools.h"
+#include "markov.h"
+#include "history.h"
 
 using namespace std;
 
@@ -72,31 +74,53 @@ void BarrierDistribution::set(int beta, double value) {
   sites[rcheck(beta)] = value;
 }
 
-double BarrierDistribution::evolve_reflection(int beta) const {
-  if (beta > 0)
-    return(p * get(beta-1) + (1-p) * get(beta+1));
-  if (beta == 0)
-    return((1-p) * (get(0) + get(1)));
-  else
-    throw std::invalid_argument("distribution index out of range");
-}
+/* The chain of markov.h for pos: a single phase, an honest outcome
+   moving up with probability p and one moving down with 1-p, and no
+   adversarial one. Beta = 0 is the barrier. With reflection a particle
+   there asked to move down stays put; with absorption it stays in any
+   case, and row 0 is computed here, in the form the walk has always
+   used. What would move beyond footprint is lost. */
 
-double BarrierDistribution::evolve_absorbtion(int beta) const {
-  if (beta > 1)
-    return(p * get(beta-1) + (1-p) * get(beta+1));
-  if (beta == 1)
-    return((1-p) * get(2));
-  if (beta == 0)
-    return(get(0) + (1-p)*get(1));
-  else
-    throw std::invalid_argument("distribution index out of range");
+class PosChain {
+public:
+  PosChain(double init_p,
+	   EvolutionType init_convention) : p(init_p), convention(init_convention) {}
+  int    phases() const { return(1); }
+  int    column(int) const { return(0); }
+  int    honest_outcomes() const { return(2); }
+  double honest_weight(int down) const { return(down ? 1-p : p); }
+  int    adversarial_outcomes() const { return(1); }
+  double adversarial_weight(int) const { return(1.0); }
+  MarkovMove move(int, int down) const {
+    MarkovMove result = {0, down ? -1 : 1};
+    return(result);
+  }
+  int    barrier() const { return(1); }
+  int    land(int, MarkovMove move, int) const {
+    if (convention == absorb) return(-1);
+    return((move.shift > 0) ? 1 : 0);
+  }
+  int    first_regular() const { return(1); }
+  int    last_regular(int) const { return(footprint); }
+  bool   fold() const { return(false); }
+  int    fixed_rows() const { return(1); }
+  double fixed(const double* source, int, int, int) const {
+    if (convention == reflect)
+      return((1-p) * (source[0] + source[1]));
+    else
+      return(source[0] + (1-p)*source[1]);
+  }
+private:
+  const double        p;
+  const EvolutionType convention;
+};
+
+const double* BarrierDistribution::site_data() const {
+  return(sites);
 }
 
 double BarrierDistribution::pdensity() const {
-  double result = 0.0;
-  int beta;
-  for(beta = 1; beta <= footprint; beta++)
-    result = result + get(beta);
+  double result = markov_sum(sites, 1, 1, footprint, markov_columns(PosChain(p,reflect)));
   if (result < 1)
     return(result);
   else
@@ -104,11 +128,7 @@ double BarrierDistribution::pdensity() const {
 }
 
 double BarrierDistribution::tdensity() const {
-  double result = 0.0;
-  int beta;
-  for(beta = 0; beta <= footprint; beta++)
-    result = result + get(beta);
-  return(result);
+  return(markov_sum(sites, 1, 0, footprint, markov_columns(PosChain(p,reflect))));
 }
 
 double BarrierDistribution::stationary(int t) const {
@@ -142,18 +162,20 @@ BarrierDistribution::BarrierDistribution(double parameter,
 }
 
 BarrierDistribution::BarrierDistribution(BarrierDistribution const &prev, EvolutionType eselect) : p(prev.p) {
-  int beta;
-  set(footprint,0);
-  if (eselect == reflect) {
-    for(beta = 0; beta < footprint; beta++)
-      set(beta,prev.evolve_reflection(beta));
-    set(footprint,0.0); }
-  else if (eselect == absorb) {
-    for(beta = 0; beta < footprint; beta++)
-      set(beta,prev.evolve_absorbtion(beta));
-    set(footprint,0.0); }
-  else     
-    std::invalid_argument("evolution type unknown");
+  evolve(&prev,this,eselect);
+}
+
+// The evolution of the constructor above, into an existing distribution.
+void evolve(const BarrierDistribution* prev,
+	    BarrierDistribution* result,
+	    EvolutionType eselect) {
+  if (result->p != prev->p) throw std::invalid_argument("evolution target has another p");
+  if ((eselect != reflect) && (eselect != absorb))
+    throw std::invalid_argument("evolution type unknown");
+  PosChain chain(prev->p,eselect);
+  MarkovStencil stencil(chain,1);
+  markov_evolve(chain,stencil,prev->sites,result->sites,0,footprint-1);
+  result->set(footprint,0.0);
 }
 
 BarrierDistribution* translate(const BarrierDistribution* source,
@@ -169,11 +191,67 @@ BarrierDistribution* convolve(const BarrierDistribution* term1,
 			      const BarrierDistribution* term2) {
   BarrierDistribution* result;
   result = new BarrierDistribution(term1->p,zero);
-  for (int i=0; i <= footprint; i++) {
-    for (int j=0; j <= (footprint-i); j++) {
-      result->set(i+j,result->get(i+j) + term1->get(i)*term2->get(j) );
-    }}
+  markov_convolve(term1->sites,result->sites,1,footprint+1,
+		  markov_columns(PosChain(term1->p,reflect)),term2->sites);
   /* for (int i = 0; i <= footprint; i++)
      if (result->get(i) > 1) result->set(i,1); */
   return(result);
 }
+
+DensityBounds spike_bounds(const BarrierDistribution* stationary,
+			   int k,
+			   int w) {
+  BarrierDistribution spikes(stationary->p,spike,k);
+  // The start is the stationary distribution shifted by the spike, so
+  // its generating function is the product of theirs.
+  vector<pair<int, double> > logs[2];
+  const double* sites[2] = {stationary->site_data(), spikes.site_data()};
+  for (int factor = 0; factor < 2; factor++)
+    for (int beta = 0; beta <= footprint; beta++)
+      if (sites[factor][beta] > 0) logs[factor].push_back(make_pair(beta, log(sites[factor][beta])));
+  BoundStart start = [&logs](double theta) {
+    double result = 0;
+    for (int factor = 0; factor < 2; factor++) {
+      vector<double> terms;
+      for (const pair<int, double>& site : logs[factor])
+	terms.push_back(site.second + theta * site.first);
+      result = result + bound_log_sum(terms); }
+    return(vector<double>(1, result)); };
+  BoundWalk walk(PosChain(stationary->p,absorb));
+  DensityBounds result = {1 - walk.reach_below(start, 0, w), walk.upper_tail(start, 1, w)};
+  return(result);
+}
+
+EvolutionHistory* history_for(double p,
+			      int k,
+			      int spacing,
+			      size_t budget) {
+  return(new EvolutionHistory(1, spacing, budget, {{"p", p}, {"k", double(k)}}));
+}
+
+void history_keyframe(EvolutionHistory& history,
+		      int step,
+		      const BarrierDistribution* dist) {
+  if (history.row_width() != 1) throw std::invalid_argument("HISTORY: not a pos history");
+  history.keyframe(step, dist->site_data(), footprint + 1, 1);
+}
+
+BarrierDistribution* history_replay(const EvolutionHistory& history,
+				    int step,
+				    int* replayed) {
+  if (history.row_width() != 1) throw std::runtime_error("HISTORY: not a pos history");
+  double p = history.param("p");
+  BarrierDistribution* distributions[2] = {new BarrierDistribution(p,zero), new BarrierDistribution(p,zero)};
+  int from;
+  try {
+    from = history.restore(step, distributions[0]->sites, footprint + 1, 1); }
+  catch (...) {
+    delete(distributions[0]);
+    delete(distributions[1]);
+    throw; }
+  for (int at = from; at < step; at++)
+    evolve(distributions[(at - from) % 2], distributions[(at - from + 1) % 2], absorb);
+  if (replayed != NULL) *replayed = step - from;
+  delete(distributions[1 - (step - from) % 2]);
+  return(distributions[(step - from) % 2]);
+}
@@ -17,12 +17,17 @@ limitations under the License.
 #ifndef __BARRIER_H
 #define __BARRIER_H
 
+#include <cstddef>
+#include "bound.h"
+
 enum EvolutionType {reflect, absorb};
 enum InitialType   {zero, stable, spike};
 
 const int maxsteps = 2200;
 const int footprint = maxsteps + 1;
 
+class EvolutionHistory;
+
 class BarrierDistribution {
   
 public:
@@ -31,21 +36,52 @@ public:
   void show() const;  
   double pdensity() const;
   double tdensity() const;
+  const double* site_data() const;  // sites, read-only
   const double p;
   friend BarrierDistribution* convolve(const BarrierDistribution*,
 				       const BarrierDistribution*);
   friend BarrierDistribution* translate(const BarrierDistribution*,
 					int);
+  friend void evolve(const BarrierDistribution*,  // source
+		     BarrierDistribution*,        // target, same p
+		     EvolutionType);
+  friend BarrierDistribution* history_replay(const EvolutionHistory&,
+					     int,
+					     int*);
   
 private:
   double sites[footprint + 1];
   int    rcheck(int) const;
   double stationary(int) const;
   double spikedist(int,int) const;
-  double evolve_absorbtion(int) const;
-  double evolve_reflection(int) const;
   double get(int) const;
   void   set(int, double);
 };
 
+// Bounds on the probability after w absorbing steps from the spike k
+// on a stationary distribution, before the convolution (bound.h): the
+// walk is at least 1 at step w, and does not reach 0 on the way.
+DensityBounds spike_bounds(const BarrierDistribution*,  // stationary
+			   int,                         // k
+			   int);                        // w
+
+// A history (history.h) of the absorbing walk from the spike k on the
+// stationary distribution of p: the parameters its replays need.
+EvolutionHistory* history_for(double,   // p
+			      int,      // k
+			      int,      // spacing
+			      size_t);  // budget, bytes
+
+// Takes the distribution after step steps as a keyframe of the history.
+void history_keyframe(EvolutionHistory&,
+		      int,                           // step
+		      const BarrierDistribution*);
+
+// The distribution after step absorbing steps, the keyframe at or
+// before it evolved the rest of the way (replayed, if given, is set to
+// how many steps that took). The caller deletes it.
+BarrierDistribution* history_replay(const EvolutionHistory&,
+				    int,              // step
+				    int* replayed = NULL);
+
 #endif
@@ -0,0 +1,99 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "barriertools.h"
+#include "bench.h"
+
+using namespace std;
+
+/*
+  Times the pos kernels: the absorb and reflect evolution constructors,
+  convolve (of the stationary distribution with a spike) and pdensity,
+  then the absorb constructor again as throughput of independent walks
+  on 1, 2, 4 ... threads. An update is one site of the result; the
+  bytes are one read and one write of each site (a read of both terms
+  for convolve, though it does footprint times that work; a read for
+  pdensity). There is no delta here and maxsteps is a compile-time
+  constant, so only p varies.
+*/
+
+int main(int argc, char **argv)
+{
+  string output = "bench-pos.json", baseline;
+  double noise = 0.10, min_seconds = 0.5;
+  bool quick = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "o:c:n:t:q")) != -1)
+    if (option == 'o') output = optarg;
+    else if (option == 'c') baseline = optarg;
+    else if (option == 'n') noise = atof(optarg);
+    else if (option == 't') min_seconds = atof(optarg);
+    else if (option == 'q') quick = true;
+    else {
+      cout << "Usage: " << argv[0] << " [-q] [-t seconds_per_case] [-o results.json] [-c baseline.json [-n noise]]" << endl;
+      cout << "  -q  fewer cases;  -c  flag cases slower than the baseline by more than noise (default 0.10)" << endl;
+      return 1; }
+
+  BenchReport report("pos");
+  report.measure_stream(thread_counts());
+
+  double updates = footprint + 1;
+  vector<double> ps = quick ? vector<double>{0.4} : vector<double>{0.3, 0.4, 0.45};
+  for (double p : ps) {
+    string params = "p=" + to_string(p).substr(0, 4);
+    BarrierDistribution* stationary = new BarrierDistribution(p,stable);
+    BarrierDistribution* spikeshift = new BarrierDistribution(p,spike,10);
+
+    report.add({"absorb", params, 1,
+	  time_throughput(1, [&](int) { BarrierDistribution next(*stationary,absorb); }, min_seconds),
+	  updates, 16 * updates});
+    report.add({"reflect", params, 1,
+	  time_throughput(1, [&](int) { BarrierDistribution next(*stationary,reflect); }, min_seconds),
+	  updates, 16 * updates});
+    report.add({"convolve", params, 1,
+	  time_throughput(1, [&](int) { delete(convolve(stationary,spikeshift)); }, min_seconds),
+	  updates, 24 * updates});
+    report.add({"pdensity", params, 1,
+	  time_kernel([&] { stationary->pdensity(); }, min_seconds),
+	  updates, 8 * updates});
+    delete(stationary);
+    delete(spikeshift); }
+
+  // Throughput of independent walks, as a sweep runs them.
+  for (int threads : thread_counts()) {
+    vector<BarrierDistribution*> walks;
+    for (int thread = 0; thread < threads; thread++)
+      walks.push_back(new BarrierDistribution(0.4,stable));
+    report.add({"absorb", "p=0.40 independent", threads,
+	  time_throughput(threads, [&](int thread) { BarrierDistribution next(*walks[thread],absorb); }, min_seconds),
+	  updates, 16 * updates});
+    for (BarrierDistribution* walk : walks)
+      delete(walk); }
+
+  ofstream json(output.c_str());
+  report.write(json);
+  json.close();
+  cout << "Results in " << output << endl;
+  if (!baseline.empty())
+    return(report.compare(baseline, noise, cout) > 0 ? 1 : 0);
+  return 0;
+}
@@ -0,0 +1,144 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "barriertools.h"
+#include "batch.h"
+#include "conform.h"
+
+using namespace std;
+
+/*
+  Checks pos and posthr against the reference runs in conformance.txt,
+  job records as posbatch takes, each with its golden results:
+
+    tool=pos ... densities=d1,d2,...   the density after each step
+    tool=posthr ... steps=s1,s2,...    the count posthr prints for each
+                                       quota, or -1 for an underflow
+
+  Records with fast=1 make up the default subset; -f runs them all.
+  Densities conform within the -r and -a tolerances, step counts
+  exactly. Reflect evolution conserves mass, so each spike start is
+  also walked `mass_steps' reflecting steps, checking tdensity()
+  against its starting value within -m. -u writes the records back
+  with freshly computed golden values.
+*/
+
+static Tolerance tolerance = {1e-9, 1e-15};
+static double mass_allowed = 1e-12;
+static const int mass_steps = 50;
+
+static BarrierDistribution* start_for(double p, int k) {
+  BarrierDistribution* stationary = new BarrierDistribution(p,stable);
+  BarrierDistribution* spikeshift = new BarrierDistribution(p,spike,k);
+  BarrierDistribution* start = convolve(stationary,spikeshift);
+  delete(stationary);
+  delete(spikeshift);
+  return(start);
+}
+
+static void check_mass(const JobRecord& job, const BarrierDistribution* start, ConformReport& report) {
+  double mass = start->tdensity();
+  BarrierDistribution* current = new BarrierDistribution(*start,reflect);
+  for (int step = 1; step <= mass_steps; step++) {
+    report.invariant(job.lead() + " mass after reflect step " + to_string(step),
+		     mass, current->tdensity(), mass_allowed);
+    BarrierDistribution* next = new BarrierDistribution(*current,reflect);
+    delete(current);
+    current = next; }
+  delete(current);
+}
+
+// Runs one record, giving the golden field's name and computed values.
+static string run_case(const JobRecord& job, ConformReport& report, vector<double>& computed) {
+  string tool = job.text("tool");
+  if ((tool != "pos") && (tool != "posthr")) throw std::invalid_argument("CONFORM: unknown tool " + tool);
+  double p = job.number("p");
+  int w = job.integer("w");
+  if ((w < 1) || (w > maxsteps)) throw std::invalid_argument("CONFORM: w out of range");
+  int k_lower = job.integer((tool == "pos") ? "k" : "k_lower");
+  int k_upper = job.integer((tool == "pos") ? "k" : "k_upper");
+  double threshold = job.number("threshold", 0);
+  computed.clear();
+  for (int k = k_lower; k <= k_upper; k++) {
+    BarrierDistribution* current = start_for(p, k);
+    check_mass(job, current, report);
+    double density = 1;
+    int step;
+    for (step = 1; step <= w; step++) {
+      BarrierDistribution* next = new BarrierDistribution(*current,absorb);
+      delete(current);
+      current = next;
+      density = current->pdensity();
+      if (tool == "pos")
+	computed.push_back(density);
+      else if (density <= threshold)
+	break; }
+    delete(current);
+    if (tool == "posthr")
+      computed.push_back((density <= threshold) ? step + 1 : -1); }
+  return((tool == "pos") ? "densities" : "steps");
+}
+
+int main(int argc, char **argv)
+{
+  string golden = "conformance.txt";
+  bool full = false, update = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "g:r:a:m:fu")) != -1)
+    if (option == 'g') golden = optarg;
+    else if (option == 'r') tolerance.relative = atof(optarg);
+    else if (option == 'a') tolerance.absolute = atof(optarg);
+    else if (option == 'm') mass_allowed = atof(optarg);
+    else if (option == 'f') full = true;
+    else if (option == 'u') update = true;
+    else {
+      cout << "Usage: " << argv[0] << " [-f] [-g golden] [-r relative] [-a absolute] [-m mass] [-u]" << endl;
+      cout << "  -f  all reference runs, not just the fast subset;  -u  write the records with fresh golden values" << endl;
+      return 1; }
+
+  ifstream in(golden.c_str());
+  if (!in) {
+    cerr << "Cannot read " << golden << endl;
+    return 1; }
+  ConformReport report(update ? cerr : cout);
+  string line;
+  while (getline(in, line)) {
+    if (JobRecord::blank(line)) {
+      if (update) cout << line << "\n";
+      continue; }
+    JobRecord job(line);
+    if (!full && !update && (job.integer("fast", 0) == 0)) continue;
+    vector<double> computed;
+    string field = run_case(job, report, computed);
+    if (update) {
+      cout << without_field(line, field) << " " << field << "=" << golden_text(computed) << "\n" << std::flush;
+      continue; }
+    vector<double> expected = golden_list(job.text(field));
+    report.value(job.lead() + " result count", expected.size(), computed.size(), Tolerance{0, 0});
+    for (size_t at = 0; (at < expected.size()) && (at < computed.size()); at++)
+      report.value(job.lead() + " " + field + "[" + to_string(at) + "]", expected[at], computed[at],
+		   (field == "steps") ? Tolerance{0, 0} : tolerance);
+    cout << job.lead() << ": " << computed.size() << " results checked" << endl; }
+  return(report.finish(full ? "pos conformance (full)" : "pos conformance (fast)"));
+}
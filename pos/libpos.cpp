@@ -0,0 +1,113 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <string>
+#include <stdexcept>
+#include "barriertools.h"
+#include "libpos.h"
+
+using namespace std;
+
+static thread_local string last_error;
+
+static const BarrierDistribution* unwrap(const pos_distribution* distribution) {
+  if (distribution == NULL) throw std::invalid_argument("POS: NULL distribution");
+  return(reinterpret_cast<const BarrierDistribution*>(distribution));
+}
+
+static BarrierDistribution* unwrap(pos_distribution* distribution) {
+  if (distribution == NULL) throw std::invalid_argument("POS: NULL distribution");
+  return(reinterpret_cast<BarrierDistribution*>(distribution));
+}
+
+static pos_distribution* wrap(BarrierDistribution* distribution) {
+  return(reinterpret_cast<pos_distribution*>(distribution));
+}
+
+template <class Value> static Value* result_pointer(Value* pointer) {
+  if (pointer == NULL) throw std::invalid_argument("POS: NULL result pointer");
+  return(pointer);
+}
+
+SPIKE_EXPORT int pos_abi_version(void) {
+  return(SPIKE_ABI_VERSION);
+}
+
+SPIKE_EXPORT const char* pos_last_error(void) {
+  return(last_error.c_str());
+}
+
+SPIKE_EXPORT int pos_create(double p, int initial, int shift, pos_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	if (!((p > 0) && (p < 1))) throw std::invalid_argument("POS: p out of range");
+	if ((initial != POS_ZERO) && (initial != POS_STABLE) && (initial != POS_SPIKE))
+	  throw std::invalid_argument("POS: unknown initial distribution");
+	if (shift < 0) throw std::invalid_argument("POS: negative shift");
+	InitialType selection = (initial == POS_ZERO) ? zero : (initial == POS_STABLE) ? stable : spike;
+	*result_pointer(created) = wrap(new BarrierDistribution(p, selection, shift)); }));
+}
+
+SPIKE_EXPORT int pos_copy(const pos_distribution* source, pos_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(created) = wrap(new BarrierDistribution(*unwrap(source))); }));
+}
+
+SPIKE_EXPORT void pos_destroy(pos_distribution* distribution) {
+  delete(reinterpret_cast<BarrierDistribution*>(distribution));
+}
+
+SPIKE_EXPORT int pos_evolve(const pos_distribution* source, pos_distribution* target, int evolution) {
+  return(cabi_guard(last_error, [&] {
+	if ((evolution != POS_REFLECT) && (evolution != POS_ABSORB)) throw std::invalid_argument("POS: unknown evolution");
+	if (source == target) throw std::invalid_argument("POS: evolution target is the source");
+	evolve(unwrap(source), unwrap(target), (evolution == POS_REFLECT) ? reflect : absorb); }));
+}
+
+SPIKE_EXPORT int pos_convolve(const pos_distribution* a, const pos_distribution* b, pos_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(created) = wrap(convolve(unwrap(a), unwrap(b))); }));
+}
+
+SPIKE_EXPORT int pos_translate(const pos_distribution* source, int k, pos_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	if (k < 0) throw std::invalid_argument("POS: negative translation");
+	*result_pointer(created) = wrap(translate(unwrap(source), k)); }));
+}
+
+SPIKE_EXPORT int pos_pdensity(const pos_distribution* distribution, double* density) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(density) = unwrap(distribution)->pdensity(); }));
+}
+
+SPIKE_EXPORT int pos_tdensity(const pos_distribution* distribution, double* density) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(density) = unwrap(distribution)->tdensity(); }));
+}
+
+SPIKE_EXPORT int pos_view(const pos_distribution* distribution, spike_view* view) {
+  return(cabi_guard(last_error, [&] {
+	const BarrierDistribution* source = unwrap(distribution);
+	spike_view* result = result_pointer(view);
+	result->data = source->site_data();
+	result->rank = 1;
+	result->shape[0] = footprint + 1;
+	result->shape[1] = 1;
+	result->strides[0] = sizeof(double);
+	result->strides[1] = sizeof(double);
+	result->used[0] = footprint + 1;
+	result->used[1] = 1; }));
+}
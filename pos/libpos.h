@@ -0,0 +1,66 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __LIBPOS_H
+#define __LIBPOS_H
+
+/*
+  C interface to the pos barrier distributions, built as libpos.so.
+  Result codes and views are those of cabi.h. Distributions made here
+  are freed with pos_destroy(); pointer arguments may not be NULL.
+
+  A view has rank 1, indexed by beta in [0 ... 2201] (maxsteps + 1,
+  fixed at build time); all of it is used.
+*/
+
+#include "cabi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pos_distribution pos_distribution;
+
+#define POS_ZERO     0
+#define POS_STABLE   1
+#define POS_SPIKE    2
+
+#define POS_REFLECT  0
+#define POS_ABSORB   1
+
+int         pos_abi_version(void);
+const char* pos_last_error(void);
+
+/* A distribution for parameter p, one of POS_ZERO, POS_STABLE or
+   POS_SPIKE; shift only matters to the spike. */
+int  pos_create(double p, int initial, int shift, pos_distribution** created);
+int  pos_copy(const pos_distribution* source, pos_distribution** created);
+void pos_destroy(pos_distribution* distribution);
+
+/* One step from source into target, which must have the same p. */
+int  pos_evolve(const pos_distribution* source, pos_distribution* target, int evolution);
+int  pos_convolve(const pos_distribution* a, const pos_distribution* b, pos_distribution** created);
+int  pos_translate(const pos_distribution* source, int k, pos_distribution** created);
+
+int  pos_pdensity(const pos_distribution* distribution, double* density);
+int  pos_tdensity(const pos_distribution* distribution, double* density);
+int  pos_view(const pos_distribution* distribution, spike_view* view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
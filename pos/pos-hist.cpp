@@ -0,0 +1,85 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <unistd.h>
+#include "barriertools.h"
+#include "history.h"
+
+using namespace std;
+
+/*
+  Looks at the distributions of a finished pos run again, from the
+  history it kept (pos -y): for each step asked for, the uncaptured
+  probability as pos prints it, and with -a the sites that hold some
+  mass, "beta : probability". Each step is replayed from the keyframe
+  before it, at most the history's spacing less one steps; a density
+  the run recorded at the step is checked against the replayed one.
+*/
+
+int main(int argc, char **argv)
+{
+  bool sites = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "a")) != -1)
+    if (option == 'a') sites = true;
+    else {
+      argc = 0;
+      break; }
+  if (argc - optind < 2) {
+    cout << "Usage: " << argv[0] << " [-a] <history> <step> ..." << endl;
+    cout << "  -a  with each density, the sites of the distribution that hold some mass" << endl;
+    return 0;
+  }
+
+  EvolutionHistory history(argv[optind]);
+  cout << "p = " << history.param("p") << ", k = " << history.param("k") << endl;
+  cout << "steps " << history.first() << " to " << history.latest() << ", "
+       << history.keyframes() << " keyframes every " << history.every() << " steps" << endl;
+  cout << "Results, of form (length, uncaptured probability)." << "\n";
+
+  int failed = 0;
+  for (int arg = optind + 1; arg < argc; arg++) {
+    int step = atoi(argv[arg]);
+    BarrierDistribution* dist;
+    try {
+      dist = history_replay(history, step); }
+    catch (std::invalid_argument& failure) {
+      cout << failure.what() << endl;
+      failed++;
+      continue; }
+    double density = dist->pdensity();
+    double recorded = history.density(step);
+    cout << "(" << step << "," << density << ")";
+    cout << "\n";
+    if (!std::isnan(recorded) && (recorded != density)) {
+      cout << setprecision(17) << "Step " << step << " was recorded with density " << recorded
+	   << ", replayed as " << density << setprecision(6) << "\n";
+      failed++; }
+    if (sites) {
+      const double* at = dist->site_data();
+      cout << setprecision(17);
+      for (int beta = 0; beta <= footprint; beta++)
+	if (at[beta] != 0.0) cout << beta << " : " << at[beta] << "\n";
+      cout << setprecision(6); }
+    delete(dist); }
+  return(failed > 0 ? 2 : 0);
+}
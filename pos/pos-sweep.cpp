@@ -0,0 +1,414 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include "barriertools.h"
+#include "sweep.h"
+#include "inverse.h"
+#include "surrogate.h"
+
+using namespace std;
+
+/*
+  Sweeps pos over a grid of (p, k, w). Each finished point adds a line
+  to the result log: its key, a tab, and the uncaptured probabilities
+  at steps every, 2 every, ... and w (only at w by default).
+
+  The stationary distribution of each p is built once and shared by
+  the spike convolutions of all its k; points that differ only in w
+  share one evolution. A (p, k) group costs a convolution, about
+  footprint^2 / 2, plus footprint per step.
+
+  With -i target each point of a grid of (p, w), without k, is solved
+  for the largest spike k in the range -r (default 0 to maxsteps)
+  whose probability at w is at most target. The spike is an integer,
+  with no derivative to follow, so the search bisects (inverse.h),
+  each trial a convolution and w steps from the shared stationary
+  distribution. The point's line has the key with target=..., then k,
+  the probability there, the number of evaluations, and "infeasible"
+  if even the low end of the range is above the target; or, with no
+  answer, "not bracketed" and the probability at the high end if even
+  that is within the target.
+
+  With -T table the grid has a single w, and the log-probabilities at
+  steps every, 2 every, ... and w of each (p, k) go into a surrogate
+  table (surrogate.h) over p, k and the step instead of a log. With
+  -Q table the "p k step" lines on standard input are answered from
+  it, or by an evolution where its bound in log-probability is above
+  -t (default 0.01).
+
+  With -b target each (p, k, w) is first bounded from the stationary
+  distribution of p (bound.h), which settles whether the probability
+  at w is at most target, without the convolution, when the point is
+  far from it; the spikes the bounds leave open are evolved as above.
+  The point's line has the key with threshold=..., then the
+  probability or the bound that settled it, "below" or "above" the
+  target, and "exact" or "bound".
+*/
+
+struct SpikeGroup {
+  int               k;
+  vector<GridPoint> points;
+};
+
+struct StationaryGroup {
+  double                p;
+  map<int, SpikeGroup>  spikes;
+};
+
+static int last_w(const SpikeGroup& group) {
+  int w = 0;
+  for (const GridPoint& point : group.points)
+    w = max(w, int(point.get("w")));
+  return(w);
+}
+
+static void run_spike(const SpikeGroup& group,
+		      shared_ptr<const BarrierDistribution> stationary,
+		      int every,
+		      double target,
+		      ResultLog& log) {
+  map<int, double> density;  // at every reported step of the group
+  for (const GridPoint& point : group.points) {
+    int point_w = point.get("w");
+    for (int step = every; step < point_w; step = step + every)
+      density[step] = 0.0;
+    density[point_w] = 0.0; }
+
+  BarrierDistribution* spikeshift = new BarrierDistribution(stationary->p,spike,group.k);
+  BarrierDistribution* current = convolve(stationary.get(),spikeshift);
+  delete(spikeshift);
+  int step = 0;
+  for (map<int, double>::iterator report = density.begin(); report != density.end(); report++) {
+    for (; step < report->first; step++) {
+      BarrierDistribution* next = new BarrierDistribution(*current,absorb);
+      delete(current);
+      current = next; }
+    report->second = current->pdensity(); }
+  delete(current);
+
+  for (const GridPoint& point : group.points) {
+    int point_w = point.get("w");
+    if (target > 0) {
+      log.record(bound_key(point.key(), target), bound_result(density[point_w], target, true));
+      continue; }
+    ostringstream result;
+    result << setprecision(17);
+    for (int step = every; step < point_w; step = step + every)
+      result << density[step] << " ";
+    result << density[point_w];
+    log.record(point.key(), result.str()); }
+}
+
+static double spike_cost(const SpikeGroup& group) {
+  return(double(footprint) * footprint / 2 + double(footprint) * last_w(group));
+}
+
+// With a tally (-b), only the points the bounds leave open are evolved.
+static void run_stationary(const StationaryGroup& base,
+			   int every,
+			   double target,
+			   BoundTally* tally,
+			   WorkStealingPool& pool,
+			   ResultLog& log) {
+  shared_ptr<const BarrierDistribution> stationary(new BarrierDistribution(base.p,stable));
+  for (map<int, SpikeGroup>::const_iterator at = base.spikes.begin(); at != base.spikes.end(); at++) {
+    const SpikeGroup* group = &at->second;
+    if (tally != NULL) {
+      shared_ptr<SpikeGroup> open(new SpikeGroup());
+      open->k = group->k;
+      for (const GridPoint& point : group->points) {
+	DensityBounds found = spike_bounds(stationary.get(), group->k, point.get("w"));
+	BoundVerdict verdict = bound_verdict(found, target);
+	tally->count(verdict);
+	if (verdict == bound_open)
+	  open->points.push_back(point);
+	else
+	  log.record(bound_key(point.key(), target),
+		     bound_result((verdict == bound_below) ? found.upper : found.lower, target, false)); }
+      if (!open->points.empty())
+	pool.submit(spike_cost(*open),
+		    [open, stationary, every, target, &log] { run_spike(*open, stationary, every, target, log); });
+      continue; }
+    pool.submit(spike_cost(*group),
+		[group, stationary, every, &log] { run_spike(*group, stationary, every, 0, log); }); }
+}
+
+static double spike_density(const BarrierDistribution* stationary, int k, int w) {
+  BarrierDistribution* spikeshift = new BarrierDistribution(stationary->p,spike,k);
+  BarrierDistribution* current = convolve(stationary,spikeshift);
+  delete(spikeshift);
+  for (int step = 0; step < w; step++) {
+    BarrierDistribution* next = new BarrierDistribution(*current,absorb);
+    delete(current);
+    current = next; }
+  double result = current->pdensity();
+  delete(current);
+  return(result);
+}
+
+static void run_inverse(const GridPoint& point,
+			const string& key,
+			shared_ptr<const BarrierDistribution> stationary,
+			double target,
+			int low,
+			int high,
+			ResultLog& log) {
+  int w = point.get("w");
+  InverseResult found = inverse_search([&](int k) { return(spike_density(stationary.get(), k, w)); },
+				       target, low, high);
+  string trouble = inverse_trouble(found);
+  ostringstream result;
+  if (!trouble.empty()) result << trouble;
+  else result << setprecision(17) << found.parameter << " " << found.density.value << " "
+	      << found.evaluations << (found.feasible ? "" : " infeasible");
+  log.record(key, result.str());
+}
+
+struct InverseGroup {
+  double                               p;
+  vector<pair<GridPoint, string> >     solves;  // each point and its key
+};
+
+static void solve_stationary(const InverseGroup& base,
+			     double target,
+			     int low,
+			     int high,
+			     WorkStealingPool& pool,
+			     ResultLog& log) {
+  shared_ptr<const BarrierDistribution> stationary(new BarrierDistribution(base.p,stable));
+  for (size_t at = 0; at < base.solves.size(); at++) {
+    const pair<GridPoint, string>* solve = &base.solves[at];
+    pool.submit(double(footprint) * (footprint + solve->first.get("w")),
+		[solve, stationary, target, low, high, &log] {
+		  run_inverse(solve->first, solve->second, stationary, target, low, high, log); }); }
+}
+
+// -i: the stationary distribution of each p is built once for all its solves.
+static void solve_grid(const vector<GridPoint>& points,
+		       double target,
+		       int low,
+		       int high,
+		       int threads,
+		       ResultLog& log) {
+  map<string, InverseGroup> groups;
+  int skipped = 0, solves = 0;
+  for (const GridPoint& point : points) {
+    if (point.has("k")) throw std::invalid_argument("POS-SWEEP: -i solves for k; the grid may not fix it");
+    if ((point.get("w") < 1) || (point.get("w") > maxsteps))
+      throw std::invalid_argument("POS-SWEEP: w out of range in " + point.key());
+    ostringstream key;
+    key << point.key() << " target=" << setprecision(12) << target;
+    if (log.done(key.str())) {
+      skipped++;
+      continue; }
+    ostringstream name;
+    name << setprecision(12) << point.get("p");
+    InverseGroup& group = groups[name.str()];
+    group.p = point.get("p");
+    group.solves.push_back(make_pair(point, key.str()));
+    solves++; }
+  cout << points.size() << " points, " << skipped << " already done, "
+       << solves << " solves of k on " << threads << " threads" << endl;
+
+  WorkStealingPool pool(threads);
+  for (map<string, InverseGroup>::iterator at = groups.begin(); at != groups.end(); at++) {
+    const InverseGroup* group = &at->second;
+    pool.submit(double(footprint) * footprint * group->solves.size(),
+		[group, target, low, high, &pool, &log] { solve_stationary(*group, target, low, high, pool, log); }); }
+  pool.run();
+}
+
+// The log-probabilities of spikes ks of one stationary distribution at
+// the steps given, a row per spike.
+static void table_rows(double p, const vector<double>& ks, const vector<double>& steps, float* rows) {
+  BarrierDistribution* stationary = new BarrierDistribution(p,stable);
+  for (size_t at = 0; at < ks.size(); at++) {
+    BarrierDistribution* spikeshift = new BarrierDistribution(p,spike,int(ks[at]));
+    BarrierDistribution* current = convolve(stationary,spikeshift);
+    delete(spikeshift);
+    int step = 0;
+    for (size_t report = 0; report < steps.size(); report++) {
+      for (; step < int(steps[report]); step++) {
+	BarrierDistribution* next = new BarrierDistribution(*current,absorb);
+	delete(current);
+	current = next; }
+      rows[at * steps.size() + report] = float(log(current->pdensity())); }
+    delete(current); }
+  delete(stationary);
+}
+
+static void build_table(const GridAxes& grid, int every, int threads, const string& path) {
+  GridAxes axes;
+  vector<double> steps;
+  for (const pair<string, vector<double> >& axis : grid)
+    if (axis.first == "w") {
+      if ((axis.second.size() != 1) || (axis.second[0] < 1) || (axis.second[0] > maxsteps))
+	throw std::invalid_argument("POS-SWEEP: -T needs a single w in range");
+      int w = axis.second[0];
+      for (int step = every; step < w; step = step + every)
+	steps.push_back(step);
+      steps.push_back(w); }
+    else if ((axis.first == "p") || (axis.first == "k")) {
+      axes.push_back(axis);
+      sort(axes.back().second.begin(), axes.back().second.end()); }
+    else
+      throw std::invalid_argument("POS-SWEEP: -T tables are over p, k and w, not " + axis.first);
+  if ((axes.size() != 2) || (axes[0].first != "p") || steps.empty())
+    throw std::invalid_argument("POS-SWEEP: -T needs p, then k, and w");
+  const vector<double> ks = axes[1].second;
+  for (double k : ks)
+    if ((k < 0) || (k != floor(k))) throw std::invalid_argument("POS-SWEEP: -T needs whole spikes k >= 0");
+  axes.push_back(make_pair(string("step"), steps));
+  vector<float> cells(axes[0].second.size() * ks.size() * steps.size());
+  WorkStealingPool pool(threads);
+  for (size_t at = 0; at < axes[0].second.size(); at++) {
+    double p = axes[0].second[at];
+    float* rows = &cells[at * ks.size() * steps.size()];
+    pool.submit(double(footprint) * (footprint + steps.back()) * ks.size(),
+		[p, rows, &ks, &steps] { table_rows(p, ks, steps, rows); }); }
+  cout << axes[0].second.size() << " stationary distributions, " << ks.size() << " spikes each, "
+       << steps.size() << " steps on " << threads << " threads" << endl;
+  pool.run();
+  surrogate_write(path, axes, cells);
+  cout << cells.size() << " probabilities in " << path << endl;
+}
+
+// The probability at a "p k step" query point, by evolution.
+static double exact_density(const vector<double>& point) {
+  double k = point[1], step = point[2];
+  if ((k != floor(k)) || (k < 0) || (step != floor(step)) || (step < 1) || (step > maxsteps))
+    throw std::invalid_argument("POS-SWEEP: an exact answer needs whole k and step in range");
+  BarrierDistribution* stationary = new BarrierDistribution(point[0],stable);
+  double density = spike_density(stationary, int(k), int(step));
+  delete(stationary);
+  return(density);
+}
+
+int main(int argc, char **argv)
+{
+  int threads = thread::hardware_concurrency();
+  int every = 0;
+  double target = 0;
+  double threshold = 0;
+  int low = 0, high = maxsteps;
+  double tolerance = 0.01;
+  string results = "sweep.txt";
+  string table, queried;
+  int option;
+
+  while ((option = getopt(argc, argv, "j:e:o:i:b:r:T:Q:t:")) != -1)
+    if (option == 'j') threads = atoi(optarg);
+    else if (option == 'e') every = atoi(optarg);
+    else if (option == 'o') results = optarg;
+    else if (option == 'i') target = atof(optarg);
+    else if (option == 'b') threshold = atof(optarg);
+    else if (option == 'T') table = optarg;
+    else if (option == 'Q') queried = optarg;
+    else if (option == 't') tolerance = atof(optarg);
+    else if (option == 'r') {
+      if (sscanf(optarg, "%d:%d", &low, &high) != 2) {
+	argc = 0;
+	break; }}
+    else {
+      argc = 0;
+      break; }
+  if (!queried.empty() && (argc > 0)) {
+    SurrogateTable surrogate(queried);
+    if ((surrogate.axes.size() != 3) || (surrogate.axes[0].first != "p") || (surrogate.axes[1].first != "k"))
+      throw std::invalid_argument("POS-SWEEP: " + queried + " is not a table over p, k and the step");
+    surrogate_serve(surrogate, cin, cout, tolerance, exact_density);
+    return 0; }
+  if (argc - optind < 1) {
+    cout << "Usage: " << argv[0] << " [-j threads] [-e every | -i target [-r low:high] | -b target]" << endl;
+    cout << "       [-o results | -T table] <grid>" << endl;
+    cout << "       " << argv[0] << " -Q table [-t tolerance] < queries" << endl;
+    cout << "  grid lines: p = 0.3:0.45:0.05   k = 0:40:10   w = 500, 2000" << endl;
+    cout << "  -e  also record the probability every `every' steps (default: only at w)" << endl;
+    cout << "  -i  instead find, for each (p, w), the largest k in -r (default 0:" << maxsteps << ")" << endl;
+    cout << "      whose probability at w is at most target" << endl;
+    cout << "  -b  instead tell whether each probability at w is at most target, from bounds" << endl;
+    cout << "      where they settle it and by evolution where they do not" << endl;
+    cout << "  -o  result log (default sweep.txt); points already in it are skipped" << endl;
+    cout << "  -T  build a surrogate table over p, k and the steps every ... w" << endl;
+    cout << "  -Q  answer \"p k step\" lines from the table, or exactly where its error" << endl;
+    cout << "      bound in log-probability is over tolerance (default 0.01)" << endl;
+    return 0;
+  }
+  ifstream spec(argv[optind]);
+  if (!spec) {
+    cout << "Cannot read " << argv[optind] << endl;
+    return 1;
+  }
+  if (!table.empty()) {
+    if (every < 1) throw std::invalid_argument("POS-SWEEP: -T needs -e");
+    build_table(read_axes(spec), every, threads, table);
+    return 0; }
+  vector<GridPoint> points = read_grid(spec);
+  ResultLog log(results);
+
+  if (target > 0) {
+    solve_grid(points, target, low, high, threads, log);
+    cout << log.count() << " points in " << results << endl;
+    return 0; }
+
+  map<string, StationaryGroup> groups;
+  int skipped = 0, evolutions = 0;
+  for (const GridPoint& point : points) {
+    if ((point.get("k") < 0) || (point.get("w") < 1) || (point.get("w") > maxsteps))
+      throw std::invalid_argument("POS-SWEEP: k or w out of range in " + point.key());
+    if (log.done((threshold > 0) ? bound_key(point.key(), threshold) : point.key())) {
+      skipped++;
+      continue; }
+    ostringstream name;
+    name << setprecision(12) << point.get("p");
+    StationaryGroup& group = groups[name.str()];
+    group.p = point.get("p");
+    SpikeGroup& spike = group.spikes[int(point.get("k"))];
+    if (spike.points.empty()) evolutions++;
+    spike.k = point.get("k");
+    spike.points.push_back(point); }
+  cout << points.size() << " points, " << skipped << " already done, "
+       << evolutions << " evolutions on " << threads << " threads" << endl;
+
+  WorkStealingPool pool(threads);
+  int report_every = ((every > 0) && (threshold <= 0)) ? every : maxsteps + 1;
+  BoundTally tally;
+  BoundTally* bounding = (threshold > 0) ? &tally : NULL;
+  for (map<string, StationaryGroup>::iterator at = groups.begin(); at != groups.end(); at++) {
+    const StationaryGroup* group = &at->second;
+    double cost = 0;
+    for (map<int, SpikeGroup>::const_iterator spike = group->spikes.begin(); spike != group->spikes.end(); spike++)
+      cost = cost + spike_cost(spike->second);
+    pool.submit(cost,
+		[group, report_every, threshold, bounding, &pool, &log] {
+		  run_stationary(*group, report_every, threshold, bounding, pool, log); }); }
+  pool.run();
+  if (bounding != NULL) cout << tally.report() << endl;
+  cout << log.count() << " points in " << results << endl;
+  return 0;
+}
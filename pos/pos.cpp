@@ -18,18 +18,39 @@ limitations under the License.
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <string>
+#include <unistd.h>
 #include "barriertools.h"
+#include "history.h"
+#define PROBE_ALLOCATIONS
+#include "probe.h"
 
 using namespace std;
 
-int main()
+int main(int argc, char **argv)
 {
   double p;
   int k, w, step;
   BarrierDistribution* stationary;
   BarrierDistribution* spikeshift;
   BarrierDistribution* distributions[maxsteps+1];
+  string history_path;
+  int history_every = 100;
+  double history_megabytes = 256;
+  EvolutionHistory* history = NULL;
+  int option;
+
+  while ((option = getopt(argc, argv, "y:K:B:")) != -1)
+    if (option == 'y') history_path = optarg;
+    else if (option == 'K') history_every = max(1, atoi(optarg));
+    else if (option == 'B') history_megabytes = atof(optarg);
+    else {
+      cout << "Usage: " << argv[0] << " [-y history [-K every] [-B megabytes]]" << endl;
+      cout << "  -y  keep the distribution every `every' steps (default 100), within megabytes (default 256)," << endl;
+      cout << "      spacing them out as needed, and write them to history at the end, for pos-hist" << endl;
+      return 1; }
   
+  probe_start("pos");
   cout << "Enter binomial distribution parameter: ";
   cin >> p;
   
@@ -42,16 +63,37 @@ int main()
   if ((k >= 0) && (w >= 0) && (w <= maxsteps)) {
     stationary = new BarrierDistribution(p,stable);
     spikeshift = new BarrierDistribution(p,spike,k);
-    distributions[0] = convolve(stationary,spikeshift);
+    {
+      ProbePhase phase("convolve", footprint + 1);
+      distributions[0] = convolve(stationary,spikeshift);
+    }
     delete(stationary);
     delete(spikeshift);
+    if (!history_path.empty()) {
+      history = history_for(p, k, history_every, size_t(history_megabytes * 1024 * 1024));
+      history_keyframe(*history, 0, distributions[0]); }
     cout << "Results, of form (length, uncaptured probability)." << "\n";
     for (step = 1; step <= w; step++) {
-      distributions[step] = new BarrierDistribution(*distributions[step-1],absorb);
+      {
+	ProbePhase phase("absorb", footprint + 1);
+	distributions[step] = new BarrierDistribution(*distributions[step-1],absorb);
+      }
       delete(distributions[step-1]);
-      cout << "(" << step << "," << distributions[step]->pdensity() << ")";
+      double density;
+      {
+	ProbePhase phase("pdensity", footprint + 1);
+	density = distributions[step]->pdensity();
+      }
+      probe_trace("density", step, density);
+      if (history != NULL) {
+	history->note(step, density);
+	if (history->due(step)) history_keyframe(*history, step, distributions[step]); }
+      cout << "(" << step << "," << density << ")";
       cout << "\n";
     }
+    if (history != NULL) {
+      history->save(history_path);
+      delete(history); }
     if (w>0) delete(distributions[w]);
   }
   return 0;
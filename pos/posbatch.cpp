@@ -0,0 +1,145 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <unistd.h>
+#include "barriertools.h"
+#include "batch.h"
+
+using namespace std;
+
+/*
+  Runs pos and posthr queries from job records (see batch.h), without
+  prompts, all in one process. The fields are those pos and posthr ask
+  for:
+
+    tool=pos    p k w
+    tool=posthr p threshold k_lower k_upper w
+
+  pos jobs give one "step=... density=..." line per step, posthr jobs
+  one "k=... steps=..." line per spike quota, with the count posthr
+  prints, or "k=... underflow=1" if w steps were not enough. A job
+  that fails gives a single error="..." line and the batch goes on.
+
+  The stationary distribution of each p and the spike start of each
+  (p, k), whose convolution is most of a short walk's cost, are kept
+  between jobs, least recently used first out.
+*/
+
+static LruCache<BarrierDistribution>* stationaries;
+static LruCache<BarrierDistribution>* starts;
+
+static const BarrierDistribution* start_for(double p, int k) {
+  string key = cache_key({p, double(k)});
+  BarrierDistribution* found = starts->find(key);
+  if (found != NULL) return(found);
+  BarrierDistribution* stationary = stationaries->find(cache_key({p}));
+  if (stationary == NULL)
+    stationary = stationaries->insert(cache_key({p}), new BarrierDistribution(p,stable));
+  BarrierDistribution* spikeshift = new BarrierDistribution(p,spike,k);
+  BarrierDistribution* start = convolve(stationary,spikeshift);
+  delete(spikeshift);
+  return(starts->insert(key, start));
+}
+
+static void run_job(const JobRecord& job, ostream& out) {
+  string tool = job.text("tool");
+  if ((tool != "pos") && (tool != "posthr")) throw std::invalid_argument("JOB: unknown tool " + tool);
+  double p = job.number("p");
+  int w = job.integer("w");
+  if ((w < 0) || (w > maxsteps)) throw std::invalid_argument("JOB: w out of range");
+  if ((tool == "posthr") && !(job.has("threshold") && job.has("k_upper")))
+    throw std::invalid_argument("JOB: posthr needs threshold and k_upper");
+  if ((tool == "pos") ? (job.integer("k") < 0) : (job.integer("k_lower") < 0))
+    throw std::invalid_argument("JOB: spike quota out of range");
+  BarrierDistribution* distributions[2];
+  distributions[0] = new BarrierDistribution(p,zero);
+  distributions[1] = new BarrierDistribution(p,zero);
+  if (tool == "pos") {
+    int k = job.integer("k");
+    const BarrierDistribution* current = start_for(p, k);
+    for (int step = 1; step <= w; step++) {
+      evolve(current, distributions[step % 2], absorb);
+      current = distributions[step % 2];
+      out << job.lead() << " step=" << step << " density=" << current->pdensity() << "\n"; }}
+  else {
+    double threshold = job.number("threshold");
+    int k_lower = job.integer("k_lower");
+    int k_upper = job.integer("k_upper");
+    for (int k = k_lower; k <= k_upper; k++) {
+      const BarrierDistribution* current = start_for(p, k);
+      double current_error = 1;
+      int step = 1;
+      while ((current_error > threshold) && (step <= w)) {
+	evolve(current, distributions[step % 2], absorb);
+	current = distributions[step % 2];
+	current_error = current->pdensity();
+	step++; }
+      if (current_error <= threshold)
+	out << job.lead() << " k=" << k << " steps=" << step << "\n";
+      else
+	out << job.lead() << " k=" << k << " underflow=1\n"; }}
+  delete(distributions[0]);
+  delete(distributions[1]);
+}
+
+int main(int argc, char **argv)
+{
+  int cached = 64;
+  int precision = 17;
+  int option;
+
+  while ((option = getopt(argc, argv, "c:p:")) != -1)
+    if (option == 'c') cached = atoi(optarg);
+    else if (option == 'p') precision = atoi(optarg);
+    else {
+      cout << "Usage: " << argv[0] << " [-c cached_starts] [-p precision] [job_file ...]" << endl;
+      cout << "  reads job records from the files, or from standard input if none are given" << endl;
+      return 1; }
+  stationaries = new LruCache<BarrierDistribution>(cached);
+  starts = new LruCache<BarrierDistribution>(cached);
+  cout << setprecision(precision);
+
+  int failed = 0;
+  for (int file = optind; (file < argc) || (file == optind); file++) {
+    ifstream opened;
+    if (file < argc) {
+      opened.open(argv[file]);
+      if (!opened) {
+	cerr << "Cannot read " << argv[file] << endl;
+	return 1; }}
+    istream& jobs = (file < argc) ? opened : cin;
+    string line;
+    while (getline(jobs, line)) {
+      if (JobRecord::blank(line)) continue;
+      string lead = "id=- tool=-";
+      try {
+	JobRecord job(line);
+	lead = job.lead();
+	run_job(job, cout); }
+      catch (std::exception& failure) {
+	cout << lead << " " << error_field(failure.what()) << "\n";
+	failed++; }
+      cout << std::flush; }}
+  delete(starts);
+  delete(stationaries);
+  return(failed > 0 ? 2 : 0);
+}
@@ -0,0 +1,203 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include "barriertools.h"
+#include "batch.h"
+#include "daemon.h"
+
+using namespace std;
+
+/*
+  Answers pos and posthr queries over a Unix-domain socket (or a
+  loopback TCP port), with the job records and result lines of
+  posbatch; pos jobs may add every=N to get every Nth step only.
+
+  Every (p, k) walk is kept: its latest distribution and the density
+  at each step so far. A query within the steps already walked is a
+  lookup, answered at once; one beyond them walks on from a copy of the
+  latest distribution, on one of -j worker threads (see daemon.h). The
+  walks and the stationary distributions share one LRU cache with a
+  memory budget. tool=stats reports the cache.
+*/
+
+struct Walk {
+  BarrierDistribution* latest;    // at step density.size()
+  BarrierDistribution* spare;
+  vector<double>       density;   // density[s - 1] at step s
+  Walk(BarrierDistribution* start) : latest(start),
+				     spare(new BarrierDistribution(start->p,zero)) {}
+  ~Walk() {
+    delete(latest);
+    delete(spare);
+  }
+  size_t bytes() const {
+    return(2 * sizeof(BarrierDistribution) + density.capacity() * sizeof(double));
+  }
+  // Walked far enough for a query: `steps' long, or down to `until'.
+  bool covers(int steps, double until) const {
+    return((int(density.size()) >= steps) || (!density.empty() && (density.back() <= until)));
+  }
+};
+
+static LruCache<BarrierDistribution>* stationaries;
+static LruCache<Walk>* walks;
+
+/* The densities of the walk of (p, k), at least `steps' of them unless
+   `until' is reached first. With cached_only, under cache_lock(),
+   those of the cached walk, NULL if it falls short. Otherwise the walk
+   goes on from a copy of the cached one, without the lock, into own,
+   and replaces the cached one if it got further. */
+static const vector<double>* densities(double p, int k, int steps, double until,
+				       bool cached_only, vector<double>& own) {
+  string key = cache_key({p, double(k)});
+  if (cached_only) {
+    Walk* walk = walks->find(key);
+    return(((walk != NULL) && walk->covers(steps, until)) ? &walk->density : NULL); }
+  Walk* extended = NULL;
+  BarrierDistribution* stationary = NULL;
+  string stationary_key = cache_key({p});
+  {
+    lock_guard<mutex> guard(cache_lock());
+    Walk* walk = walks->find(key);
+    if (walk != NULL) {
+      own = walk->density;
+      if (walk->covers(steps, until)) return(&own);
+      extended = new Walk(new BarrierDistribution(*walk->latest));
+      extended->density = walk->density; }
+    else {
+      BarrierDistribution* found = stationaries->find(stationary_key);
+      if (found != NULL) stationary = new BarrierDistribution(*found); }
+  }
+  if (extended == NULL) {
+    if (stationary == NULL) {
+      stationary = new BarrierDistribution(p,stable);
+      lock_guard<mutex> guard(cache_lock());
+      if (stationaries->find(stationary_key) == NULL)
+	stationaries->insert(stationary_key, new BarrierDistribution(*stationary),
+			     sizeof(BarrierDistribution)); }
+    BarrierDistribution* spikeshift = new BarrierDistribution(p,spike,k);
+    extended = new Walk(convolve(stationary,spikeshift));
+    delete(spikeshift);
+    delete(stationary); }
+  while (!extended->covers(steps, until)) {
+    evolve(extended->latest, extended->spare, absorb);
+    swap(extended->latest, extended->spare);
+    extended->density.push_back(extended->latest->pdensity()); }
+  own = extended->density;
+  lock_guard<mutex> guard(cache_lock());
+  Walk* walk = walks->find(key);
+  if (walk == NULL)
+    walks->insert(key, extended, extended->bytes());
+  else {
+    if (walk->density.size() < extended->density.size()) {
+      swap(walk->latest, extended->latest);
+      swap(walk->spare, extended->spare);
+      walk->density.swap(extended->density);
+      walks->resize(key, walk->bytes()); }
+    delete(extended); }
+  return(&own);
+}
+
+// Answers a job, into out only if it is answered in full; with
+// cached_only, from the caches or not at all.
+static bool respond(const JobRecord& job, ostream& out, bool cached_only) {
+  string tool = job.text("tool");
+  if (tool == "stats") {
+    unique_lock<mutex> guard(cache_lock(), defer_lock);
+    if (!cached_only) guard.lock();
+    out << job.lead() << " entries=" << walks->size() + stationaries->size()
+	<< " bytes=" << walks->used() + stationaries->used()
+	<< " hits=" << walks->hits << " misses=" << walks->misses << "\n";
+    return(true); }
+  if ((tool != "pos") && (tool != "posthr")) throw std::invalid_argument("JOB: unknown tool " + tool);
+  double p = job.number("p");
+  int w = job.integer("w");
+  if ((w < 0) || (w > maxsteps)) throw std::invalid_argument("JOB: w out of range");
+  ostringstream lines;
+  lines.precision(out.precision());
+  vector<double> own;
+  if (tool == "pos") {
+    int k = job.integer("k");
+    int every = job.integer("every", 1);
+    if ((k < 0) || (every < 1)) throw std::invalid_argument("JOB: k or every out of range");
+    const vector<double>* density = densities(p, k, w, -1, cached_only, own);
+    if (density == NULL) return(false);
+    for (int step = every; step <= w; step = step + every)
+      lines << job.lead() << " step=" << step << " density=" << (*density)[step - 1] << "\n"; }
+  else {
+    double threshold = job.number("threshold");
+    int k_lower = job.integer("k_lower");
+    int k_upper = job.integer("k_upper");
+    if (k_lower < 0) throw std::invalid_argument("JOB: k_lower out of range");
+    for (int k = k_lower; k <= k_upper; k++) {
+      const vector<double>* density = densities(p, k, w, threshold, cached_only, own);
+      if (density == NULL) return(false);
+      int step;
+      for (step = 1; step <= min(w, int(density->size())); step++)
+	if ((*density)[step - 1] <= threshold) break;
+      // posthr counts one past the step that got below the threshold.
+      if ((step <= w) && (step <= int(density->size())))
+	lines << job.lead() << " k=" << k << " steps=" << step + 1 << "\n";
+      else
+	lines << job.lead() << " k=" << k << " underflow=1\n"; }}
+  out << lines.str();
+  return(true);
+}
+
+static bool lookup(const JobRecord& job, ostream& out) {
+  return(respond(job, out, true));
+}
+
+static void answer(const JobRecord& job, ostream& out) {
+  respond(job, out, false);
+}
+
+int main(int argc, char **argv)
+{
+  string path = "/tmp/posd.sock";
+  int port = 0;
+  long megabytes = 256;
+  int precision = 17;
+  int workers = max(1u, thread::hardware_concurrency());
+  int option;
+
+  while ((option = getopt(argc, argv, "s:P:m:p:j:")) != -1)
+    if (option == 's') path = optarg;
+    else if (option == 'P') port = atoi(optarg);
+    else if (option == 'm') megabytes = atol(optarg);
+    else if (option == 'p') precision = atoi(optarg);
+    else if (option == 'j') workers = atoi(optarg);
+    else {
+      cout << "Usage: " << argv[0] << " [-s socket_path | -P localhost_port] [-m cache_megabytes] [-p precision] [-j workers]" << endl;
+      cout << "  serves posbatch job records, one per line; each reply ends with a line \".\"" << endl;
+      return 1; }
+  stationaries = new LruCache<BarrierDistribution>(1 << 20, (megabytes << 20) / 16);
+  walks = new LruCache<Walk>(1 << 20, megabytes << 20);
+  int listener = (port > 0) ? listen_local_tcp(port) : listen_unix(path);
+  cout << "posd: serving on " << ((port > 0) ? "localhost:" + to_string(port) : path) << endl;
+  serve_queries(listener, lookup, answer, precision, workers);
+  return 0;
+}
@@ -18,7 +18,10 @@ limitations under the License.
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <string>
 #include "barriertools.h"
+#define PROBE_ALLOCATIONS
+#include "probe.h"
 
 using namespace std;
 
@@ -31,6 +34,7 @@ int main()
   BarrierDistribution* spikeshift;
   BarrierDistribution* distributions[maxsteps+1];
   
+  probe_start("posthr");
   cout << "Enter binomial distribution parameter: ";
   cin >> p;
   cout << "Enter error threshold: ";
@@ -48,14 +52,25 @@ int main()
     stationary = new BarrierDistribution(p,stable);
     for (int k=k_lower; k <= k_upper; k++) { 
       spikeshift = new BarrierDistribution(p,spike,k);
-      distributions[0] = convolve(stationary,spikeshift);
+      {
+	ProbePhase phase("convolve", footprint + 1);
+	distributions[0] = convolve(stationary,spikeshift);
+      }
       delete(spikeshift);
+      string trace = probe_on() ? "density k=" + to_string(k) : "";
       current_error = 1;
       step = 1;
       while ((current_error > error_threshold) && (step <= w)) {
-	distributions[step] = new BarrierDistribution(*distributions[step-1],absorb);
+	{
+	  ProbePhase phase("absorb", footprint + 1);
+	  distributions[step] = new BarrierDistribution(*distributions[step-1],absorb);
+	}
 	delete(distributions[step-1]);
-	current_error = distributions[step]->pdensity();
+	{
+	  ProbePhase phase("pdensity", footprint + 1);
+	  current_error = distributions[step]->pdensity();
+	}
+	probe_trace(trace, step, current_error);
 	step++;
       }
       if (current_error <= error_threshold)
@@ -18,13 +18,14 @@ limitations under the License.
 #include <stdexcept>
 #include <cmath>
 #include "barriertools.h"
+#include "markov.h"
 
 using namespace std;
 
 
 /*
   The BarrierDistribution object can hold a single probability
-  distribution supported on {0, ..., maxsteps}.
+  distribution supported on {0, ..., range()}, maxsteps at first.
   
   Given a particular distribution and a parameter 0 < p < 1 (which the
   object holds), one can "evolve" the distribution to yield the next
@@ -41,6 +42,16 @@ using namespace std;
   code. In particular, distribution objects carry out (hopefully)
   unnecessary range checking, are conservatively initialized to zero,
   and are created anew for each step of the evolution.
+
+  A particle pushed beyond the range is lost. Every evolution and
+  spike convolution works out the mass it loses so -- the rows near
+  the top times the Poisson tail beyond -- before it runs, and adds
+  it to leak(), which bounds how far the densities may read low. If
+  a step would lose more than the distribution's tolerance
+  (leak_tolerance unless set), the range first grows, to the
+  smallest one that keeps the loss within it, the rows copied into a
+  larger buffer; ranges never shrink along an evolution, and never
+  grow past beta_limit.
 */
 
 //class Dist_index
@@ -116,9 +127,10 @@ Dist_index* Dist_index::evolve(int adversarial,
 
 //class BarrierDistribution;
 
-double Poisson(double lambda, int k) {
+// Of a double or a Dual rate, by the same operations.
+template <class Scalar> Scalar Poisson(Scalar lambda, int k) {
   if (k < 0) throw std::invalid_argument("Poisson index out of range");
-  double result = 1.0;
+  Scalar result = 1.0;
   for (int i=1; i <= k; i++)
     result = result * (lambda / i);
   return( exp(-lambda) * result );
@@ -136,22 +148,84 @@ double gaugetail(double shift, int beta) {
 //  }
 
 
-double spikedist(double shift, int beta) {
+template <class Scalar> Scalar spikedist(Scalar shift, int beta) {
   return(Poisson(shift,beta));
 }
 
+/* The chain of markov.h for pow. A phase is (r_isolation,
+   l_isolated_pending) as 2 r_isolation + pending, the order of the
+   loops below, stored at the internal index; the moves are read off
+   Dist_index::evolve. The honest outcomes are 0, 1 and 2 or more
+   leaders, the adversarial one any number up to the top of the range.
+   Beta = 0 is the barrier: with reflection a particle there lands on
+   the adversarial count alone, with absorption it is dropped. A
+   particle at beta whose adversarial advance is more than top - beta
+   is lost.
+   The weights are doubles, or Duals for DualBarrierDistribution. */
+
+template <class Scalar> class PowChainOf {
+public:
+  PowChainOf(int init_delta,
+	     EvolutionType init_convention,
+	     Scalar init_adv_param,
+	     Scalar hon_param,
+	     int init_top = maxsteps) : delta(init_delta), convention(init_convention),
+					adv_param(init_adv_param), top(init_top) {
+    h_transition_pr[0] = exp(-hon_param);
+    h_transition_pr[1] = hon_param * exp(-hon_param);
+    h_transition_pr[2] = 1 - exp(-hon_param) * (1 + hon_param);
+  }
+  int    phases() const { return(2 * delta + 2); }
+  int    column(int phase) const {
+    Dist_index index(delta, 0, phase / 2, phase % 2 == 1);
+    return(index.get_internal());
+  }
+  int    honest_outcomes() const { return(3); }
+  Scalar honest_weight(int hon) const { return(h_transition_pr[hon]); }
+  int    adversarial_outcomes() const { return(top + 1); }
+  Scalar adversarial_weight(int adv) const { return(Poisson(adv_param, adv)); }
+  MarkovMove move(int phase, int hon) const {
+    Dist_index source_index(delta, 1, phase / 2, phase % 2 == 1);
+    Dist_index* target_index = source_index.evolve(0, hon);
+    int internal = target_index->get_internal();
+    MarkovMove result;
+    if (internal <= delta)
+      result.phase = 2 * internal + 1;
+    else
+      result.phase = 2 * (internal - delta - 1);
+    result.shift = target_index->get_beta() - 1;
+    delete(target_index);
+    return(result);
+  }
+  int    barrier() const { return(1); }
+  int    land(int, MarkovMove, int adv) const { return((convention == reflect) ? adv : -1); }
+  int    first_regular() const { return(1); }
+  int    last_regular(int adv) const { return(top - adv); }
+  bool   fold() const { return(false); }
+  int    fixed_rows() const { return(0); }
+  Scalar fixed(const Scalar*, int, int, int) const { return(0.0); }
+private:
+  const int           delta;
+  const EvolutionType convention;
+  const Scalar        adv_param;
+  const int           top;
+  Scalar              h_transition_pr[3];
+};
+
+typedef PowChainOf<double> PowChain;
+
 void BarrierDistribution::show() const {
   cout << "Distribution contents...\n";
   for (int beta=0; beta < 30; beta++) {
     cout << beta << " : ";
     for (int internal=0; internal <= 2*delta+1; internal++)
-      cout << sites[beta][internal] << " ";
+      cout << sites[size_t(beta) * (2*maxdelta + 2) + internal] << " ";
     cout << "\n";
   }
 }
 
 int BarrierDistribution::rcheck_beta(int beta) const {
-  if ((beta < 0) || (beta > maxsteps)) throw std::invalid_argument("distribution index out of range");
+  if ((beta < 0) || (beta > top)) throw std::invalid_argument("distribution index out of range");
   return beta; }
 
 int BarrierDistribution::rcheck_delta(int internal) const {
@@ -159,48 +233,61 @@ int BarrierDistribution::rcheck_delta(int internal) const {
   return(internal); }
 
 double BarrierDistribution::get(Dist_index* ind) const {
-  return(sites[rcheck_beta(ind->get_beta())]
-	 [rcheck_delta(ind->get_internal())]);
+  return(sites[size_t(rcheck_beta(ind->get_beta())) * (2*maxdelta + 2) +
+	       rcheck_delta(ind->get_internal())]);
 }
 
 void BarrierDistribution::set(Dist_index* ind, double value) {
-  sites[rcheck_beta(ind->get_beta())]
-    [rcheck_delta(ind->get_internal())] = value;
+  sites[size_t(rcheck_beta(ind->get_beta())) * (2*maxdelta + 2) +
+	rcheck_delta(ind->get_internal())] = value;
+}
+
+const double* BarrierDistribution::site_data() const {
+  return(&sites[0]);
+}
+
+int BarrierDistribution::range() const {
+  return(top);
+}
+
+double BarrierDistribution::leak() const {
+  return(leaked);
+}
+
+size_t BarrierDistribution::bytes() const {
+  return(size_t(range() + 1) * (2*maxdelta + 2) * sizeof(double) + sizeof(BarrierDistribution));
+}
+
+void BarrierDistribution::set_leak_tolerance(double init_tolerance) {
+  if (!(init_tolerance >= 0)) throw std::invalid_argument("leak tolerance must be nonnegative");
+  tolerance = init_tolerance;
+}
+
+void BarrierDistribution::resize(int new_top) {
+  sites.resize(size_t(new_top + 1) * (2*maxdelta + 2), 0.0);
+  top = new_top;
 }
 
 double BarrierDistribution::pdensity() const {
-  double result = 0.0;
-  Dist_index* index;
-  index = new Dist_index(delta,0,0,false);
-  for(int beta = 1; beta <= maxsteps; beta++)
-    for (int r_iso = 0; r_iso <= delta; r_iso++)
-      for (bool pend : {false, true}) {
-	index->set(beta,r_iso,pend);
-	result = result + get(index);
-      }
-  delete(index);
-  return(result); 
+  return(markov_sum(&sites[0], 2*maxdelta + 2, 1, top,
+		    markov_columns(PowChain(delta, reflect, 0, 0))));
 }
 
 double BarrierDistribution::tdensity() const {
-  double result = 0.0;
-  Dist_index* index;
-  index = new Dist_index(delta,0,0,true);
-  for(int beta = 0; beta <= maxsteps; beta++)
-    for (int r_iso = 0; r_iso <= delta; r_iso++)
-      for (bool pend : {false, true}) {
-	index->set(beta,r_iso,pend);
-	result = result + get(index); }
-  delete(index);
-  return(result); 
+  return(markov_sum(&sites[0], 2*maxdelta + 2, 0, top,
+		    markov_columns(PowChain(delta, reflect, 0, 0))));
 }
 
 // Initial constructor, "structure" variable determines if zero or distribution at 0.
-BarrierDistribution::BarrierDistribution(int init_delta,InitializationType structure) : delta(init_delta) {
+BarrierDistribution::BarrierDistribution(int init_delta,InitializationType structure) : delta(init_delta),
+											    sites(size_t(footprint) * (2*maxdelta + 2)),
+											    top(maxsteps),
+											    leaked(0.0),
+											    tolerance(leak_tolerance) {
   Dist_index* index;
   if (init_delta > maxdelta) throw std::invalid_argument("Delta index out of range");
   index = new Dist_index(delta,0,0,true);
-  for(int beta = 0; beta <= maxsteps; beta++)
+  for(int beta = 0; beta <= top; beta++)
     for(int r_iso = 0; r_iso <= delta; r_iso++)
       for(bool pend : {false, true}) {
 	index->set(beta,r_iso,pend);
@@ -213,10 +300,14 @@ BarrierDistribution::BarrierDistribution(int init_delta,InitializationType struc
 }
 
 // Copy constructor
-BarrierDistribution::BarrierDistribution(const BarrierDistribution* orig) : delta(orig->delta) {
+BarrierDistribution::BarrierDistribution(const BarrierDistribution* orig) : delta(orig->delta),
+										    sites(orig->sites.size()),
+										    top(orig->top),
+										    leaked(orig->leaked),
+										    tolerance(orig->tolerance) {
   Dist_index* index;
   index = new Dist_index(delta,0,0,true);
-  for(int beta = 0; beta <= maxsteps; beta++)
+  for(int beta = 0; beta <= top; beta++)
     for(int r_iso = 0; r_iso <= delta; r_iso++)
       for(bool pend : {false, true}) {
 	index->set(beta,r_iso,pend);
@@ -224,41 +315,135 @@ BarrierDistribution::BarrierDistribution(const BarrierDistribution* orig) : delt
   delete(index);
 }
 
+// Over the larger range of the two, the rows beyond the smaller zero.
 double stat_distance(const BarrierDistribution* dista,
 		     const BarrierDistribution* distb) {
-  double result = 0;
-  Dist_index* index;
-  index = new Dist_index(dista->delta,0,0,true);
-  for (int beta=0; beta <= maxsteps; beta++) 
-    for (int r_iso=0; r_iso <= dista->delta; r_iso++)
-      for (bool pend : {false, true}) {
-	index->set(beta,r_iso,pend);
-	result = result + abs(dista->get(index)
-			      -distb->get(index)); }
-  delete(index);
-  return(result/2);
+  if (dista->top < distb->top) return(stat_distance(distb, dista));
+  if (dista->top > distb->top) {
+    BarrierDistribution grown(distb);
+    grown.resize(dista->top);
+    return(stat_distance(dista, &grown)); }
+  return(markov_distance(&dista->sites[0], &distb->sites[0], 2*maxdelta + 2, 0, dista->top,
+			 markov_columns(PowChain(dista->delta, reflect, 0, 0))));
 }
 
+// P(X > n) for X Poisson(lambda), n in [0 ... top]: the series beyond
+// top, then the terms added back down.
+static vector<double> poisson_tails(double lambda, int top) {
+  vector<double> point(top + 1), tails(top + 1);
+  point[0] = exp(-lambda);
+  for (int n = 1; n <= top; n++)
+    point[n] = point[n - 1] * lambda / n;
+  double term = point[top], beyond = 0.0;
+  for (int n = top + 1; ; n++) {
+    term = term * lambda / n;
+    beyond = beyond + term;
+    if ((term == 0.0) || ((n > lambda) && (term < beyond * 1e-17))) break; }
+  tails[top] = beyond;
+  for (int n = top; n > 0; n--)
+    tails[n - 1] = tails[n] + point[n];
+  return(tails);
+}
+
+/* The rows of a distribution as grown_range() reads them: rows
+   [0 ... range] of stride doubles each, whose mass is in columns (the
+   values alone, for Dual cells). */
+struct LossRows {
+  const double*    cells;
+  size_t           stride;
+  std::vector<int> columns;
+  int              range;
+};
+
+/* The mass a step into the range [0 ... top] would lose: a particle
+   at beta >= first is lost when the advance drawn from the tails is
+   more than top - beta (for evolve whatever the honest move, as
+   PowChain's last_regular() has it; for the spike, the convolution). */
+static double truncation_loss(const LossRows& source,
+			      const vector<double>& tails,
+			      int first,
+			      int top) {
+  double loss = 0.0;
+  for (int beta = first; beta <= source.range; beta++) {
+    double mass = 0.0;
+    for (int column : source.columns)
+      mass = mass + source.cells[size_t(beta) * source.stride + column];
+    loss = loss + mass * tails[top - beta]; }
+  return(loss);
+}
+
+/* The smallest range, from the source's up, whose step loses at most
+   the tolerance, and that loss: out in steps of a sixteenth, then
+   back by bisection. */
+static int grown_range(const LossRows& source,
+		       double lambda,
+		       int first,
+		       double tolerance,
+		       double* loss) {
+  int low = source.range, top = low;
+  *loss = truncation_loss(source, poisson_tails(lambda, top), first, top);
+  if (*loss <= tolerance) return(top);
+  while ((*loss > tolerance) && (top < beta_limit)) {
+    low = top + 1;
+    top = min(beta_limit, top + max(1, top / 16));
+    *loss = truncation_loss(source, poisson_tails(lambda, top), first, top); }
+  if (*loss > tolerance) return(top);  // as far as it goes
+  while (low < top) {
+    int middle = low + (top - low) / 2;
+    double middle_loss = truncation_loss(source, poisson_tails(lambda, middle), first, middle);
+    if (middle_loss <= tolerance) {
+      top = middle;
+      *loss = middle_loss; }
+    else
+      low = middle + 1; }
+  return(top);
+}
+
+static LossRows loss_rows(const BarrierDistribution* source) {
+  LossRows result = {source->site_data(), 2*maxdelta + 2,
+		     markov_columns(PowChain(source->delta, reflect, 0, 0)), source->range()};
+  return(result);
+}
 
 BarrierDistribution* convolve_spike(const BarrierDistribution* base,
 				    double spike_param) {
   BarrierDistribution* result;
-  Dist_index* source_index;
-  Dist_index* target_index;
-  source_index = new Dist_index(base->delta,0,0,true);
-  target_index = new Dist_index(base->delta,0,0,true);
+  double loss;
+  int top = grown_range(loss_rows(base), spike_param, 0, base->tolerance, &loss);
+  vector<double> spike(top + 1);
+  for (int beta_b=0; beta_b <= top; beta_b++)
+    spike[beta_b] = spikedist(spike_param,beta_b);
+  BarrierDistribution grown(base);
+  grown.resize(top);
   result = new BarrierDistribution(base->delta,zero);
-  for (int beta_a=0; beta_a <= maxsteps; beta_a++) 
-    for (int beta_b=0; beta_b <= (maxsteps-beta_a); beta_b++)
-      for (int r_iso=0; r_iso <= base->delta; r_iso++)
-	for (bool pend : {false, true}) {
-	  source_index->set(beta_a,r_iso,pend);
-	  target_index->set(beta_a+beta_b,r_iso,pend);
-	  result->set(target_index,result->get(target_index)
-		      + base->get(source_index)*spikedist(spike_param,beta_b));
-	}
-  delete(source_index);
-  delete(target_index);
+  result->resize(top);
+  result->leaked = base->leaked + loss;
+  result->tolerance = base->tolerance;
+  markov_convolve(&grown.sites[0], &result->sites[0], 2*maxdelta + 2, top + 1,
+		  markov_columns(PowChain(base->delta, reflect, 0, 0)), &spike[0]);
+  return(result);
+}
+
+DensityBounds spike_bounds(const BarrierDistribution* stationary,
+			   double adv_param,
+			   double hon_param,
+			   double spike_param,
+			   int w) {
+  PowChain chain(stationary->delta, absorb, adv_param, hon_param);
+  // The chain's advance stops at its range; the walk's is all of the Poisson.
+  BoundWalk walk(chain, [adv_param](double theta) { return(adv_param * (exp(theta) - 1)); });
+  // The spike is Poisson too, independent of the phase.
+  BoundStart start = [stationary, spike_param, &chain](double theta) {
+    vector<double> result;
+    for (int phase = 0; phase < chain.phases(); phase++) {
+      vector<double> terms;
+      int column = chain.column(phase);
+      for (int beta = 0; beta <= stationary->top; beta++) {
+	double site = stationary->sites[size_t(beta) * (2*maxdelta + 2) + column];
+	if (site > 0) terms.push_back(log(site) + theta * beta); }
+      result.push_back(bound_log_sum(terms) + spike_param * (exp(theta) - 1)); }
+    return(result); };
+  DensityBounds result = {1 - walk.reach_below(start, 0, w), walk.upper_tail(start, 1, w)};
   return(result);
 }
 
@@ -266,32 +451,166 @@ BarrierDistribution* evolve(const BarrierDistribution* source,
 			    EvolutionType convention,
 			    double adv_param,
 			    double hon_param) {
-  double h_transition_pr;
   BarrierDistribution* result;
-  Dist_index* source_index;
-  Dist_index* target_index;
-  int initial_beta;
-  if (convention==reflect)
-    initial_beta = 0;
-  else
-    initial_beta = 1;
-  source_index = new Dist_index(source->delta,0,0,true);
   result = new BarrierDistribution(source->delta,zero);
-  for (int hon : {0, 1, 2}) {            // Honest move
-    if (hon == 0) h_transition_pr = exp(-hon_param);
-    else if (hon == 1) h_transition_pr = hon_param * exp(-hon_param);
-    else h_transition_pr = 1 - exp(-hon_param) * (1 + hon_param);
-    for (int adv=0; adv <= maxsteps; adv++)  // Adversarial move
-      for (int beta=initial_beta; beta <= (maxsteps-adv); beta++)
-	for (int r_iso=0; r_iso <= source->delta; r_iso++)
-	  for (bool pend : {false, true}) {
-	    source_index->set(beta,r_iso,pend);
-	    target_index = source_index->evolve(adv,hon);
-	    result->set(target_index,result->get(target_index)
-			+ source->get(source_index) * Poisson(adv_param,adv) * h_transition_pr);
-	    delete(target_index);
-	  }};
-  delete(source_index);
+  evolve(source, result, convention, adv_param, hon_param);
+  return(result);
+}
+
+// Same evolution into an existing distribution of the same delta, so
+// that long runs can ping-pong between two buffers.
+void evolve(const BarrierDistribution* source,
+	    BarrierDistribution* result,
+	    EvolutionType convention,
+	    double adv_param,
+	    double hon_param) {
+  if (result->delta != source->delta) throw std::invalid_argument("evolution target has another delta");
+  // Reflected, the barrier row lands on the advance alone and is lost
+  // past top as any other; absorbed, it is meant to go.
+  double loss;
+  int top = grown_range(loss_rows(source), adv_param, (convention == reflect) ? 0 : 1, source->tolerance, &loss);
+  BarrierDistribution* grown = NULL;
+  if (top > source->top) {
+    grown = new BarrierDistribution(source);
+    grown->resize(top);
+    source = grown; }
+  result->resize(top);
+  result->leaked = source->leaked + loss;
+  result->tolerance = source->tolerance;
+  PowChain chain(source->delta, convention, adv_param, hon_param, top);
+  MarkovStencil stencil(chain, 2*maxdelta + 2);
+  markov_evolve(chain, stencil, &source->sites[0], &result->sites[0], 0, top);
+  delete(grown);
+}
+
+/* DualBarrierDistribution keeps its range as BarrierDistribution
+   does: each evolution and convolution first grows it to lose at most
+   the tolerance, judged on the values, and the values' loss adds to
+   leak(). */
+
+DualBarrierDistribution::DualBarrierDistribution(int init_delta,
+						 InitializationType structure) : delta(init_delta),
+										 sites(size_t(footprint) * (2*maxdelta + 2)),
+										 top(maxsteps),
+										 leaked(0.0),
+										 tolerance(leak_tolerance) {
+  if (init_delta > maxdelta) throw std::invalid_argument("Delta index out of range");
+  if (structure==identity) {
+    Dist_index index(delta,0,0,false);
+    sites[index.get_internal()] = 1.0; }
+}
+
+// All of the original's range, with its leak and tolerance.
+DualBarrierDistribution::DualBarrierDistribution(const BarrierDistribution* orig) : delta(orig->delta),
+										    sites(size_t(orig->range() + 1) * (2*maxdelta + 2)),
+										    top(orig->range()),
+										    leaked(orig->leaked),
+										    tolerance(orig->tolerance) {
+  const double* cells = orig->site_data();
+  for (size_t cell = 0; cell < sites.size(); cell++)
+    sites[cell] = cells[cell];
+}
+
+// Copy constructor
+DualBarrierDistribution::DualBarrierDistribution(const DualBarrierDistribution* orig) : delta(orig->delta),
+											sites(orig->sites),
+											top(orig->top),
+											leaked(orig->leaked),
+											tolerance(orig->tolerance) {}
+
+const Dual* DualBarrierDistribution::site_data() const {
+  return(&sites[0]);
+}
+
+int DualBarrierDistribution::range() const {
+  return(top);
+}
+
+double DualBarrierDistribution::leak() const {
+  return(leaked);
+}
+
+void DualBarrierDistribution::set_leak_tolerance(double init_tolerance) {
+  if (!(init_tolerance >= 0)) throw std::invalid_argument("leak tolerance must be nonnegative");
+  tolerance = init_tolerance;
+}
+
+void DualBarrierDistribution::resize(int new_top) {
+  sites.resize(size_t(new_top + 1) * (2*maxdelta + 2), Dual(0.0));
+  top = new_top;
+}
+
+// The Dual cells read as doubles: a row is 2 (2 maxdelta + 2) of them,
+// value then slope, so the value of column c is at 2c and its slope
+// at 2c + 1.
+static vector<int> dual_columns(int delta, int part) {
+  vector<int> result;
+  for (int column : markov_columns(PowChain(delta, reflect, 0, 0)))
+    result.push_back(2 * column + part);
+  return(result);
+}
+
+static LossRows loss_rows(const DualBarrierDistribution* source) {
+  LossRows result = {&source->site_data()->value, 2 * (2*maxdelta + 2),
+		     dual_columns(source->delta, 0), source->range()};
   return(result);
 }
 
+Dual DualBarrierDistribution::pdensity() const {
+  const double* cells = &sites[0].value;
+  return(Dual(markov_sum(cells, 2 * (2*maxdelta + 2), 1, top, dual_columns(delta, 0)),
+	      markov_sum(cells, 2 * (2*maxdelta + 2), 1, top, dual_columns(delta, 1))));
+}
+
+// Over the larger range of the two, the rows beyond the smaller zero.
+double stat_distance(const DualBarrierDistribution* dista,
+		     const DualBarrierDistribution* distb) {
+  if (dista->top < distb->top) return(stat_distance(distb, dista));
+  if (dista->top > distb->top) {
+    DualBarrierDistribution grown(distb);
+    grown.resize(dista->top);
+    return(stat_distance(dista, &grown)); }
+  return(markov_distance(&dista->sites[0].value, &distb->sites[0].value, 2 * (2*maxdelta + 2), 0, dista->top,
+			 dual_columns(dista->delta, 0)));
+}
+
+DualBarrierDistribution* convolve_spike(const DualBarrierDistribution* base,
+					Dual spike_param) {
+  DualBarrierDistribution* result;
+  double loss;
+  int top = grown_range(loss_rows(base), spike_param.value, 0, base->tolerance, &loss);
+  vector<Dual> spike(top + 1);
+  for (int beta_b=0; beta_b <= top; beta_b++)
+    spike[beta_b] = spikedist(spike_param,beta_b);
+  DualBarrierDistribution grown(base);
+  grown.resize(top);
+  result = new DualBarrierDistribution(base->delta,zero);
+  result->resize(top);
+  result->leaked = base->leaked + loss;
+  result->tolerance = base->tolerance;
+  markov_convolve(&grown.sites[0], &result->sites[0], 2*maxdelta + 2, top + 1,
+		  markov_columns(PowChain(base->delta, reflect, 0, 0)), &spike[0]);
+  return(result);
+}
+
+void evolve(const DualBarrierDistribution* source,
+	    DualBarrierDistribution* result,
+	    EvolutionType convention,
+	    Dual adv_param,
+	    Dual hon_param) {
+  if (result->delta != source->delta) throw std::invalid_argument("evolution target has another delta");
+  double loss;
+  int top = grown_range(loss_rows(source), adv_param.value, (convention == reflect) ? 0 : 1, source->tolerance, &loss);
+  DualBarrierDistribution* grown = NULL;
+  if (top > source->top) {
+    grown = new DualBarrierDistribution(source);
+    grown->resize(top);
+    source = grown; }
+  result->resize(top);
+  result->leaked = source->leaked + loss;
+  result->tolerance = source->tolerance;
+  PowChainOf<Dual> chain(source->delta, convention, adv_param, hon_param, top);
+  MarkovStencilOf<Dual> stencil(chain, 2*maxdelta + 2);
+  markov_evolve(chain, stencil, &source->sites[0], &result->sites[0], 0, top);
+  delete(grown);
+}
@@ -17,12 +17,18 @@ limitations under the License.
 #ifndef __BARRIER_H
 #define __BARRIER_H
 
+#include <vector>
+#include "dual.h"
+#include "bound.h"
+
 enum EvolutionType {reflect, absorb};
 enum InitializationType {zero, identity};
 
-const int maxsteps = 200;
+const int maxsteps = 200;        // the beta range a distribution starts with
 const int footprint = maxsteps + 1;
 const int maxdelta = 30;
+const int beta_limit = 20000;    // no range grows beyond this
+const double leak_tolerance = 1e-15;  // default truncation loss allowed per step
 
 class Dist_index {
 public:
@@ -54,17 +60,38 @@ public:
   void show() const;  
   double pdensity() const;
   double tdensity() const;
+  const double* site_data() const;  // sites, row-major, read-only
+  int    range() const;   // largest beta held, maxsteps or more
+  double leak() const;    // mass lost beyond the range so far
+  size_t bytes() const;   // held, the sites with the object
+  void   set_leak_tolerance(double);  // per step, passed on to evolutions
   friend double stat_distance(const BarrierDistribution*,
 			      const BarrierDistribution*);
   friend BarrierDistribution* convolve_spike(const BarrierDistribution*,
 					     double);  // spike param
+  friend DensityBounds spike_bounds(const BarrierDistribution*,
+				    double,
+				    double,
+				    double,
+				    int);
   friend BarrierDistribution* evolve(const BarrierDistribution*,
 				     EvolutionType,
 				     double,  // adversarial Poisson param
 				     double); // honest prob
+  friend void evolve(const BarrierDistribution*,  // source
+		     BarrierDistribution*,        // target, overwritten
+		     EvolutionType,
+		     double,  // adversarial Poisson param
+		     double); // honest prob
   
+  friend class DualBarrierDistribution;
+
 private:
-  double sites[footprint][2*maxdelta + 2];
+  std::vector<double> sites;  // rows [0 ... top] of 2*maxdelta + 2
+  int    top;
+  double leaked;
+  double tolerance;
+  void   resize(int);  // new top; rows kept, new ones zero
   int    rcheck_beta(int) const;
   int    rcheck_delta(int) const;
   // accessor functions
@@ -72,4 +99,46 @@ private:
   void   set(Dist_index*, double);  // index object, value
 };
 
+// The same distribution over Dual cells, each with its derivative along
+// one parameter, seeded in the Dual arguments (pow-sweep -i).
+class DualBarrierDistribution {
+
+public:
+  const int delta;
+  DualBarrierDistribution(int,InitializationType); // delta
+  DualBarrierDistribution(const BarrierDistribution*); // constant copy
+  DualBarrierDistribution(const DualBarrierDistribution*); // copy constructor
+  //
+  Dual   pdensity() const;
+  const Dual* site_data() const;  // sites, row-major, read-only
+  int    range() const;   // largest beta held, maxsteps or more
+  double leak() const;    // value mass lost beyond the range so far
+  void   set_leak_tolerance(double);  // per step, passed on to evolutions
+  friend double stat_distance(const DualBarrierDistribution*,  // of the values
+			      const DualBarrierDistribution*);
+  friend DualBarrierDistribution* convolve_spike(const DualBarrierDistribution*,
+						 Dual);  // spike param
+  friend void evolve(const DualBarrierDistribution*,  // source
+		     DualBarrierDistribution*,        // target, overwritten
+		     EvolutionType,
+		     Dual,   // adversarial Poisson param
+		     Dual);  // honest prob
+
+private:
+  std::vector<Dual> sites;  // rows [0 ... top] of 2*maxdelta + 2, as BarrierDistribution's
+  int    top;
+  double leaked;
+  double tolerance;
+  void   resize(int);  // new top; rows kept, new ones zero
+};
+
+// Bounds on pdensity() after w absorbing steps from a spike on a
+// stationary distribution, before the convolution (bound.h): the walk
+// is at least 1 at step w, and does not reach 0 on the way.
+DensityBounds spike_bounds(const BarrierDistribution*,  // stationary
+			   double,  // adversarial Poisson param
+			   double,  // honest prob
+			   double,  // spike param
+			   int);    // w
+
 #endif
@@ -0,0 +1,109 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "barriertools.h"
+#include "bench.h"
+
+using namespace std;
+
+/*
+  Times the pow kernels over a range of delta: evolve (reflect and
+  absorb, into an existing distribution), convolve_spike,
+  stat_distance and pdensity; then evolve again as throughput of
+  independent distributions on 1, 2, 4 ... threads. An update is one
+  (beta, internal) cell of the result; the bytes are one read and one
+  write of each cell (two reads for stat_distance, one for pdensity).
+  maxsteps is a compile-time constant here, so only delta varies.
+*/
+
+static const double hon_param = 0.1, adv_param = 0.04, spike = 5;
+
+int main(int argc, char **argv)
+{
+  string output = "bench-pow.json", baseline;
+  double noise = 0.10, min_seconds = 0.5;
+  bool quick = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "o:c:n:t:q")) != -1)
+    if (option == 'o') output = optarg;
+    else if (option == 'c') baseline = optarg;
+    else if (option == 'n') noise = atof(optarg);
+    else if (option == 't') min_seconds = atof(optarg);
+    else if (option == 'q') quick = true;
+    else {
+      cout << "Usage: " << argv[0] << " [-q] [-t seconds_per_case] [-o results.json] [-c baseline.json [-n noise]]" << endl;
+      cout << "  -q  fewer cases;  -c  flag cases slower than the baseline by more than noise (default 0.10)" << endl;
+      return 1; }
+
+  BenchReport report("pow");
+  report.measure_stream(thread_counts());
+
+  vector<int> deltas = quick ? vector<int>{2, 10} : vector<int>{1, 2, 5, 10, 20, 30};
+  for (int delta : deltas) {
+    string params = "delta=" + to_string(delta);
+    double updates = double(footprint) * (2 * delta + 2);
+    BarrierDistribution* distributions[2] = {new BarrierDistribution(delta,identity),
+					     new BarrierDistribution(delta,zero)};
+    for (int step = 0; step < 4; step++)
+      evolve(distributions[step % 2], distributions[1 - step % 2], reflect, adv_param, hon_param);
+
+    report.add({"evolve_reflect", params, 1,
+	  time_throughput(1, [&](int) { evolve(distributions[0], distributions[1], reflect, adv_param, hon_param); }, min_seconds),
+	  updates, 16 * updates});
+    report.add({"evolve_absorb", params, 1,
+	  time_throughput(1, [&](int) { evolve(distributions[0], distributions[1], absorb, adv_param, hon_param); }, min_seconds),
+	  updates, 16 * updates});
+    report.add({"convolve_spike", params, 1,
+	  time_throughput(1, [&](int) { delete(convolve_spike(distributions[0], spike)); }, min_seconds),
+	  updates, 16 * updates});
+    report.add({"stat_distance", params, 1,
+	  time_kernel([&] { stat_distance(distributions[0], distributions[1]); }, min_seconds),
+	  updates, 16 * updates});
+    report.add({"pdensity", params, 1,
+	  time_kernel([&] { distributions[0]->pdensity(); }, min_seconds),
+	  updates, 8 * updates});
+    delete(distributions[0]);
+    delete(distributions[1]); }
+
+  // Throughput of independent evolutions, as a sweep runs them.
+  for (int threads : thread_counts()) {
+    vector<BarrierDistribution*> sources, targets;
+    for (int thread = 0; thread < threads; thread++) {
+      sources.push_back(new BarrierDistribution(5,identity));
+      targets.push_back(new BarrierDistribution(5,zero)); }
+    double updates = double(footprint) * 12;
+    report.add({"evolve_absorb", "delta=5 independent", threads,
+	  time_throughput(threads, [&](int thread) { evolve(sources[thread], targets[thread], absorb, adv_param, hon_param); }, min_seconds),
+	  updates, 16 * updates});
+    for (int thread = 0; thread < threads; thread++) {
+      delete(sources[thread]);
+      delete(targets[thread]); }}
+
+  ofstream json(output.c_str());
+  report.write(json);
+  json.close();
+  cout << "Results in " << output << endl;
+  if (!baseline.empty())
+    return(report.compare(baseline, noise, cout) > 0 ? 1 : 0);
+  return 0;
+}
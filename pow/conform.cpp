@@ -0,0 +1,156 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "barriertools.h"
+#include "batch.h"
+#include "conform.h"
+
+using namespace std;
+
+/*
+  Checks pow and powthr against the reference runs in conformance.txt,
+  job records as powbatch takes, each with its golden results:
+
+    tool=pow ... densities=d1,d2,...   the density every `every' steps
+    tool=powthr ... steps=s1,s2,...    the steps for each spike
+
+  Records with fast=1 make up the default subset, which runs in
+  seconds; -f runs them all. Densities conform within the -r and -a
+  tolerances, step counts exactly. Reflect evolution conserves mass,
+  so the stationary solve also checks tdensity() against 1 within -m.
+  -u writes the records back with freshly computed golden values.
+*/
+
+static Tolerance tolerance = {1e-9, 1e-15};
+static double mass_allowed = 1e-12;
+
+static BarrierDistribution* stationary_for(const JobRecord& job, ConformReport& report) {
+  int delta = job.integer("delta");
+  if ((delta < 1) || (delta > maxdelta)) throw std::invalid_argument("CONFORM: delta out of range");
+  double hon_param = job.number("hon_param");
+  double adv_param = job.number("adv_param");
+  double approx_error = job.number("approx_error");
+  BarrierDistribution* distributions[2];
+  distributions[0] = new BarrierDistribution(delta,identity);
+  distributions[1] = new BarrierDistribution(delta,zero);
+  double error = 1;
+  int step;
+  for  (step = 1; error > approx_error; step++) {
+    evolve(distributions[(step - 1) % 2], distributions[step % 2],
+	   reflect, adv_param, hon_param);
+    report.invariant(job.lead() + " mass after reflect step " + to_string(step),
+		     1.0, distributions[step % 2]->tdensity(), mass_allowed);
+    error = stat_distance(distributions[0],distributions[1]); }
+  delete(distributions[step % 2]);
+  return(distributions[(step - 1) % 2]);
+}
+
+// The density after each step from the spike, until done(step, density).
+template <class Done> static vector<double> walk(const BarrierDistribution* stationary,
+						  double spike,
+						  double adv_param,
+						  double hon_param,
+						  Done done) {
+  vector<double> densities;
+  BarrierDistribution* distributions[2];
+  distributions[0] = convolve_spike(stationary,spike);
+  distributions[1] = new BarrierDistribution(stationary->delta,zero);
+  for (int step = 1; ; step++) {
+    evolve(distributions[(step - 1) % 2], distributions[step % 2],
+	   absorb, adv_param, hon_param);
+    densities.push_back(distributions[step % 2]->pdensity());
+    if (done(step, densities.back())) break; }
+  delete(distributions[0]);
+  delete(distributions[1]);
+  return(densities);
+}
+
+// Runs one record, giving the golden field's name and computed values.
+static string run_case(const JobRecord& job, ConformReport& report, vector<double>& computed) {
+  string tool = job.text("tool");
+  if ((tool != "pow") && (tool != "powthr")) throw std::invalid_argument("CONFORM: unknown tool " + tool);
+  double hon_param = job.number("hon_param");
+  double adv_param = job.number("adv_param");
+  BarrierDistribution* stationary = stationary_for(job, report);
+  computed.clear();
+  if (tool == "pow") {
+    int w = job.integer("w");
+    int every = job.integer("every", 10);
+    if ((w < 1) || (every < 1)) throw std::invalid_argument("CONFORM: w or every out of range");
+    vector<double> densities = walk(stationary, job.number("spike"), adv_param, hon_param,
+				    [&](int step, double) { return(step >= w); });
+    for (int step = every; step <= w; step = step + every)
+      computed.push_back(densities[step - 1]); }
+  else {
+    double threshold = job.number("threshold");
+    for (int spike = job.integer("spike_begin"); spike <= job.integer("spike_end"); spike++)
+      computed.push_back(walk(stationary, double(spike), adv_param, hon_param,
+			      [&](int, double density) { return(density <= threshold); }).size()); }
+  delete(stationary);
+  return((tool == "pow") ? "densities" : "steps");
+}
+
+int main(int argc, char **argv)
+{
+  string golden = "conformance.txt";
+  bool full = false, update = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "g:r:a:m:fu")) != -1)
+    if (option == 'g') golden = optarg;
+    else if (option == 'r') tolerance.relative = atof(optarg);
+    else if (option == 'a') tolerance.absolute = atof(optarg);
+    else if (option == 'm') mass_allowed = atof(optarg);
+    else if (option == 'f') full = true;
+    else if (option == 'u') update = true;
+    else {
+      cout << "Usage: " << argv[0] << " [-f] [-g golden] [-r relative] [-a absolute] [-m mass] [-u]" << endl;
+      cout << "  -f  all reference runs, not just the fast subset;  -u  write the records with fresh golden values" << endl;
+      return 1; }
+
+  ifstream in(golden.c_str());
+  if (!in) {
+    cerr << "Cannot read " << golden << endl;
+    return 1; }
+  ConformReport report(update ? cerr : cout);
+  string line;
+  while (getline(in, line)) {
+    if (JobRecord::blank(line)) {
+      if (update) cout << line << "\n";
+      continue; }
+    JobRecord job(line);
+    if (!full && !update && (job.integer("fast", 0) == 0)) continue;
+    vector<double> computed;
+    string field = run_case(job, report, computed);
+    if (update) {
+      cout << without_field(line, field) << " " << field << "=" << golden_text(computed) << "\n" << std::flush;
+      continue; }
+    vector<double> expected = golden_list(job.text(field));
+    report.value(job.lead() + " result count", expected.size(), computed.size(), Tolerance{0, 0});
+    for (size_t at = 0; (at < expected.size()) && (at < computed.size()); at++)
+      report.value(job.lead() + " " + field + "[" + to_string(at) + "]", expected[at], computed[at],
+		   (field == "steps") ? Tolerance{0, 0} : tolerance);
+    cout << job.lead() << ": " << computed.size() << " results checked" << endl; }
+  return(report.finish(full ? "pow conformance (full)" : "pow conformance (fast)"));
+}
@@ -0,0 +1,123 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <string>
+#include <stdexcept>
+#include "barriertools.h"
+#include "libpow.h"
+
+using namespace std;
+
+static thread_local string last_error;
+
+static const BarrierDistribution* unwrap(const pow_distribution* distribution) {
+  if (distribution == NULL) throw std::invalid_argument("POW: NULL distribution");
+  return(reinterpret_cast<const BarrierDistribution*>(distribution));
+}
+
+static BarrierDistribution* unwrap(pow_distribution* distribution) {
+  if (distribution == NULL) throw std::invalid_argument("POW: NULL distribution");
+  return(reinterpret_cast<BarrierDistribution*>(distribution));
+}
+
+static pow_distribution* wrap(BarrierDistribution* distribution) {
+  return(reinterpret_cast<pow_distribution*>(distribution));
+}
+
+template <class Value> static Value* result_pointer(Value* pointer) {
+  if (pointer == NULL) throw std::invalid_argument("POW: NULL result pointer");
+  return(pointer);
+}
+
+SPIKE_EXPORT int pow_abi_version(void) {
+  return(SPIKE_ABI_VERSION);
+}
+
+SPIKE_EXPORT const char* pow_last_error(void) {
+  return(last_error.c_str());
+}
+
+SPIKE_EXPORT int pow_create(int delta, int initial, pow_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	if ((delta < 1) || (delta > maxdelta)) throw std::invalid_argument("POW: delta out of range");
+	if ((initial != POW_ZERO) && (initial != POW_IDENTITY)) throw std::invalid_argument("POW: unknown initial distribution");
+	*result_pointer(created) = wrap(new BarrierDistribution(delta, (initial == POW_ZERO) ? zero : identity)); }));
+}
+
+SPIKE_EXPORT int pow_copy(const pow_distribution* source, pow_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(created) = wrap(new BarrierDistribution(unwrap(source))); }));
+}
+
+SPIKE_EXPORT void pow_destroy(pow_distribution* distribution) {
+  delete(reinterpret_cast<BarrierDistribution*>(distribution));
+}
+
+SPIKE_EXPORT int pow_evolve(const pow_distribution* source, pow_distribution* target,
+			    int evolution, double adv_param, double hon_param) {
+  return(cabi_guard(last_error, [&] {
+	if ((evolution != POW_REFLECT) && (evolution != POW_ABSORB)) throw std::invalid_argument("POW: unknown evolution");
+	if (unwrap(source)->delta != unwrap(target)->delta) throw std::invalid_argument("POW: evolution target has another delta");
+	if (source == target) throw std::invalid_argument("POW: evolution target is the source");
+	evolve(unwrap(source), unwrap(target), (evolution == POW_REFLECT) ? reflect : absorb, adv_param, hon_param); }));
+}
+
+SPIKE_EXPORT int pow_convolve_spike(const pow_distribution* source, double spike, pow_distribution** created) {
+  return(cabi_guard(last_error, [&] {
+	if (spike < 0) throw std::invalid_argument("POW: negative spike");
+	*result_pointer(created) = wrap(convolve_spike(unwrap(source), spike)); }));
+}
+
+SPIKE_EXPORT int pow_stat_distance(const pow_distribution* a, const pow_distribution* b, double* distance) {
+  return(cabi_guard(last_error, [&] {
+	if (unwrap(a)->delta != unwrap(b)->delta) throw std::invalid_argument("POW: distributions have different delta");
+	*result_pointer(distance) = stat_distance(unwrap(a), unwrap(b)); }));
+}
+
+SPIKE_EXPORT int pow_pdensity(const pow_distribution* distribution, double* density) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(density) = unwrap(distribution)->pdensity(); }));
+}
+
+SPIKE_EXPORT int pow_tdensity(const pow_distribution* distribution, double* density) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(density) = unwrap(distribution)->tdensity(); }));
+}
+
+SPIKE_EXPORT int pow_view(const pow_distribution* distribution, spike_view* view) {
+  return(cabi_guard(last_error, [&] {
+	const BarrierDistribution* source = unwrap(distribution);
+	spike_view* result = result_pointer(view);
+	result->data = source->site_data();
+	result->rank = 2;
+	result->shape[0] = source->range() + 1;
+	result->shape[1] = 2 * maxdelta + 2;
+	result->strides[0] = sizeof(double) * (2 * maxdelta + 2);
+	result->strides[1] = sizeof(double);
+	result->used[0] = source->range() + 1;
+	result->used[1] = 2 * source->delta + 2; }));
+}
+
+SPIKE_EXPORT int pow_leak(const pow_distribution* distribution, double* leak) {
+  return(cabi_guard(last_error, [&] {
+	*result_pointer(leak) = unwrap(distribution)->leak(); }));
+}
+
+SPIKE_EXPORT int pow_set_leak_tolerance(pow_distribution* distribution, double tolerance) {
+  return(cabi_guard(last_error, [&] {
+	unwrap(distribution)->set_leak_tolerance(tolerance); }));
+}
@@ -0,0 +1,75 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#ifndef __LIBPOW_H
+#define __LIBPOW_H
+
+/*
+  C interface to the pow barrier distributions, built as libpow.so.
+  Result codes and views are those of cabi.h. Distributions made here
+  are freed with pow_destroy(); pointer arguments may not be NULL.
+
+  A view has rank 2: row beta in [0 ... range], column the internal
+  index, r_isolation when the left isolation is pending and
+  r_isolation + delta + 1 when not, of which the first 2 delta + 2
+  are used. The range starts at 200 (maxsteps) and grows when an
+  evolution or spike would lose more than the leak tolerance beyond
+  it; pow_leak() gives the mass lost so far. Growing moves the sites,
+  so a view of an evolution's target is only good until the next
+  evolution into it.
+*/
+
+#include "cabi.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pow_distribution pow_distribution;
+
+#define POW_ZERO      0
+#define POW_IDENTITY  1
+
+#define POW_REFLECT   0
+#define POW_ABSORB    1
+
+int         pow_abi_version(void);
+const char* pow_last_error(void);
+
+int  pow_create(int delta, int initial, pow_distribution** created);  /* POW_ZERO or POW_IDENTITY */
+int  pow_copy(const pow_distribution* source, pow_distribution** created);
+void pow_destroy(pow_distribution* distribution);
+
+/* One step from source into target, which must have the same delta. */
+int  pow_evolve(const pow_distribution* source, pow_distribution* target,
+		int evolution, double adv_param, double hon_param);
+int  pow_convolve_spike(const pow_distribution* source, double spike, pow_distribution** created);
+int  pow_stat_distance(const pow_distribution* a, const pow_distribution* b, double* distance);
+
+int  pow_pdensity(const pow_distribution* distribution, double* density);
+int  pow_tdensity(const pow_distribution* distribution, double* density);
+int  pow_view(const pow_distribution* distribution, spike_view* view);
+
+/* Truncation loss so far, and that allowed per step (inherited by
+   evolution targets and spikes; 1e-15 by default). */
+int  pow_leak(const pow_distribution* distribution, double* leak);
+int  pow_set_leak_tolerance(pow_distribution* distribution, double tolerance);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
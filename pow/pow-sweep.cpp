@@ -0,0 +1,377 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include "barriertools.h"
+#include "sweep.h"
+#include "inverse.h"
+#include "bound.h"
+
+using namespace std;
+
+/*
+  Sweeps pow over a grid of (hon_param, adv_param, delta, approx_error,
+  spike, w). Each finished point adds a line to the result log: its
+  key, a tab, and the densities at steps every, 2 every, ... and w
+  (only at w by default), as pow prints them.
+
+  The stationary distribution depends only on (hon_param, adv_param,
+  delta, approx_error). It is computed once, by a task of its own,
+  which then submits the spike evolutions that use it; the last of
+  those frees it. Spikes that differ only in w share one evolution.
+
+  With -i target each point of a grid without adv_param (or, with
+  -x spike, without spike) is solved for the largest value of that
+  parameter, in the range -r, whose density at w is at most target,
+  to 1e-6. The range is by default 0 to the effective honest rate
+  hon_param * exp(-hon_param * (2 delta + 1)), past which there is no
+  stationary distribution, or for the spike 0 to maxsteps, doubled up
+  to beta_limit while even its high end is within the target. Each
+  trial evolves Dual distributions carrying the derivative along the
+  parameter, growing their beta range as pow does, for the Newton
+  steps of inverse.h; a spike solve computes the stationary
+  distribution once, as it does not depend on the spike. The point's
+  line has the key with target=..., then the parameter, the density
+  there and its derivative, the number of evaluations, and
+  "infeasible" if even the low end of the range is above the target;
+  or, with no answer, "not bracketed" and the density at the high end
+  if even that is within the target, "not monotone" and the slope
+  where the density fell, or "truncated" and the truncation loss if
+  a trial lost more than a millionth of the target beyond the range.
+
+  With -b target each point is first bounded from its stationary
+  distribution (bound.h), which settles whether the density at w is
+  at most target, without the spike's evolution, when the point is far
+  from it; the spikes the bounds leave open are evolved as above. The
+  stationary distributions are computed either way. The point's line
+  has the key with threshold=..., then the density or the bound that
+  settled it, "below" or "above" the target, and "exact" or "bound".
+*/
+
+struct SpikeGroup {
+  double            spike;
+  vector<GridPoint> points;
+};
+
+struct StationaryGroup {
+  double                        hon_param, adv_param, approx_error;
+  int                           delta;
+  map<double, SpikeGroup>       spikes;
+};
+
+static int last_w(const SpikeGroup& group) {
+  int w = 0;
+  for (const GridPoint& point : group.points)
+    w = max(w, int(point.get("w")));
+  return(w);
+}
+
+static void run_spike(const StationaryGroup& base,
+		      const SpikeGroup& group,
+		      shared_ptr<const BarrierDistribution> stationary,
+		      int every,
+		      double target,
+		      ResultLog& log) {
+  map<int, double> density;  // at every reported step of the group
+  for (const GridPoint& point : group.points) {
+    int point_w = point.get("w");
+    for (int step = every; step < point_w; step = step + every)
+      density[step] = 0.0;
+    density[point_w] = 0.0; }
+
+  BarrierDistribution* current = convolve_spike(stationary.get(), group.spike);
+  int step = 0;
+  for (map<int, double>::iterator report = density.begin(); report != density.end(); report++) {
+    for (; step < report->first; step++) {
+      BarrierDistribution* next = evolve(current, absorb, base.adv_param, base.hon_param);
+      delete(current);
+      current = next; }
+    report->second = current->pdensity(); }
+  delete(current);
+
+  for (const GridPoint& point : group.points) {
+    int point_w = point.get("w");
+    if (target > 0) {
+      log.record(bound_key(point.key(), target), bound_result(density[point_w], target, true));
+      continue; }
+    ostringstream result;
+    result << setprecision(17);
+    for (int step = every; step < point_w; step = step + every)
+      result << density[step] << " ";
+    result << density[point_w];
+    log.record(point.key(), result.str()); }
+}
+
+// With a tally (-b), only the points the bounds leave open are evolved.
+static void run_stationary(const StationaryGroup& base,
+			   int every,
+			   double target,
+			   BoundTally* tally,
+			   WorkStealingPool& pool,
+			   ResultLog& log) {
+  BarrierDistribution* distributions[2];
+  distributions[0] = new BarrierDistribution(base.delta,identity);
+  double error = 1;
+  int step;
+  for  (step = 1; error > base.approx_error; step++) {
+    distributions[step % 2] = evolve(distributions[(step - 1) % 2],
+				     reflect,
+				     base.adv_param, base.hon_param);
+    error = stat_distance(distributions[0],distributions[1]);
+    delete(distributions[(step - 1) % 2]); }
+  shared_ptr<const BarrierDistribution> stationary(distributions[(step-1) % 2]);
+  for (map<double, SpikeGroup>::const_iterator at = base.spikes.begin(); at != base.spikes.end(); at++) {
+    const SpikeGroup* group = &at->second;
+    if (tally != NULL) {
+      shared_ptr<SpikeGroup> open(new SpikeGroup());
+      open->spike = group->spike;
+      for (const GridPoint& point : group->points) {
+	DensityBounds found = spike_bounds(stationary.get(), base.adv_param, base.hon_param,
+					   group->spike, point.get("w"));
+	BoundVerdict verdict = bound_verdict(found, target);
+	tally->count(verdict);
+	if (verdict == bound_open)
+	  open->points.push_back(point);
+	else
+	  log.record(bound_key(point.key(), target),
+		     bound_result((verdict == bound_below) ? found.upper : found.lower, target, false)); }
+      if (!open->points.empty())
+	pool.submit(double(base.delta + 1) * last_w(*open),
+		    [&base, open, stationary, every, target, &log] {
+		      run_spike(base, *open, stationary, every, target, log); });
+      continue; }
+    pool.submit(double(base.delta + 1) * last_w(*group),
+		[&base, group, stationary, every, &log] { run_spike(base, *group, stationary, every, 0, log); }); }
+}
+
+// The stationary distribution from the identity, reflecting, to approx_error.
+template <class Distribution, class Scalar> Distribution* stationary_of(int delta,
+									 Scalar adv_param,
+									 Scalar hon_param,
+									 double approx_error) {
+  Distribution* distributions[2];
+  distributions[0] = new Distribution(delta,identity);
+  distributions[1] = new Distribution(delta,zero);
+  double error = 1;
+  int step;
+  for (step = 1; error > approx_error; step++) {
+    evolve(distributions[(step - 1) % 2], distributions[step % 2], reflect, adv_param, hon_param);
+    error = stat_distance(distributions[0],distributions[1]); }
+  delete(distributions[step % 2]);
+  return(distributions[(step - 1) % 2]);
+}
+
+// The most any call has lost beyond the range goes in *leak.
+static Dual spike_density(const DualBarrierDistribution* stationary,
+			  Dual adv_param,
+			  Dual hon_param,
+			  Dual spike,
+			  int w,
+			  double* leak) {
+  DualBarrierDistribution* current = convolve_spike(stationary, spike);
+  DualBarrierDistribution* next = new DualBarrierDistribution(stationary->delta, zero);
+  for (int step = 0; step < w; step++) {
+    evolve(current, next, absorb, adv_param, hon_param);
+    swap(current, next); }
+  Dual result = current->pdensity();
+  *leak = max(*leak, current->leak());
+  delete(current);
+  delete(next);
+  return(result);
+}
+
+static void run_inverse(const GridPoint& point,
+			const string& key,
+			const string& unknown,
+			double target,
+			double low,
+			double high,
+			bool widen,  // double high while the solve is not bracketed
+			ResultLog& log) {
+  double hon_param = point.get("hon_param");
+  double approx_error = point.get("approx_error");
+  int delta = point.get("delta");
+  int w = point.get("w");
+  InverseResult found;
+  double leak = 0;
+  if (unknown == "spike") {
+    double adv_param = point.get("adv_param");
+    BarrierDistribution* plain = stationary_of<BarrierDistribution>(delta, adv_param, hon_param, approx_error);
+    DualBarrierDistribution stationary(plain);
+    delete(plain);
+    int evaluations = 0;
+    for (;;) {
+      found = inverse_solve([&](double spike) {
+	  return(spike_density(&stationary, Dual(adv_param), Dual(hon_param), Dual(spike, 1.0), w, &leak)); },
+	target, low, high, 1e-6);
+      evaluations = evaluations + found.evaluations;
+      if (found.bracketed || !widen || (high >= beta_limit)) break;
+      low = high;
+      high = min(2 * high, double(beta_limit)); }
+    found.evaluations = evaluations; }
+  else {
+    double spike = point.get("spike");
+    found = inverse_solve([&](double adv_param) {
+	Dual adv(adv_param, 1.0);
+	DualBarrierDistribution* stationary =
+	  stationary_of<DualBarrierDistribution>(delta, adv, Dual(hon_param), approx_error);
+	Dual result = spike_density(stationary, adv, Dual(hon_param), Dual(spike), w, &leak);
+	delete(stationary);
+	return(result); },
+      target, low, high, 1e-6); }
+  string trouble = inverse_trouble(found);
+  ostringstream result;
+  if (!trouble.empty()) result << trouble;
+  else if (leak > 1e-6 * target) result << setprecision(17) << "truncated: leak " << leak;
+  else result << setprecision(17) << found.parameter << " " << found.density.value << " "
+	      << found.density.slope << " " << found.evaluations << (found.feasible ? "" : " infeasible");
+  log.record(key, result.str());
+}
+
+int main(int argc, char **argv)
+{
+  int threads = thread::hardware_concurrency();
+  int every = 0;
+  double target = 0, low = 0, high = -1;
+  double threshold = 0;
+  string unknown = "adv_param";
+  string results = "sweep.txt";
+  int option;
+
+  while ((option = getopt(argc, argv, "j:e:o:i:x:r:b:")) != -1)
+    if (option == 'j') threads = atoi(optarg);
+    else if (option == 'e') every = atoi(optarg);
+    else if (option == 'o') results = optarg;
+    else if (option == 'i') target = atof(optarg);
+    else if (option == 'x') unknown = optarg;
+    else if (option == 'b') threshold = atof(optarg);
+    else if (option == 'r') {
+      if (sscanf(optarg, "%lf:%lf", &low, &high) != 2) {
+	argc = 0;
+	break; }}
+    else {
+      argc = 0;
+      break; }
+  if (argc - optind < 1) {
+    cout << "Usage: " << argv[0] << " [-j threads] [-e every | -i target [-x adv_param|spike] [-r low:high]]" << endl;
+    cout << "       [-b target] [-o results] <grid>" << endl;
+    cout << "  grid lines: hon_param = 0.1   adv_param = 0.02, 0.04   delta = 2:10:2" << endl;
+    cout << "              approx_error = 1e-9   spike = 0:20:5   w = 200" << endl;
+    cout << "  -e  also record the density every `every' steps (default: only at w)" << endl;
+    cout << "  -i  instead find, for each point, the largest value of the parameter -x (default" << endl;
+    cout << "      adv_param), left out of the grid, whose density at w is at most target," << endl;
+    cout << "      searching -r (default 0 to the effective honest rate, or 0:" << maxsteps << " for the spike, widened" << endl;
+    cout << "      while even its high end is within the target)" << endl;
+    cout << "  -b  instead tell whether each density at w is at most target, from bounds where" << endl;
+    cout << "      they settle it and by evolution where they do not" << endl;
+    cout << "  -o  result log (default sweep.txt); points already in it are skipped" << endl;
+    return 0;
+  }
+  ifstream spec(argv[optind]);
+  if (!spec) {
+    cout << "Cannot read " << argv[optind] << endl;
+    return 1;
+  }
+  vector<GridPoint> points = read_grid(spec);
+  ResultLog log(results);
+
+  if (target > 0) {
+    if ((unknown != "adv_param") && (unknown != "spike"))
+      throw std::invalid_argument("POW-SWEEP: -x is adv_param or spike, not " + unknown);
+    WorkStealingPool pool(threads);
+    int skipped = 0, solves = 0;
+    for (const GridPoint& point : points) {
+      int delta = point.get("delta");
+      if ((delta < 1) || (delta > maxdelta) || (point.get("w") < 1))
+	throw std::invalid_argument("POW-SWEEP: delta or w out of range in " + point.key());
+      if (point.has(unknown)) throw std::invalid_argument("POW-SWEEP: -i solves for " + unknown + "; the grid may not fix it");
+      double hon_param = point.get("hon_param");
+      double point_high = (high >= 0) ? high : (unknown == "spike") ? double(maxsteps) :
+	hon_param * exp(-hon_param * (2 * delta + 1));
+      bool widen = (high < 0) && (unknown == "spike");
+      ostringstream key;
+      key << point.key() << " target=" << setprecision(12) << target;
+      if (log.done(key.str())) {
+	skipped++;
+	continue; }
+      solves++;
+      const GridPoint* at = &point;
+      string name = key.str();
+      pool.submit(double(delta + 1) * point.get("w"),
+		  [at, name, unknown, target, low, point_high, widen, &log] {
+		    run_inverse(*at, name, unknown, target, low, point_high, widen, log); }); }
+    cout << points.size() << " points, " << skipped << " already done, "
+	 << solves << " solves of " << unknown << " on " << threads << " threads" << endl;
+    pool.run();
+    cout << log.count() << " points in " << results << endl;
+    return 0; }
+
+  map<string, StationaryGroup> groups;
+  int skipped = 0, evolutions = 0;
+  for (const GridPoint& point : points) {
+    int delta = point.get("delta");
+    if ((delta < 1) || (delta > maxdelta) || (point.get("w") < 1) || (point.get("spike") < 0))
+      throw std::invalid_argument("POW-SWEEP: delta, spike or w out of range in " + point.key());
+    if (log.done((threshold > 0) ? bound_key(point.key(), threshold) : point.key())) {
+      skipped++;
+      continue; }
+    ostringstream name;
+    name << setprecision(12) << point.get("hon_param") << " " << point.get("adv_param")
+	 << " " << delta << " " << point.get("approx_error");
+    StationaryGroup& group = groups[name.str()];
+    group.hon_param = point.get("hon_param");
+    group.adv_param = point.get("adv_param");
+    group.approx_error = point.get("approx_error");
+    group.delta = delta;
+    SpikeGroup& spike = group.spikes[point.get("spike")];
+    if (spike.points.empty()) evolutions++;
+    spike.spike = point.get("spike");
+    spike.points.push_back(point); }
+  cout << points.size() << " points, " << skipped << " already done, "
+       << groups.size() << " stationary distributions and " << evolutions
+       << " evolutions on " << threads << " threads" << endl;
+
+  // A stationary task stands for all the evolutions it releases, so the
+  // groups with the most work behind them start first.
+  WorkStealingPool pool(threads);
+  int report_every = ((every > 0) && (threshold <= 0)) ? every : 1 << 30;
+  BoundTally tally;
+  BoundTally* bounding = (threshold > 0) ? &tally : NULL;
+  for (map<string, StationaryGroup>::iterator at = groups.begin(); at != groups.end(); at++) {
+    const StationaryGroup* group = &at->second;
+    double cost = 0;
+    for (map<double, SpikeGroup>::const_iterator spike = group->spikes.begin(); spike != group->spikes.end(); spike++)
+      cost = cost + double(group->delta + 1) * last_w(spike->second);
+    pool.submit(cost,
+		[group, report_every, threshold, bounding, &pool, &log] {
+		  run_stationary(*group, report_every, threshold, bounding, pool, log); }); }
+  pool.run();
+  if (bounding != NULL) cout << tally.report() << endl;
+  cout << log.count() << " points in " << results << endl;
+  return 0;
+}
@@ -16,71 +16,362 @@ limitations under the License.
 
 
 #include <iostream>
+#include <fstream>
 #include <stdexcept>
 #include <cmath>
+#include <cstdlib>
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unistd.h>
 #include "barriertools.h"
+#include "sink.h"
+#define PROBE_ALLOCATIONS
+#include "probe.h"
 
 using namespace std;
 
-int main()
+/*
+  Results go through a ResultSink (see sink.h): in the csv and binary
+  formats, 'e' records carry the stationary error of each step and 'd'
+  records the densities of a walk, each walk led by an 's' record at
+  step 0 holding its spike power.
+
+  The mass lost beyond the beta range, which grows to keep the loss
+  of each step within -L (default leak_tolerance), is reported with
+  the range after the stationary distribution and after each walk;
+  the densities may read low by as much.
+
+  So that the first answer comes as soon as it can, the stationary
+  distribution is computed by a thread of its own while the spikes
+  are read, and each spike is queued as soon as it is entered, for
+  -j workers (default one per core) that start on it once the
+  stationary distribution is there. A walk's densities go out
+  together when it completes, so with several workers walks may come
+  back out of order, each led by its "Spike ... over w steps" line
+  (the 's' record); with -j 1 they come in input order.
+
+  Every walk asked for is counted in a history file (-H, default
+  ~/.pow_history; -H "" for none), and once the stationary
+  distribution is ready the most frequent walks of earlier sessions
+  not yet asked for are computed on speculation, giving way to any
+  walk asked for, and kept to answer at once if they come.
+*/
+
+const int speculative_walks = 4;
+
+struct Walk {
+  double         spike;
+  int            w;
+  int            asked;    // times asked for by the user; 0 if only speculated
+  bool           done;
+  vector<double> density;  // at steps 1 ... w
+  double         leak;
+  int            range;
+};
+
+class WalkService {
+public:
+  WalkService(ResultSink& init_sink,
+	      ostream& init_talk,
+	      int init_every,
+	      double init_ratio,
+	      double init_adv_param,
+	      double init_hon_param) : sink(init_sink), talk(init_talk), every(init_every), ratio(init_ratio),
+				       adv_param(init_adv_param), hon_param(init_hon_param),
+				       stationary(NULL), closing(false) {}
+  ~WalkService() {
+    for (map<pair<double, int>, Walk*>::iterator at = walks.begin(); at != walks.end(); at++)
+      delete(at->second);
+    delete(stationary);
+  }
+
+  // The stationary distribution is ready, or abandoned short of the
+  // approximation error with no walk left to ask for it; speculate on
+  // what the history expects.
+  void ready(BarrierDistribution* init_stationary, const vector<pair<double, int> >& expected, bool complete) {
+    lock_guard<mutex> hold(lock);
+    stationary = init_stationary;
+    if (complete) talk << "\nStationary approximation complete.\n";
+    else talk << "\nStationary approximation abandoned: no walk asked for it.\n";
+    talk << "Truncation loss " << stationary->leak() << ", beta range 0..." << stationary->range() << "\n";
+    for (const pair<double, int>& walk : expected)
+      if ((int(speculated.size()) < speculative_walks) && (walks.find(walk) == walks.end()))
+	speculated.push_back(create(walk.first, walk.second, false));
+    ready_now.notify_all();
+  }
+
+  void ask(double spike, int w) {
+    lock_guard<mutex> hold(lock);
+    map<pair<double, int>, Walk*>::iterator known = walks.find(make_pair(spike, w));
+    if (known == walks.end()) {
+      asked.push_back(create(spike, w, true));
+      ready_now.notify_one();
+      return; }
+    // Every ask gets its own answer, a walk asked before included.
+    Walk* walk = known->second;
+    if (walk->done) {
+      emit(walk);
+      return; }
+    if (walk->asked++ == 0) {
+      // Still to start: ahead of the other guesses, behind what was asked.
+      deque<Walk*>::iterator waiting = find(speculated.begin(), speculated.end(), walk);
+      if (waiting != speculated.end()) {
+	speculated.erase(waiting);
+	asked.push_back(walk);
+	ready_now.notify_one(); }}
+  }
+
+  // Whether the stationary distribution is still needed, for a walk asked for.
+  bool wanted() {
+    lock_guard<mutex> hold(lock);
+    return(!closing || !asked.empty() || busy > 0);
+  }
+
+  void work() {
+    unique_lock<mutex> hold(lock);
+    for (;;) {
+      ready_now.wait(hold, [this] {
+	  return(closing ? (asked.empty() || stationary != NULL)
+		 : ((stationary != NULL) && (!asked.empty() || !speculated.empty()))); });
+      if (asked.empty() && (closing || speculated.empty())) return;
+      Walk* walk;
+      if (!asked.empty()) {
+	walk = asked.front();
+	asked.pop_front(); }
+      else {
+	walk = speculated.front();
+	speculated.pop_front(); }
+      busy++;
+      hold.unlock();
+      bool whole = run(walk);
+      hold.lock();
+      busy--;
+      if (!whole) {
+	// Given way to a walk asked for: start over later, if still wanted.
+	walk->density.clear();
+	if (walk->asked) asked.push_back(walk);
+	else if (!closing) speculated.push_front(walk);
+	continue; }
+      walk->done = true;
+      for (int answer = 0; answer < walk->asked; answer++)
+	emit(walk); }
+  }
+
+  void close() {
+    lock_guard<mutex> hold(lock);
+    closing = true;
+    ready_now.notify_all();
+  }
+
+private:
+  ResultSink&                    sink;
+  ostream&                       talk;
+  const int                      every;
+  const double                   ratio;
+  const double                   adv_param;
+  const double                   hon_param;
+  BarrierDistribution*           stationary;
+  bool                           closing;
+  int                            busy = 0;
+  deque<Walk*>                   asked;
+  deque<Walk*>                   speculated;
+  map<pair<double, int>, Walk*>  walks;
+  mutex                          lock;
+  condition_variable             ready_now;
+
+  Walk* create(double spike, int w, bool asked_for) {
+    Walk* walk = new Walk();
+    walk->spike = spike;
+    walk->w = w;
+    walk->asked = asked_for ? 1 : 0;
+    walk->done = false;
+    walks[make_pair(spike, w)] = walk;
+    return(walk);
+  }
+
+  // A walk only speculated on gives way to one asked for, or to closing.
+  bool preempted(const Walk* walk) {
+    lock_guard<mutex> hold(lock);
+    return(!walk->asked && (closing || !asked.empty()));
+  }
+
+  // False if the walk was preempted before it was done.
+  bool run(Walk* walk) {
+    double cells = double(stationary->range() + 1) * (2 * stationary->delta + 2);
+    BarrierDistribution* distributions[2];
+    {
+      ProbePhase phase("convolve_spike", cells);
+      distributions[0] = convolve_spike(stationary,walk->spike);
+    }
+    distributions[1] = new BarrierDistribution(stationary->delta,zero);
+    ostringstream trace;
+    trace << "density spike=" << walk->spike;
+    string series = trace.str();
+    for (int step = 1; step <= walk->w; step++) {
+      if ((step % 64 == 0) && preempted(walk)) {
+	delete(distributions[0]);
+	delete(distributions[1]);
+	return(false); }
+      {
+	ProbePhase phase("evolve_absorb", cells);
+	evolve(distributions[(step - 1) % 2], distributions[step % 2], absorb, adv_param, hon_param);
+      }
+      double new_density;
+      {
+	ProbePhase phase("pdensity", cells);
+	new_density = distributions[step % 2]->pdensity();
+      }
+      probe_trace(series, step, new_density);
+      walk->density.push_back(new_density); }
+    walk->leak = distributions[max(walk->w, 0) % 2]->leak();
+    walk->range = distributions[max(walk->w, 0) % 2]->range();
+    delete(distributions[0]);
+    delete(distributions[1]);
+    return(true);
+  }
+
+  // Under the lock, so that walks go out whole.
+  void emit(const Walk* walk) {
+    talk << "Spike " << walk->spike << " over " << walk->w << " steps:\n" << flush;
+    sink.put('s', 0, walk->spike);
+    sink.pace('d', every, ratio);
+    for (int step = 1; step <= walk->w; step++)
+      sink.put('d', step, walk->density[step - 1]);
+    sink.drain();
+    talk << "Truncation loss " << walk->leak << ", beta range 0..." << walk->range << "\n" << flush;
+  }
+};
+
+// The walks of the history, most frequent first.
+static vector<pair<double, int> > read_history(const string& path) {
+  map<pair<double, int>, int> counts;
+  ifstream history(path.c_str());
+  double spike;
+  int w;
+  while (history >> spike >> w)
+    counts[make_pair(spike, w)]++;
+  vector<pair<int, pair<double, int> > > ranked;
+  for (map<pair<double, int>, int>::iterator at = counts.begin(); at != counts.end(); at++)
+    ranked.push_back(make_pair(-at->second, at->first));
+  sort(ranked.begin(), ranked.end());
+  vector<pair<double, int> > result;
+  for (const pair<int, pair<double, int> >& walk : ranked)
+    result.push_back(walk.second);
+  return(result);
+}
+
+int main(int argc, char **argv)
 {
   double hon_param;
   double adv_param;
   double spike;
   double approx_error;
   int delta;
-  int w, step;
-  BarrierDistribution* distributions[2];
-  BarrierDistribution* stationary;
+  int w;
+  SinkFormat format = sink_human;
+  string output;
+  int every = 10;
+  double ratio = 0;
+  double tolerance = leak_tolerance;
+  int workers = max(1u, thread::hardware_concurrency());
+  string history = getenv("HOME") ? string(getenv("HOME")) + "/.pow_history" : "";
+  int option;
+
+  while ((option = getopt(argc, argv, "O:o:e:D:L:j:H:")) != -1)
+    if (option == 'O') format = sink_format(optarg);
+    else if (option == 'o') output = optarg;
+    else if (option == 'e') every = atoi(optarg);
+    else if (option == 'D') ratio = atof(optarg);
+    else if (option == 'L') tolerance = atof(optarg);
+    else if (option == 'j') workers = max(1, atoi(optarg));
+    else if (option == 'H') history = optarg;
+    else {
+      cout << "Usage: " << argv[0] << " [-O human|csv|binary] [-o output] [-e every] [-D ratio] [-L leak]" << endl;
+      cout << "       [-j workers] [-H history]" << endl;
+      cout << "  densities every `every' steps (default 10), only at steps ratio apart if ratio > 1" << endl;
+      cout << "  the beta range grows to lose at most leak per step (default " << leak_tolerance << ")" << endl;
+      cout << "  walks run on `workers' threads (default one per core), in input order with -j 1" << endl;
+      cout << "  the walks asked for are counted in history (default ~/.pow_history, \"\" for none)" << endl;
+      return 1; }
+  // With machine-readable results on standard output, prompts go to stderr.
+  ostream& talk = ((format != sink_human) && (output.empty() || (output == "-"))) ? cerr : cout;
   
-  cout << "Enter Poisson parameter for honest distribution: ";
+  probe_start("pow");
+  talk << "Enter Poisson parameter for honest distribution: ";
   cin  >> hon_param;
   
-  cout << "Enter networking delay (Delta, no more than " << maxdelta <<  "): ";
+  talk << "Enter networking delay (Delta, no more than " << maxdelta <<  "): ";
   cin  >> delta;
   
-  cout << "Effective honest unique, isolated probability: " << hon_param * exp(-hon_param * (2 * delta + 1)) << "\n";
-  cout << "Enter Poisson parameter of adversarial success: ";
+  talk << "Effective honest unique, isolated probability: " << hon_param * exp(-hon_param * (2 * delta + 1)) << "\n";
+  talk << "Enter Poisson parameter of adversarial success: ";
   cin  >> adv_param;
   
-  cout << "Enter step-to-step approximation error : ";
+  talk << "Enter step-to-step approximation error : ";
   cin  >> approx_error;
-  
-  distributions[0] = new BarrierDistribution(delta,identity);
-  cout << "Estimating stationary distribution...\n";
-  double error = 1;
-  for  (step = 1; error > approx_error; step++) {
-    distributions[step % 2] = evolve(distributions[(step - 1) % 2],
-				     reflect,
-				     adv_param, hon_param);
-    error = stat_distance(distributions[0],distributions[1]);
-    delete(distributions[(step - 1) % 2]);
-    cout << "[" << step << ":" << error << "]  \r" << std::flush; }
-  cout << "\n";
-  stationary = distributions[(step-1) % 2];
-  cout << "Stationary approximation complete.\n";
-  bool live = true;
-  while (live) {
-    cout << "Enter spike power (-1 to quit): ";
-    cin  >> spike;
-    if (spike < 0) live = false;
-    else {
-      cout << "Enter walk length for absorbtion estimates: ";
-      cin  >> w;
-      cout << "Computing spike distribution...\n";
-      cout << "Evolution beginning...\n";
-      distributions[0] = convolve_spike(stationary,spike);
-      for (step = 1; step <= w; step++) {
-	distributions[step % 2] = evolve(distributions[(step - 1) % 2],
-					 absorb,
-					 adv_param, hon_param);
-	delete(distributions[(step - 1) % 2]);
-	double new_density = distributions[step % 2]->pdensity();
-	if (step % 10 == 0)
-	  cout << "(" << step << ", " << new_density << ")\n" << std::flush;};
-      delete(distributions[w % 2]); }}
-  delete(stationary);
-  return 0;
-}
 
+  // The stationary errors are progress, overwriting one line, only
+  // while nothing else is printed: in human form they are left out.
+  ResultSink sink(format, output,
+		  {{"hon_param", hon_param}, {"delta", double(delta)}, {"adv_param", adv_param}},
+		  [](ostream& out, const SinkRecord& record) {
+		    if (record.kind == 'd')
+		      out << "(" << record.step << ", " << record.value << ")\n";
+		  },
+		  every, ratio);
+  sink.pace('e', 1, 0);
+  sink.pace('s', 1, 0);
 
+  WalkService service(sink, talk, every, ratio, adv_param, hon_param);
+  vector<pair<double, int> > expected;
+  if (!history.empty()) expected = read_history(history);
+  talk << "Estimating stationary distribution...\n";
+  thread estimate([&] {
+      double cells = double(footprint) * (2 * delta + 2);
+      BarrierDistribution* distributions[2];
+      distributions[0] = new BarrierDistribution(delta,identity);
+      distributions[0]->set_leak_tolerance(tolerance);
+      distributions[1] = new BarrierDistribution(delta,zero);
+      double error = 1;
+      int step;
+      for (step = 1; (error > approx_error) && ((step % 64 != 0) || service.wanted()); step++) {
+	{
+	  ProbePhase phase("evolve_reflect", cells);
+	  evolve(distributions[(step - 1) % 2], distributions[step % 2], reflect, adv_param, hon_param);
+	}
+	{
+	  ProbePhase phase("stat_distance", cells);
+	  error = stat_distance(distributions[0],distributions[1]);
+	}
+	probe_trace("stationary_error", step, error);
+	sink.put('e', step, error); }
+      delete(distributions[step % 2]);
+      service.ready(distributions[(step - 1) % 2], expected, error <= approx_error); });
+  vector<thread> pool;
+  for (int worker = 0; worker < workers; worker++)
+    pool.push_back(thread([&service] { service.work(); }));
+
+  ofstream record;
+  if (!history.empty()) record.open(history.c_str(), ios::app);
+  for (;;) {
+    talk << "Enter spike power (-1 to quit): " << flush;
+    if (!(cin >> spike) || (spike < 0)) break;
+    talk << "Enter walk length for absorbtion estimates: " << flush;
+    if (!(cin >> w)) break;
+    if (record) record << spike << " " << w << endl;
+    service.ask(spike, w); }
+  service.close();
+  estimate.join();
+  for (thread& worker : pool)
+    worker.join();
+  sink.drain();
+  return 0;
+}
@@ -0,0 +1,160 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <unistd.h>
+#include "barriertools.h"
+#include "batch.h"
+
+using namespace std;
+
+/*
+  Runs pow and powthr queries from job records (see batch.h), without
+  prompts, all in one process. The fields are those pow and powthr ask
+  for:
+
+    tool=pow    hon_param delta adv_param approx_error spike w [every=10]
+    tool=powthr hon_param delta adv_param approx_error threshold spike_begin spike_end
+
+  pow jobs give one "step=... density=..." line every `every' steps,
+  powthr jobs one "spike=... steps=..." line per spike. A job that
+  fails gives a single error="..." line and the batch goes on.
+
+  Stationary distributions are kept, least recently used first out,
+  keyed by (hon_param, adv_param, delta, approx_error), and the walks
+  ping-pong between two buffers instead of allocating every step.
+*/
+
+static LruCache<BarrierDistribution>* stationaries;
+
+static const BarrierDistribution* stationary_for(const JobRecord& job, int delta) {
+  double hon_param = job.number("hon_param");
+  double adv_param = job.number("adv_param");
+  double approx_error = job.number("approx_error");
+  string key = cache_key({hon_param, adv_param, double(delta), approx_error});
+  BarrierDistribution* found = stationaries->find(key);
+  if (found != NULL) return(found);
+  BarrierDistribution* distributions[2];
+  distributions[0] = new BarrierDistribution(delta,identity);
+  distributions[1] = new BarrierDistribution(delta,zero);
+  double error = 1;
+  int step;
+  for  (step = 1; error > approx_error; step++) {
+    evolve(distributions[(step - 1) % 2], distributions[step % 2],
+	   reflect, adv_param, hon_param);
+    error = stat_distance(distributions[0],distributions[1]); }
+  delete(distributions[step % 2]);
+  return(stationaries->insert(key, distributions[(step-1) % 2]));
+}
+
+// Walks from the spike on the stationary distribution; report() gets
+// each step's distribution and says whether to go on.
+template <class Report> static void walk(const BarrierDistribution* stationary,
+					 double spike,
+					 double adv_param,
+					 double hon_param,
+					 Report report) {
+  BarrierDistribution* distributions[2];
+  distributions[0] = convolve_spike(stationary,spike);
+  distributions[1] = new BarrierDistribution(stationary->delta,zero);
+  int step;
+  for (step = 1; ; step++) {
+    evolve(distributions[(step - 1) % 2], distributions[step % 2],
+	   absorb, adv_param, hon_param);
+    if (!report(step, distributions[step % 2])) break; }
+  delete(distributions[0]);
+  delete(distributions[1]);
+}
+
+static void run_job(const JobRecord& job, ostream& out) {
+  string tool = job.text("tool");
+  if ((tool != "pow") && (tool != "powthr")) throw std::invalid_argument("JOB: unknown tool " + tool);
+  int delta = job.integer("delta");
+  if ((delta < 1) || (delta > maxdelta)) throw std::invalid_argument("JOB: delta out of range");
+  double hon_param = job.number("hon_param");
+  double adv_param = job.number("adv_param");
+  const BarrierDistribution* stationary = stationary_for(job, delta);
+  if (tool == "pow") {
+    double spike = job.number("spike");
+    int w = job.integer("w");
+    int every = job.integer("every", 10);
+    if ((spike < 0) || (w < 0) || (every < 1)) throw std::invalid_argument("JOB: spike, w or every out of range");
+    if (w == 0) return;
+    walk(stationary, spike, adv_param, hon_param,
+	 [&](int step, const BarrierDistribution* current) {
+	   if (step % every == 0)
+	     out << job.lead() << " step=" << step << " density=" << current->pdensity() << "\n";
+	   return(step < w); }); }
+  else {
+    double threshold = job.number("threshold");
+    int spike_begin = job.integer("spike_begin");
+    int spike_end = job.integer("spike_end");
+    if (spike_begin < 0) throw std::invalid_argument("JOB: spike_begin out of range");
+    for (int spike = spike_begin; spike <= spike_end; spike++) {
+      int steps = 0;
+      walk(stationary, double(spike), adv_param, hon_param,
+	   [&](int step, const BarrierDistribution* current) {
+	     steps = step;
+	     return(current->pdensity() > threshold); });
+      out << job.lead() << " spike=" << spike << " steps=" << steps << "\n"; }}
+}
+
+int main(int argc, char **argv)
+{
+  int cached = 64;
+  int precision = 17;
+  int option;
+
+  while ((option = getopt(argc, argv, "c:p:")) != -1)
+    if (option == 'c') cached = atoi(optarg);
+    else if (option == 'p') precision = atoi(optarg);
+    else {
+      cout << "Usage: " << argv[0] << " [-c cached_stationaries] [-p precision] [job_file ...]" << endl;
+      cout << "  reads job records from the files, or from standard input if none are given" << endl;
+      return 1; }
+  stationaries = new LruCache<BarrierDistribution>(cached);
+  cout << setprecision(precision);
+
+  int failed = 0;
+  for (int file = optind; (file < argc) || (file == optind); file++) {
+    ifstream opened;
+    if (file < argc) {
+      opened.open(argv[file]);
+      if (!opened) {
+	cerr << "Cannot read " << argv[file] << endl;
+	return 1; }}
+    istream& jobs = (file < argc) ? opened : cin;
+    string line;
+    while (getline(jobs, line)) {
+      if (JobRecord::blank(line)) continue;
+      string lead = "id=- tool=-";
+      try {
+	JobRecord job(line);
+	lead = job.lead();
+	run_job(job, cout); }
+      catch (std::exception& failure) {
+	cout << lead << " " << error_field(failure.what()) << "\n";
+	failed++; }
+      cout << std::flush; }}
+  delete(stationaries);
+  return(failed > 0 ? 2 : 0);
+}
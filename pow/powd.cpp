@@ -0,0 +1,227 @@
+/*
+Copyright [2020] Alexander Russell
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+
+#include <iostream>
+#include <stdexcept>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <mutex>
+#include <algorithm>
+#include <thread>
+#include <unistd.h>
+#include "barriertools.h"
+#include "batch.h"
+#include "daemon.h"
+
+using namespace std;
+
+/*
+  Answers pow and powthr queries over a Unix-domain socket (or a
+  loopback TCP port), with the job records and result lines of
+  powbatch. powthr jobs may add w=N to give up after N steps (default
+  100000), with a "spike=... underflow=1" line.
+
+  Every walk, keyed by the stationary distribution's parameters and
+  the spike, is kept: its latest distribution and the density at each
+  step so far. A query within the steps already walked is a lookup,
+  answered at once; one beyond them walks on from a copy of the latest
+  distribution, on one of -j worker threads (see daemon.h). The walks
+  and the stationary distributions share one LRU cache with a memory
+  budget. tool=stats reports the cache.
+*/
+
+struct Walk {
+  BarrierDistribution* latest;    // at step density.size()
+  BarrierDistribution* spare;
+  vector<double>       density;   // density[s - 1] at step s
+  Walk(BarrierDistribution* start) : latest(start),
+				     spare(new BarrierDistribution(start->delta,zero)) {}
+  ~Walk() {
+    delete(latest);
+    delete(spare);
+  }
+  size_t bytes() const {
+    return(latest->bytes() + spare->bytes() + density.capacity() * sizeof(double));
+  }
+  // Walked far enough for a query: `steps' long, or down to `until'.
+  bool covers(int steps, double until) const {
+    return((int(density.size()) >= steps) || (!density.empty() && (density.back() <= until)));
+  }
+};
+
+static LruCache<BarrierDistribution>* stationaries;
+static LruCache<Walk>* walks;
+
+// A copy of the stationary distribution, computed unless cached.
+static BarrierDistribution* stationary_for(double hon_param,
+					   double adv_param,
+					   int delta,
+					   double approx_error) {
+  string key = cache_key({hon_param, adv_param, double(delta), approx_error});
+  {
+    lock_guard<mutex> guard(cache_lock());
+    BarrierDistribution* found = stationaries->find(key);
+    if (found != NULL) return(new BarrierDistribution(found));
+  }
+  BarrierDistribution* distributions[2];
+  distributions[0] = new BarrierDistribution(delta,identity);
+  distributions[1] = new BarrierDistribution(delta,zero);
+  double error = 1;
+  int step;
+  for  (step = 1; error > approx_error; step++) {
+    evolve(distributions[(step - 1) % 2], distributions[step % 2],
+	   reflect, adv_param, hon_param);
+    error = stat_distance(distributions[0],distributions[1]); }
+  delete(distributions[step % 2]);
+  BarrierDistribution* result = distributions[(step-1) % 2];
+  lock_guard<mutex> guard(cache_lock());
+  if (stationaries->find(key) == NULL)
+    stationaries->insert(key, new BarrierDistribution(result), result->bytes());
+  return(result);
+}
+
+/* The densities of the walk from `spike', at least `steps' of them
+   unless `until' is reached first. With cached_only, under
+   cache_lock(), those of the cached walk, NULL if it falls short.
+   Otherwise the walk goes on from a copy of the cached one, without
+   the lock, into own, and replaces the cached one if it got further. */
+static const vector<double>* densities(const JobRecord& job, int delta, double spike,
+				       int steps, double until, bool cached_only,
+				       vector<double>& own) {
+  double hon_param = job.number("hon_param");
+  double adv_param = job.number("adv_param");
+  double approx_error = job.number("approx_error");
+  string key = cache_key({hon_param, adv_param, double(delta), approx_error, spike});
+  if (cached_only) {
+    Walk* walk = walks->find(key);
+    return(((walk != NULL) && walk->covers(steps, until)) ? &walk->density : NULL); }
+  Walk* extended = NULL;
+  {
+    lock_guard<mutex> guard(cache_lock());
+    Walk* walk = walks->find(key);
+    if (walk != NULL) {
+      own = walk->density;
+      if (walk->covers(steps, until)) return(&own);
+      extended = new Walk(new BarrierDistribution(walk->latest));
+      extended->density = walk->density; }
+  }
+  if (extended == NULL) {
+    BarrierDistribution* stationary = stationary_for(hon_param, adv_param, delta, approx_error);
+    extended = new Walk(convolve_spike(stationary,spike));
+    delete(stationary); }
+  while (!extended->covers(steps, until)) {
+    evolve(extended->latest, extended->spare, absorb, adv_param, hon_param);
+    swap(extended->latest, extended->spare);
+    extended->density.push_back(extended->latest->pdensity()); }
+  own = extended->density;
+  lock_guard<mutex> guard(cache_lock());
+  Walk* walk = walks->find(key);
+  if (walk == NULL)
+    walks->insert(key, extended, extended->bytes());
+  else {
+    // Charged for its grown range as it goes back in.
+    if (walk->density.size() < extended->density.size()) {
+      swap(walk->latest, extended->latest);
+      swap(walk->spare, extended->spare);
+      walk->density.swap(extended->density);
+      walks->resize(key, walk->bytes()); }
+    delete(extended); }
+  return(&own);
+}
+
+// Answers a job, into out only if it is answered in full; with
+// cached_only, from the caches or not at all.
+static bool respond(const JobRecord& job, ostream& out, bool cached_only) {
+  string tool = job.text("tool");
+  if (tool == "stats") {
+    unique_lock<mutex> guard(cache_lock(), defer_lock);
+    if (!cached_only) guard.lock();
+    out << job.lead() << " entries=" << walks->size() + stationaries->size()
+	<< " bytes=" << walks->used() + stationaries->used()
+	<< " hits=" << walks->hits << " misses=" << walks->misses << "\n";
+    return(true); }
+  if ((tool != "pow") && (tool != "powthr")) throw std::invalid_argument("JOB: unknown tool " + tool);
+  int delta = job.integer("delta");
+  if ((delta < 1) || (delta > maxdelta)) throw std::invalid_argument("JOB: delta out of range");
+  ostringstream lines;
+  lines.precision(out.precision());
+  vector<double> own;
+  if (tool == "pow") {
+    double spike = job.number("spike");
+    int w = job.integer("w");
+    int every = job.integer("every", 10);
+    if ((spike < 0) || (w < 0) || (every < 1)) throw std::invalid_argument("JOB: spike, w or every out of range");
+    const vector<double>* density = densities(job, delta, spike, w, -1, cached_only, own);
+    if (density == NULL) return(false);
+    for (int step = every; step <= w; step = step + every)
+      lines << job.lead() << " step=" << step << " density=" << (*density)[step - 1] << "\n"; }
+  else {
+    double threshold = job.number("threshold");
+    int spike_begin = job.integer("spike_begin");
+    int spike_end = job.integer("spike_end");
+    int w = job.integer("w", 100000);
+    if ((spike_begin < 0) || (w < 1)) throw std::invalid_argument("JOB: spike_begin or w out of range");
+    for (int spike = spike_begin; spike <= spike_end; spike++) {
+      const vector<double>* density = densities(job, delta, double(spike), w, threshold, cached_only, own);
+      if (density == NULL) return(false);
+      int step;
+      for (step = 1; step <= min(w, int(density->size())); step++)
+	if ((*density)[step - 1] <= threshold) break;
+      if ((step <= w) && (step <= int(density->size())))
+	lines << job.lead() << " spike=" << spike << " steps=" << step << "\n";
+      else
+	lines << job.lead() << " spike=" << spike << " underflow=1\n"; }}
+  out << lines.str();
+  return(true);
+}
+
+static bool lookup(const JobRecord& job, ostream& out) {
+  return(respond(job, out, true));
+}
+
+static void answer(const JobRecord& job, ostream& out) {
+  respond(job, out, false);
+}
+
+int main(int argc, char **argv)
+{
+  string path = "/tmp/powd.sock";
+  int port = 0;
+  long megabytes = 256;
+  int precision = 17;
+  int workers = max(1u, thread::hardware_concurrency());
+  int option;
+
+  while ((option = getopt(argc, argv, "s:P:m:p:j:")) != -1)
+    if (option == 's') path = optarg;
+    else if (option == 'P') port = atoi(optarg);
+    else if (option == 'm') megabytes = atol(optarg);
+    else if (option == 'p') precision = atoi(optarg);
+    else if (option == 'j') workers = atoi(optarg);
+    else {
+      cout << "Usage: " << argv[0] << " [-s socket_path | -P localhost_port] [-m cache_megabytes] [-p precision] [-j workers]" << endl;
+      cout << "  serves powbatch job records, one per line; each reply ends with a line \".\"" << endl;
+      return 1; }
+  stationaries = new LruCache<BarrierDistribution>(1 << 20, (megabytes << 20) / 4);
+  walks = new LruCache<Walk>(1 << 20, megabytes << 20);
+  int listener = (port > 0) ? listen_local_tcp(port) : listen_unix(path);
+  cout << "powd: serving on " << ((port > 0) ? "localhost:" + to_string(port) : path) << endl;
+  serve_queries(listener, lookup, answer, precision, workers);
+  return 0;
+}
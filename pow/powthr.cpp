@@ -18,7 +18,10 @@ limitations under the License.
 #include <iostream>
 #include <stdexcept>
 #include <cmath>
+#include <string>
 #include "barriertools.h"
+#define PROBE_ALLOCATIONS
+#include "probe.h"
 
 using namespace std;
 
@@ -33,6 +36,7 @@ int main()
   BarrierDistribution* distributions[2];
   BarrierDistribution* stationary;
   
+  probe_start("powthr");
   cout << "Enter Poisson parameter for honest distribution: ";
   cin  >> hon_param;
   
@@ -46,19 +50,28 @@ int main()
   cout << "Enter step-to-step approximation error : ";
   cin  >> approx_error;
 
+  double cells = double(footprint) * (2 * delta + 2);
   distributions[0] = new BarrierDistribution(delta,identity);
   cout << "Estimating stationary distribution...\n";
   double error = 1;
   for  (step = 1; error > approx_error; step++) {
-    distributions[step % 2] = evolve(distributions[(step - 1) % 2],
-				     reflect,
-				     adv_param, hon_param);
-    error = stat_distance(distributions[0],distributions[1]);
+    {
+      ProbePhase phase("evolve_reflect", cells);
+      distributions[step % 2] = evolve(distributions[(step - 1) % 2],
+				       reflect,
+				       adv_param, hon_param);
+    }
+    {
+      ProbePhase phase("stat_distance", cells);
+      error = stat_distance(distributions[0],distributions[1]);
+    }
     delete(distributions[(step - 1) % 2]);
+    probe_trace("stationary_error", step, error);
     cout << "[" << step << ":" << error << "]  \r" << std::flush; }
   cout << "\n";
   stationary = distributions[(step-1) % 2];
   cout << "Stationary approximation complete.\n";
+  cout << "Truncation loss " << stationary->leak() << ", beta range 0..." << stationary->range() << "\n";
 
   cout << "Enter desired stabilization error threshold: ";
   cin  >> error_threshold;
@@ -70,16 +83,29 @@ int main()
   cin  >> spike_end;
   
   for (int spike = spike_begin; spike <= spike_end; spike++) {
-    distributions[0] = convolve_spike(stationary,double (spike));
+    {
+      ProbePhase phase("convolve_spike", cells);
+      distributions[0] = convolve_spike(stationary,double (spike));
+    }
+    string trace = probe_on() ? "density spike=" + to_string(spike) : "";
     step = 0; error = 1.0;
     while (error > error_threshold) {
       step++;
-      distributions[step % 2] = evolve(distributions[(step - 1) % 2],
-				       absorb,
-				       adv_param, hon_param);
+      {
+	ProbePhase phase("evolve_absorb", cells);
+	distributions[step % 2] = evolve(distributions[(step - 1) % 2],
+					 absorb,
+					 adv_param, hon_param);
+      }
       delete(distributions[(step - 1) % 2]);
-      error = distributions[step % 2]->pdensity(); }
-    cout << "(" << spike << ", " << step << ")\n" << std::flush;
+      {
+	ProbePhase phase("pdensity", cells);
+	error = distributions[step % 2]->pdensity();
+      }
+      probe_trace(trace, step, error); }
+    cout << "(" << spike << ", " << step << ")\n";
+    cout << "Truncation loss " << distributions[step % 2]->leak() << ", beta range 0..."
+	 << distributions[step % 2]->range() << "\n" << std::flush;
     delete(distributions[step % 2]); }
   delete(stationary);
   return 0;